@@ -54,6 +54,7 @@ auto BufferPoolManagerInstance::FlushPgImp(page_id_t page_id) -> bool {
   }
   frame_id_t frame_id = it->second;
   Page *page = &pages_[frame_id];
+  ForceLogFor(page);
   disk_manager_->WritePage(page_id, page->GetData());
   page->is_dirty_ = false;
   return true;
@@ -63,6 +64,7 @@ void BufferPoolManagerInstance::FlushAllPgsImp() {
   std::lock_guard<std::mutex> guard(latch_);
   for (auto &it : page_table_) {
     Page *page = &pages_[it.second];
+    ForceLogFor(page);
     disk_manager_->WritePage(it.first, page->GetData());
     page->is_dirty_ = false;
   }
@@ -101,6 +103,7 @@ auto BufferPoolManagerInstance::AcquireFrame() -> frame_id_t {
     Page *victimed = &pages_[frame_id];
     page_table_.erase(victimed->GetPageId());
     if (victimed->IsDirty()) {
+      ForceLogFor(victimed);
       disk_manager_->WritePage(victimed->GetPageId(), victimed->GetData());
     }
   } else {
@@ -189,6 +192,13 @@ auto BufferPoolManagerInstance::UnpinPgImp(page_id_t page_id, bool is_dirty) ->
   return true;
 }
 
+void BufferPoolManagerInstance::ForceLogFor(Page *page) {
+  // WAL: the log must be persistent up to the page LSN before the page itself
+  if (enable_logging && log_manager_ != nullptr && page->GetLSN() > log_manager_->GetPersistentLSN()) {
+    log_manager_->Flush();
+  }
+}
+
 auto BufferPoolManagerInstance::AllocatePage() -> page_id_t {
   const page_id_t next_page_id = next_page_id_;
   next_page_id_ += num_instances_;
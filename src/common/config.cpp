@@ -18,6 +18,12 @@ std::atomic<bool> enable_logging(false);
 
 std::chrono::duration<int64_t> log_timeout = std::chrono::seconds(1);
 
+std::chrono::microseconds group_commit_max_wait = std::chrono::microseconds(0);
+
+int group_commit_max_batch = 32;
+
+int lock_escalation_threshold = 5000;
+
 std::chrono::milliseconds cycle_detection_interval = std::chrono::milliseconds(50);
 
 }  // namespace bustub
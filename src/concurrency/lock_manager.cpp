@@ -10,153 +10,211 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include <algorithm>
 #include <utility>
 #include <vector>
 
 #include "concurrency/lock_manager.h"
+#include "common/util/hash_util.h"
 
 namespace bustub {
-auto LockManager::LockShared(Transaction *txn, const RID &rid) -> bool {
+
+LockManager::LockManager(size_t num_shards, DeadlockPolicy policy)
+    : num_shards_(num_shards), shards_(std::make_unique<Shard[]>(num_shards)), policy_(policy) {
+  if (policy_ == DeadlockPolicy::DETECTION) {
+    enable_cycle_detection_ = true;
+    cycle_detection_thread_ = std::thread(&LockManager::RunCycleDetection, this);
+  }
+}
+
+LockManager::~LockManager() {
+  if (cycle_detection_thread_.joinable()) {
+    {
+      std::lock_guard lk(detection_latch_);
+      enable_cycle_detection_ = false;
+    }
+    detection_cv_.notify_one();
+    cycle_detection_thread_.join();
+  }
+}
+
+auto LockManager::LockShared(Transaction *txn, const RID &rid, std::optional<table_oid_t> oid) -> bool {
+  if (oid.has_value() && TableLockCovers(txn, *oid, LockMode::SHARED)) {
+    return txn->GetState() != TransactionState::ABORTED;
+  }
+  if (txn->IsIncrementLocked(rid)) {
+    return LockUpgrade(txn, rid, oid);
+  }
+  if (!LockGroupRow(txn, rid, LockMode::SHARED)) {
+    return false;
+  }
+  return !oid.has_value() || CountRowLock(txn, *oid, rid);
+}
+
+auto LockManager::LockExclusive(Transaction *txn, const RID &rid, std::optional<table_oid_t> oid) -> bool {
+  if (oid.has_value() && TableLockCovers(txn, *oid, LockMode::EXCLUSIVE)) {
+    return txn->GetState() != TransactionState::ABORTED;
+  }
+  if (txn->IsIncrementLocked(rid)) {
+    return LockUpgrade(txn, rid, oid);
+  }
+  if (!LockExclusiveRow(txn, rid)) {
+    return false;
+  }
+  return !oid.has_value() || CountRowLock(txn, *oid, rid);
+}
+
+auto LockManager::LockIncrement(Transaction *txn, const RID &rid, std::optional<table_oid_t> oid) -> bool {
+  if (oid.has_value() && TableLockCovers(txn, *oid, LockMode::INCREMENT)) {
+    return txn->GetState() != TransactionState::ABORTED;
+  }
+  if (txn->IsSharedLocked(rid)) {
+    // reading and adding to the record make an exclusive lock
+    return LockUpgrade(txn, rid, oid);
+  }
+  if (!LockGroupRow(txn, rid, LockMode::INCREMENT)) {
+    return false;
+  }
+  return !oid.has_value() || CountRowLock(txn, *oid, rid);
+}
+
+auto LockManager::LockUpgrade(Transaction *txn, const RID &rid, std::optional<table_oid_t> oid) -> bool {
+  if (oid.has_value() && TableLockCovers(txn, *oid, LockMode::EXCLUSIVE)) {
+    return txn->GetState() != TransactionState::ABORTED;
+  }
+  if (!LockUpgradeRow(txn, rid)) {
+    return false;
+  }
+  return !oid.has_value() || CountRowLock(txn, *oid, rid);
+}
+
+auto LockManager::LockGroupRow(Transaction *txn, const RID &rid, LockMode lock_mode) -> bool {
   txn_id_t txn_id = txn->GetTransactionId();
   // LOG_DEBUG("transaction %d LockShared %s", txn_id, rid.ToString().c_str());
-  if (txn->GetIsolationLevel() == IsolationLevel::READ_UNCOMMITTED) {
+  if (lock_mode == LockMode::SHARED && txn->GetIsolationLevel() == IsolationLevel::READ_UNCOMMITTED) {
     // READ_UNCOMMITTED read data without lock
-    txn->SetState(TransactionState::ABORTED);
-    throw TransactionAbortException(txn_id, AbortReason::LOCKSHARED_ON_READ_UNCOMMITTED);
+    AbortWith(txn, AbortReason::LOCKSHARED_ON_READ_UNCOMMITTED);
   }
-  if (txn->IsSharedLocked(rid)) {
+  if (txn->IsSharedLocked(rid) || txn->IsIncrementLocked(rid)) {
     UNREACHABLE("duplicated lock");
   }
+  if (lock_mode == LockMode::INCREMENT && txn->IsReadOnly()) {
+    AbortWith(txn, AbortReason::WRITE_ON_READ_ONLY);
+  }
   if (txn->GetState() == TransactionState::SHRINKING) {
-    txn->SetState(TransactionState::ABORTED);
-    throw TransactionAbortException(txn_id, AbortReason::LOCK_ON_SHRINKING);
+    AbortWith(txn, AbortReason::LOCK_ON_SHRINKING);
   }
   if (txn->GetState() == TransactionState::ABORTED) {
     return false;
   }
 
-  std::unique_lock lk(latch_);
-  LockRequestQueue *queue = &lock_table_[rid];
+  Shard &shard = ShardOf(rid);
+  std::unique_lock lk(shard.latch_);
+  LockRequestQueue *queue = QueueOf(&shard, &shard.lock_table_, rid);
   // wound younger transactions
-  bool xfound = false;
-  for (auto it = queue->request_queue_.rbegin(); it != queue->request_queue_.rend(); ++it) {
-    if (it->lock_mode_ == LockMode::EXCLUSIVE || it->txn_id_ == queue->upgrading_) {
-      xfound = true;
-    }
-    if (it->txn_id_ > txn_id && it->txn_->GetState() == TransactionState::GROWING && xfound) {
-      // LOG_DEBUG("transaction %d wound %d because conflict on %s", txn_id, it->txn_id_, rid.ToString().c_str());
-      it->txn_->SetState(TransactionState::ABORTED);
-      auto blk = blocking_.find(it->txn_id_);
-      if (blk != blocking_.end()) {
-        lock_table_[blk->second].cv_.notify_all();
+  std::vector<txn_id_t> wounded;
+  if (policy_ == DeadlockPolicy::WOUND_WAIT) {
+    // from the back of the queue, the last conflicting request and everybody in front of it
+    bool xfound = false;
+    auto wound = [&](LockRequest &r) {
+      if (!AreCompatible(r.lock_mode_, lock_mode) || r.txn_id_ == queue->upgrading_) {
+        xfound = true;
       }
-    }
+      if (r.txn_id_ > txn_id && r.txn_->GetState() == TransactionState::GROWING && xfound) {
+        // LOG_DEBUG("transaction %d wound %d because conflict on %s", txn_id, r.txn_id_, rid.ToString().c_str());
+        r.txn_->SetState(TransactionState::ABORTED);
+        wounded.push_back(r.txn_id_);
+      }
+    };
+    std::for_each(queue->waiting_.rbegin(), queue->waiting_.rend(), wound);
+    std::for_each(queue->granted_.rbegin(), queue->granted_.rend(), wound);
   }
 
-  {
-    LockRequest &req = queue->request_queue_.emplace_back(txn_id, LockMode::SHARED);
-    req.txn_ = txn;
+  bool grantable = queue->upgrading_ == INVALID_TXN_ID && CompatibleWithAll(queue->granted_count_, lock_mode) &&
+                   CompatibleWithAll(queue->waiting_count_, lock_mode);
+  LockRequest *request = queue->Add(txn, lock_mode, grantable);
+  if (!wounded.empty()) {
+    lk.unlock();
+    NotifyAborted(wounded);
+    lk.lock();
   }
-  queue->cv_.wait(lk, [&] {
-    if (txn->GetState() == TransactionState::ABORTED) {
-      return true;
-    }
-    if (queue->upgrading_ != INVALID_TXN_ID) {
-      blocking_[txn_id] = rid;
-      return false;
-    }
-    for (auto &r : queue->request_queue_) {
-      if (r.txn_id_ == txn_id) {
-        return true;
-      }
-      if (r.lock_mode_ == LockMode::EXCLUSIVE) {
-        blocking_[txn_id] = rid;
-        return false;
-      }
-    }
-    UNREACHABLE("request_queue_ must contains this request");
-  });
-  blocking_.erase(txn_id);
+  RecordWait(&shard, &shard.row_waits_, rid, WaitForGrant(txn, &shard, request, lock_mode, &lk));
   if (txn->GetState() == TransactionState::ABORTED) {
     // LOG_DEBUG("transaction %d start abort", txn_id);
-    queue->request_queue_.remove_if([&](LockRequest r) { return r.txn_id_ == txn_id; });
-    queue->cv_.notify_all();
+    // a wounder may have dropped the request, and the queue with it, while the latch was released
+    ReleaseRequest(&shard, &shard.lock_table_, rid, txn, true);
     return false;
   }
-  queue->Grant(txn_id);
-  txn->GetSharedLockSet()->emplace(rid);
+  txn->AddDependency(queue->released_commit_lsn_);
+  (lock_mode == LockMode::SHARED ? txn->GetSharedLockSet() : txn->GetIncrementLockSet())->emplace(rid);
   // LOG_DEBUG("transaction %d got shared-lock", txn_id);
   return true;
 }
 
-auto LockManager::LockExclusive(Transaction *txn, const RID &rid) -> bool {
+auto LockManager::LockExclusiveRow(Transaction *txn, const RID &rid) -> bool {
   txn_id_t txn_id = txn->GetTransactionId();
   // LOG_DEBUG("transaction %d LockExclusive %s", txn_id, rid.ToString().c_str());
   if (txn->IsExclusiveLocked(rid)) {
     UNREACHABLE("duplicated lock");
   }
+  if (txn->IsReadOnly()) {
+    AbortWith(txn, AbortReason::WRITE_ON_READ_ONLY);
+  }
   if (txn->GetState() == TransactionState::SHRINKING) {
-    txn->SetState(TransactionState::ABORTED);
-    throw TransactionAbortException(txn_id, AbortReason::LOCK_ON_SHRINKING);
+    AbortWith(txn, AbortReason::LOCK_ON_SHRINKING);
   }
   if (txn->GetState() == TransactionState::ABORTED) {
     return false;
   }
-  std::unique_lock lk(latch_);
-  LockRequestQueue *queue = &lock_table_[rid];
+  Shard &shard = ShardOf(rid);
+  std::unique_lock lk(shard.latch_);
+  LockRequestQueue *queue = QueueOf(&shard, &shard.lock_table_, rid);
   // wound younger transactions
-  for (auto &req : queue->request_queue_) {
-    if (req.txn_id_ > txn_id && req.txn_->GetState() == TransactionState::GROWING) {
-      // LOG_DEBUG("transaction %d wound %d because conflict on %s", txn_id, req.txn_id_, rid.ToString().c_str());
-      req.txn_->SetState(TransactionState::ABORTED);
-      auto blk = blocking_.find(req.txn_id_);
-      if (blk != blocking_.end()) {
-        lock_table_[blk->second].cv_.notify_all();
+  std::vector<txn_id_t> wounded;
+  if (policy_ == DeadlockPolicy::WOUND_WAIT) {
+    for (auto *requests : {&queue->granted_, &queue->waiting_}) {
+      for (auto &req : *requests) {
+        if (req.txn_id_ > txn_id && req.txn_->GetState() == TransactionState::GROWING) {
+          // LOG_DEBUG("transaction %d wound %d because conflict on %s", txn_id, req.txn_id_, rid.ToString().c_str());
+          req.txn_->SetState(TransactionState::ABORTED);
+          wounded.push_back(req.txn_id_);
+        }
       }
     }
-  }
-  for (auto it = queue->request_queue_.begin(); it != queue->request_queue_.end();) {
-    if (it->txn_->GetState() == TransactionState::ABORTED) {
-      it = queue->request_queue_.erase(it);
-    } else {
-      ++it;
+    if (DropAbortedHolders(queue)) {
+      GrantWaiting(queue, true);
     }
   }
 
-  {
-    LockRequest &req = queue->request_queue_.emplace_back(txn_id, LockMode::EXCLUSIVE);
-    req.txn_ = txn;
+  bool grantable = CompatibleWithAll(queue->granted_count_, LockMode::EXCLUSIVE) &&
+                   CompatibleWithAll(queue->waiting_count_, LockMode::EXCLUSIVE);
+  LockRequest *request = queue->Add(txn, LockMode::EXCLUSIVE, grantable);
+  if (!wounded.empty()) {
+    lk.unlock();
+    NotifyAborted(wounded);
+    lk.lock();
   }
-  queue->cv_.wait(lk, [&] {
-    if (txn->GetState() == TransactionState::ABORTED) {
-      return true;
-    }
-    auto head = queue->request_queue_.begin();
-    if (head->txn_id_ != txn_id) {
-      blocking_[txn_id] = rid;
-      return false;
-    }
-    return true;
-  });
-  blocking_.erase(txn_id);
+  RecordWait(&shard, &shard.row_waits_, rid, WaitForGrant(txn, &shard, request, LockMode::EXCLUSIVE, &lk));
   if (txn->GetState() == TransactionState::ABORTED) {
     // LOG_DEBUG("transaction %d start abort", txn_id);
-    queue->request_queue_.remove_if([&](LockRequest r) { return r.txn_id_ == txn_id; });
-    queue->cv_.notify_all();
+    // a wounder may have dropped the request, and the queue with it, while the latch was released
+    ReleaseRequest(&shard, &shard.lock_table_, rid, txn, true);
     return false;
   }
-  queue->Grant(txn_id);
+  txn->AddDependency(queue->released_commit_lsn_);
   txn->GetExclusiveLockSet()->emplace(rid);
   // LOG_DEBUG("transaction %d got exclusivs-lock", txn_id);
   return true;
 }
 
-auto LockManager::LockUpgrade(Transaction *txn, const RID &rid) -> bool {
+auto LockManager::LockUpgradeRow(Transaction *txn, const RID &rid) -> bool {
   txn_id_t txn_id = txn->GetTransactionId();
   // LOG_DEBUG("transaction %d LockUpgrade %s", txn_id, rid.ToString().c_str());
+  if (txn->IsReadOnly()) {
+    AbortWith(txn, AbortReason::WRITE_ON_READ_ONLY);
+  }
   if (txn->GetState() == TransactionState::SHRINKING) {
-    txn->SetState(TransactionState::ABORTED);
-    throw TransactionAbortException(txn_id, AbortReason::LOCK_ON_SHRINKING);
+    AbortWith(txn, AbortReason::LOCK_ON_SHRINKING);
   }
   if (txn->GetState() == TransactionState::ABORTED) {
     return false;
@@ -165,66 +223,52 @@ auto LockManager::LockUpgrade(Transaction *txn, const RID &rid) -> bool {
     UNREACHABLE("duplicated lock");
   }
 
-  std::unique_lock lk(latch_);
-  LockRequestQueue *queue = &lock_table_[rid];
+  Shard &shard = ShardOf(rid);
+  std::unique_lock lk(shard.latch_);
+  LockRequestQueue *queue = QueueOf(&shard, &shard.lock_table_, rid);
   if (queue->upgrading_ != INVALID_TXN_ID) {
-    txn->SetState(TransactionState::ABORTED);
-    throw TransactionAbortException(txn_id, AbortReason::UPGRADE_CONFLICT);
+    AbortWith(txn, AbortReason::UPGRADE_CONFLICT);
   }
+  LockRequest *request = queue->Find(txn_id);
+  assert(request != nullptr && request->granted_ &&
+         (request->lock_mode_ == LockMode::SHARED || request->lock_mode_ == LockMode::INCREMENT));
+  LockMode held = request->lock_mode_;
   // wound younger transactions
-  for (auto &req : queue->request_queue_) {
-    if (req.lock_mode_ != LockMode::SHARED) {
-      break;
-    }
-    if (req.txn_id_ > txn_id) {
-      if (req.txn_->GetState() == TransactionState::GROWING && req.granted_) {
+  std::vector<txn_id_t> wounded;
+  if (policy_ == DeadlockPolicy::WOUND_WAIT) {
+    for (auto &req : queue->granted_) {
+      if (req.txn_id_ > txn_id && req.txn_->GetState() == TransactionState::GROWING) {
         // LOG_DEBUG("transaction %d wound %d because conflict on %s", txn_id, req.txn_id_, rid.ToString().c_str());
         req.txn_->SetState(TransactionState::ABORTED);
-        auto blk = blocking_.find(req.txn_id_);
-        if (blk != blocking_.end()) {
-          lock_table_[blk->second].cv_.notify_all();
-        }
+        wounded.push_back(req.txn_id_);
       }
-    } else if (req.txn_id_ == txn_id) {
-      // consider this situation:
-      //   request_queue_: (txn4,ungranted) (txn2,granted) (txn1,granted) (txn3,granted)
-      // txn2 try to upgrade lock, and we have to abort txn3.
-      // but there is no need to abort txn4 only if we move txn2 to front:
-      //   request_queue_: (txn2,granted) (txn4,ungranted) (txn1,granted)
-      // Then things will occur: txn1.unlock -> txn2.upgrade ->txn2.unlock -> txn4.sharedLock
-      auto head = queue->request_queue_.begin();
-      std::swap(*head, req);
     }
   }
 
+  // the upgrade goes before every waiting request, once it is the last holder
   queue->upgrading_ = txn_id;
-  queue->cv_.wait(lk, [&] {
-    if (txn->GetState() == TransactionState::ABORTED) {
-      return true;
-    }
-    auto it = queue->request_queue_.begin();
-    assert(it->txn_id_ == txn_id);
-    for (++it; it != queue->request_queue_.end(); ++it) {
-      if (it->lock_mode_ != LockMode::SHARED) {
-        break;
-      }
-      if (it->txn_id_ < txn_id && it->granted_) {
-        blocking_[txn_id] = rid;
-        return false;
-      }
-    }
-    return true;
-  });
-  blocking_.erase(txn_id);
+  if (policy_ == DeadlockPolicy::WOUND_WAIT) {
+    DropAbortedHolders(queue);
+  }
+  GrantWaiting(queue, true);
+  if (!wounded.empty()) {
+    lk.unlock();
+    NotifyAborted(wounded);
+    lk.lock();
+  }
+  RecordWait(&shard, &shard.row_waits_, rid, WaitForGrant(txn, &shard, request, LockMode::EXCLUSIVE, &lk));
   queue->upgrading_ = INVALID_TXN_ID;
   if (txn->GetState() == TransactionState::ABORTED) {
+    // it keeps the lock it held
+    if (request->lock_mode_ == LockMode::EXCLUSIVE) {
+      queue->ChangeMode(request, held);
+    }
+    // the waiting requests were held back by the upgrade
+    GrantWaiting(queue, true);
     return false;
   }
-  auto head = queue->request_queue_.begin();
-  assert(head->txn_id_ == txn_id);
-  assert(head->lock_mode_ == LockMode::SHARED);
-  head->lock_mode_ = LockMode::EXCLUSIVE;
   txn->GetSharedLockSet()->erase(rid);
+  txn->GetIncrementLockSet()->erase(rid);
   txn->GetExclusiveLockSet()->emplace(rid);
   // LOG_DEBUG("transaction %d upgraded to exclusivs-lock", txn_id);
   return true;
@@ -232,56 +276,805 @@ auto LockManager::LockUpgrade(Transaction *txn, const RID &rid) -> bool {
 
 auto LockManager::Unlock(Transaction *txn, const RID &rid) -> bool {
   // LOG_DEBUG("transaction %d Unlock %s", txn->GetTransactionId(), rid.ToString().c_str());
-  std::lock_guard lk(latch_);
-  LockRequestQueue *queue = &lock_table_[rid];
-  auto it = queue->request_queue_.begin();
-  for (; it != queue->request_queue_.end(); ++it) {
-    if (it->txn_id_ == txn->GetTransactionId()) {
+  // GROWING -> SHRINKING
+  if (txn->GetState() == TransactionState::GROWING) {
+    if (txn->IsExclusiveLocked(rid) || txn->IsIncrementLocked(rid) ||
+        txn->GetIsolationLevel() == IsolationLevel::REPEATABLE_READ) {
+      txn->SetState(TransactionState::SHRINKING);
+    }
+  }
+  ReleaseRow(txn, rid);
+  for (auto &[oid, rids] : *txn->GetTableRowLockSet()) {
+    if (rids.erase(rid) != 0) {
       break;
     }
   }
+  return true;
+}
+
+void LockManager::ReleaseRow(Transaction *txn, const RID &rid) {
+  Shard &shard = ShardOf(rid);
+  {
+    std::lock_guard lk(shard.latch_);
+    ReleaseRequest(&shard, &shard.lock_table_, rid, txn, true);
+  }
+  txn->GetSharedLockSet()->erase(rid);
+  txn->GetExclusiveLockSet()->erase(rid);
+  txn->GetIncrementLockSet()->erase(rid);
+}
+
+auto LockManager::TableLockCovers(Transaction *txn, table_oid_t oid, LockMode lock_mode) -> bool {
+  std::optional<LockMode> held = GetTableLockMode(txn, oid);
+  if (!held.has_value()) {
+    return false;
+  }
+  if (lock_mode == LockMode::SHARED) {
+    return *held == LockMode::SHARED || *held == LockMode::SHARED_INTENTION_EXCLUSIVE ||
+           *held == LockMode::EXCLUSIVE;
+  }
+  return *held == LockMode::EXCLUSIVE;
+}
+
+auto LockManager::CountRowLock(Transaction *txn, table_oid_t oid, const RID &rid) -> bool {
+  auto &rids = (*txn->GetTableRowLockSet())[oid];
+  rids.emplace(rid);
+  if (lock_escalation_threshold <= 0 || rids.size() < static_cast<size_t>(lock_escalation_threshold)) {
+    return true;
+  }
+  bool exclusive = std::any_of(rids.begin(), rids.end(),
+                               [&](const RID &r) { return txn->IsExclusiveLocked(r) || txn->IsIncrementLocked(r); });
+  // combined with the intention lock held, if any, e.g. S records under IX make SIX
+  if (!LockTable(txn, exclusive ? LockMode::EXCLUSIVE : LockMode::SHARED, oid)) {
+    return false;
+  }
+  // the table lock covers the records now, releasing them is no step towards shrinking
+  for (const RID &r : rids) {
+    ReleaseRow(txn, r);
+  }
+  txn->GetTableRowLockSet()->erase(oid);
+  return true;
+}
+
+auto LockManager::LockTable(Transaction *txn, LockMode lock_mode, table_oid_t oid) -> bool {
+  txn_id_t txn_id = txn->GetTransactionId();
+  if (txn->GetState() == TransactionState::ABORTED) {
+    return false;
+  }
+  if (txn->GetIsolationLevel() == IsolationLevel::READ_UNCOMMITTED && lock_mode != LockMode::EXCLUSIVE &&
+      lock_mode != LockMode::INTENTION_EXCLUSIVE) {
+    AbortWith(txn, AbortReason::LOCKSHARED_ON_READ_UNCOMMITTED);
+  }
+  if (txn->IsReadOnly() && lock_mode != LockMode::SHARED && lock_mode != LockMode::INTENTION_SHARED) {
+    AbortWith(txn, AbortReason::WRITE_ON_READ_ONLY);
+  }
+  if (txn->GetState() == TransactionState::SHRINKING) {
+    AbortWith(txn, AbortReason::LOCK_ON_SHRINKING);
+  }
+  std::optional<LockMode> held = GetTableLockMode(txn, oid);
+  LockMode mode = held.has_value() ? Combine(*held, lock_mode) : lock_mode;
+  if (held == mode) {
+    return true;
+  }
+
+  Shard &shard = ShardOf(oid);
+  std::unique_lock lk(shard.latch_);
+  LockRequestQueue *queue = QueueOf(&shard, &shard.table_lock_table_, oid);
+  bool front = false;
+  if (held.has_value()) {
+    if (queue->upgrading_ != INVALID_TXN_ID) {
+      AbortWith(txn, AbortReason::UPGRADE_CONFLICT);
+    }
+    // the upgrade goes first, it only waits for the other granted locks
+    queue->Erase(txn_id);
+    front = true;
+    queue->upgrading_ = txn_id;
+  }
+
+  // wound younger transactions
+  std::vector<txn_id_t> wounded;
+  for (LockRequest *r :
+       policy_ == DeadlockPolicy::WOUND_WAIT ? TableConflicts(queue, mode, front) : std::vector<LockRequest *>{}) {
+    if (r->txn_id_ > txn_id && r->txn_->GetState() == TransactionState::GROWING) {
+      r->txn_->SetState(TransactionState::ABORTED);
+      wounded.push_back(r->txn_id_);
+    }
+  }
+  bool grantable =
+      CompatibleWithAll(queue->granted_count_, mode) && (front || CompatibleWithAll(queue->waiting_count_, mode));
+  LockRequest *request = queue->Add(txn, mode, grantable, front);
+  if (!wounded.empty()) {
+    lk.unlock();
+    NotifyAborted(wounded);
+    lk.lock();
+  }
+  RecordWait(&shard, &shard.table_waits_, oid, WaitForGrant(txn, &shard, request, mode, &lk));
+  if (held.has_value()) {
+    // the old lock left the queue when the upgrade was queued
+    queue->upgrading_ = INVALID_TXN_ID;
+    TableLockSetOf(txn, *held)->erase(oid);
+  }
+  if (txn->GetState() == TransactionState::ABORTED) {
+    ReleaseRequest(&shard, &shard.table_lock_table_, oid, txn, false);
+    return false;
+  }
+  txn->AddDependency(queue->released_commit_lsn_);
+  TableLockSetOf(txn, mode)->emplace(oid);
+  return true;
+}
+
+auto LockManager::UnlockTable(Transaction *txn, table_oid_t oid) -> bool {
+  std::optional<LockMode> held = GetTableLockMode(txn, oid);
+  if (!held.has_value()) {
+    return false;
+  }
   // GROWING -> SHRINKING
   if (txn->GetState() == TransactionState::GROWING) {
-    if (it->lock_mode_ == LockMode::EXCLUSIVE || txn->GetIsolationLevel() == IsolationLevel::REPEATABLE_READ) {
+    if (*held == LockMode::EXCLUSIVE ||
+        ((*held == LockMode::SHARED || *held == LockMode::SHARED_INTENTION_EXCLUSIVE) &&
+         txn->GetIsolationLevel() == IsolationLevel::REPEATABLE_READ)) {
       txn->SetState(TransactionState::SHRINKING);
     }
   }
+
+  Shard &shard = ShardOf(oid);
+  {
+    std::lock_guard lk(shard.latch_);
+    ReleaseRequest(&shard, &shard.table_lock_table_, oid, txn, false);
+  }
+  TableLockSetOf(txn, *held)->erase(oid);
+  return true;
+}
+
+/*
+ * The keys are sorted by shard, so each shard latch is taken once for all of its keys. Releasing a request grants the
+ * waiters of its queue right away, as Unlock does; they wait for the latch of the shard rather than for the next
+ * Unlock.
+ */
+void LockManager::UnlockAll(Transaction *txn) {
+  // GROWING -> SHRINKING
+  if (txn->GetState() == TransactionState::GROWING &&
+      (!txn->GetExclusiveLockSet()->empty() || !txn->GetIncrementLockSet()->empty() ||
+       !txn->GetExclusiveTableLockSet()->empty() ||
+       (txn->GetIsolationLevel() == IsolationLevel::REPEATABLE_READ &&
+        (!txn->GetSharedLockSet()->empty() || !txn->GetSharedTableLockSet()->empty() ||
+         !txn->GetSharedIntentionExclusiveTableLockSet()->empty())))) {
+    txn->SetState(TransactionState::SHRINKING);
+  }
+
+  std::vector<std::pair<size_t, RID>> rows;
+  rows.reserve(txn->GetSharedLockSet()->size() + txn->GetExclusiveLockSet()->size() +
+               txn->GetIncrementLockSet()->size());
+  // a record is in one of the sets only
+  for (const auto &lock_set : {txn->GetSharedLockSet(), txn->GetExclusiveLockSet(), txn->GetIncrementLockSet()}) {
+    for (const RID &rid : *lock_set) {
+      rows.emplace_back(ShardIndexOf(rid), rid);
+    }
+    lock_set->clear();
+  }
+  std::sort(rows.begin(), rows.end(), [](const auto &l, const auto &r) { return l.first < r.first; });
+  for (auto it = rows.begin(); it != rows.end();) {
+    Shard &shard = shards_[it->first];
+    std::lock_guard lk(shard.latch_);
+    size_t index = it->first;
+    for (; it != rows.end() && it->first == index; ++it) {
+      ReleaseRequest(&shard, &shard.lock_table_, it->second, txn, true);
+    }
+  }
+  txn->GetTableRowLockSet()->clear();
+
+  // a table is in one of the sets only, too
+  std::vector<table_oid_t> tables;
+  for (LockMode mode : {LockMode::SHARED, LockMode::EXCLUSIVE, LockMode::INTENTION_SHARED,
+                        LockMode::INTENTION_EXCLUSIVE, LockMode::SHARED_INTENTION_EXCLUSIVE}) {
+    auto lock_set = TableLockSetOf(txn, mode);
+    tables.insert(tables.end(), lock_set->begin(), lock_set->end());
+    lock_set->clear();
+  }
+  std::sort(tables.begin(), tables.end(),
+            [this](table_oid_t l, table_oid_t r) { return l % num_shards_ < r % num_shards_; });
+  for (auto it = tables.begin(); it != tables.end();) {
+    Shard &shard = ShardOf(*it);
+    std::lock_guard lk(shard.latch_);
+    size_t index = *it % num_shards_;
+    for (; it != tables.end() && *it % num_shards_ == index; ++it) {
+      ReleaseRequest(&shard, &shard.table_lock_table_, *it, txn, false);
+    }
+  }
+}
+
+auto LockManager::GetTableLockMode(Transaction *txn, table_oid_t oid) -> std::optional<LockMode> {
+  for (LockMode mode : {LockMode::SHARED, LockMode::EXCLUSIVE, LockMode::INTENTION_SHARED,
+                        LockMode::INTENTION_EXCLUSIVE, LockMode::SHARED_INTENTION_EXCLUSIVE}) {
+    auto lock_set = TableLockSetOf(txn, mode);
+    if (lock_set->find(oid) != lock_set->end()) {
+      return mode;
+    }
+  }
+  return std::nullopt;
+}
+
+auto LockManager::TableLockSetOf(Transaction *txn, LockMode lock_mode)
+    -> std::shared_ptr<std::unordered_set<table_oid_t>> {
+  switch (lock_mode) {
+    case LockMode::SHARED:
+      return txn->GetSharedTableLockSet();
+    case LockMode::EXCLUSIVE:
+      return txn->GetExclusiveTableLockSet();
+    case LockMode::INTENTION_SHARED:
+      return txn->GetIntentionSharedTableLockSet();
+    case LockMode::INTENTION_EXCLUSIVE:
+      return txn->GetIntentionExclusiveTableLockSet();
+    case LockMode::SHARED_INTENTION_EXCLUSIVE:
+      return txn->GetSharedIntentionExclusiveTableLockSet();
+    case LockMode::INCREMENT:
+      break;
+  }
+  UNREACHABLE("unknown lock mode");
+}
+
+/*
+ * The compatibility matrix of multi-granularity locking, with the increment mode of records:
+ *
+ *        IS   IX   S    SIX  X    INC
+ *   IS   y    y    y    y    n    -
+ *   IX   y    y    n    n    n    -
+ *   S    y    n    y    n    n    n
+ *   SIX  y    n    n    n    n    -
+ *   X    n    n    n    n    n    n
+ *   INC  -    -    n    -    n    y
+ */
+auto LockManager::AreCompatible(LockMode l, LockMode r) -> bool {
+  if (l == LockMode::EXCLUSIVE || r == LockMode::EXCLUSIVE) {
+    return false;
+  }
+  if (l == LockMode::INCREMENT || r == LockMode::INCREMENT) {
+    return l == r;
+  }
+  if (l == LockMode::INTENTION_SHARED || r == LockMode::INTENTION_SHARED) {
+    return true;
+  }
+  if (l == LockMode::SHARED_INTENTION_EXCLUSIVE || r == LockMode::SHARED_INTENTION_EXCLUSIVE) {
+    return false;
+  }
+  // IX and S are each compatible with themselves only
+  return l == r;
+}
+
+/*
+ * The modes are ordered IS < IX, S < SIX < X, with IX and S not comparable: their join is SIX.
+ */
+auto LockManager::Combine(LockMode l, LockMode r) -> LockMode {
+  auto rank = [](LockMode mode) {
+    switch (mode) {
+      case LockMode::INTENTION_SHARED:
+        return 0;
+      case LockMode::INTENTION_EXCLUSIVE:
+      case LockMode::SHARED:
+        return 1;
+      case LockMode::SHARED_INTENTION_EXCLUSIVE:
+        return 2;
+      case LockMode::EXCLUSIVE:
+        return 3;
+      case LockMode::INCREMENT:
+        break;
+    }
+    UNREACHABLE("unknown lock mode");
+  };
+  if (rank(l) == rank(r)) {
+    return l == r ? l : LockMode::SHARED_INTENTION_EXCLUSIVE;
+  }
+  return rank(l) > rank(r) ? l : r;
+}
+
+auto LockManager::ShardIndexOf(const RID &rid) const -> size_t {
+  // std::hash<RID> leaves the page id in the high bits, mix both halves before taking the modulo
+  page_id_t page_id = rid.GetPageId();
+  uint32_t slot_num = rid.GetSlotNum();
+  hash_t hash = HashUtil::CombineHashes(HashUtil::Hash(&page_id), HashUtil::Hash(&slot_num));
+  return hash % num_shards_;
+}
+
+template <typename K>
+auto LockManager::QueueOf(Shard *shard, std::unordered_map<K, LockRequestQueue> *table, const K &key)
+    -> LockRequestQueue * {
+  auto [it, inserted] = table->try_emplace(key);
+  if (inserted) {
+    it->second.pool_ = &shard->request_pool_;
+    it->second.released_commit_lsn_ = shard->reclaimed_commit_lsn_;
+  }
+  return &it->second;
+}
+
+/*
+ * A reclaimed queue leaves its released_commit_lsn_ to the shard, so whoever locks the key next still depends on the
+ * commits released there; it may depend on other commits of the shard as well, which only holds its own commit back
+ * until they are durable too.
+ */
+template <typename K>
+void LockManager::ReleaseRequest(Shard *shard, std::unordered_map<K, LockRequestQueue> *table, const K &key,
+                                 Transaction *txn, bool record_queue) {
+  auto it = table->find(key);
+  if (it == table->end()) {
+    return;
+  }
+  LockRequestQueue *queue = &it->second;
+  LockRequest *request = queue->Find(txn->GetTransactionId());
   // maybe already erased by wounder
-  if (it != queue->request_queue_.end()) {
-    queue->request_queue_.erase(it);
+  if (request == nullptr) {
+    return;
   }
-  if (queue->upgrading_ != INVALID_TXN_ID || !queue->IsLocked()) {
-    queue->cv_.notify_all();
+  // early lock release: the commit record is in the log buffer but maybe not on disk yet; readers depend on every
+  // writer that leaves
+  if (txn->GetState() == TransactionState::COMMITTED && request->lock_mode_ != LockMode::SHARED &&
+      request->lock_mode_ != LockMode::INTENTION_SHARED) {
+    queue->released_commit_lsn_ = std::max(queue->released_commit_lsn_, txn->GetPrevLSN());
+  }
+  queue->Erase(txn->GetTransactionId());
+  if (queue->IsEmpty()) {
+    shard->reclaimed_commit_lsn_ = std::max(shard->reclaimed_commit_lsn_, queue->released_commit_lsn_);
+    table->erase(it);
+    return;
+  }
+  GrantWaiting(queue, record_queue);
+}
+
+auto LockManager::WaitForGrant(Transaction *txn, Shard *shard, LockRequest *request, LockMode lock_mode,
+                               std::unique_lock<std::mutex> *lk) -> std::chrono::nanoseconds {
+  bool blocked = false;
+  std::chrono::steady_clock::time_point start;
+  request->cv_.wait(*lk, [&] {
+    if (txn->GetState() == TransactionState::ABORTED || (request->granted_ && request->lock_mode_ == lock_mode)) {
+      return true;
+    }
+    if (!blocked) {
+      blocked = true;
+      start = std::chrono::steady_clock::now();
+    }
+    SetBlocking(txn->GetTransactionId(), shard, &request->cv_);
+    // a wounder that missed the blocking entry aborted us before it looked
+    return txn->GetState() == TransactionState::ABORTED;
+  });
+  if (!blocked) {
+    return std::chrono::nanoseconds(0);
+  }
+  ClearBlocking(txn->GetTransactionId());
+  auto waited = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+  shard->waits_++;
+  shard->wait_time_ += waited;
+  shard->max_wait_ = std::max(shard->max_wait_, waited);
+  return waited;
+}
+
+template <typename K>
+void LockManager::RecordWait(Shard *shard, std::unordered_map<K, KeyWaits> *waits, const K &key,
+                             std::chrono::nanoseconds waited) {
+  if (waited.count() == 0) {
+    return;
+  }
+  auto it = waits->find(key);
+  if (it == waits->end()) {
+    if (waits->size() == HOT_KEYS_PER_SHARD) {
+      waits->erase(std::min_element(waits->begin(), waits->end(), [](const auto &l, const auto &r) {
+        return l.second.time_ < r.second.time_;
+      }));
+    }
+    it = waits->emplace(key, KeyWaits{}).first;
+  }
+  it->second.count_++;
+  it->second.time_ += waited;
+}
+
+void LockManager::AbortWith(Transaction *txn, AbortReason reason) {
+  txn->SetState(TransactionState::ABORTED);
+  {
+    std::lock_guard lk(stats_latch_);
+    aborts_[reason]++;
+  }
+  throw TransactionAbortException(txn->GetTransactionId(), reason);
+}
+
+auto LockManager::CompatibleWithAll(const ModeCounts &counts, LockMode lock_mode) -> bool {
+  for (size_t i = 0; i < LOCK_MODE_COUNT; i++) {
+    if (counts[i] != 0 && !AreCompatible(static_cast<LockMode>(i), lock_mode)) {
+      return false;
+    }
   }
-  txn->GetSharedLockSet()->erase(rid);
-  txn->GetExclusiveLockSet()->erase(rid);
   return true;
 }
 
-auto LockManager::LockRequestQueue::IsLocked() -> bool {
-  for (auto &r : request_queue_) {
-    if (r.granted_) {
+/*
+ * The requests of aborted transactions that are still waiting are not waited for, they are about to leave the queue.
+ */
+auto LockManager::TableConflicts(LockRequestQueue *queue, LockMode lock_mode, bool front)
+    -> std::vector<LockRequest *> {
+  std::vector<LockRequest *> blockers;
+  for (auto &r : queue->granted_) {
+    if (!AreCompatible(r.lock_mode_, lock_mode)) {
+      blockers.push_back(&r);
+    }
+  }
+  if (!front) {
+    for (auto &r : queue->waiting_) {
+      if (!AreCompatible(r.lock_mode_, lock_mode) && r.txn_->GetState() != TransactionState::ABORTED) {
+        blockers.push_back(&r);
+      }
+    }
+  }
+  return blockers;
+}
+
+/*
+ * A waiting request is granted if it is compatible with the granted requests and with the waiting ones in front of
+ * it, so the waiting requests are walked once with the modes in front of each counted. On a record, nothing behind a
+ * request that has to wait is granted: shared requests wait for every exclusive one in front of them, and an exclusive
+ * one for the front. The upgrade of a record lock goes before all of them, once it is the last holder; the other
+ * holders share its mode.
+ */
+void LockManager::GrantWaiting(LockRequestQueue *queue, bool record_queue) {
+  if (record_queue && queue->upgrading_ != INVALID_TXN_ID) {
+    LockRequest *upgrade = queue->Find(queue->upgrading_);
+    if (upgrade->lock_mode_ != LockMode::EXCLUSIVE &&
+        queue->granted_count_[static_cast<size_t>(upgrade->lock_mode_)] == 1) {
+      queue->ChangeMode(upgrade, LockMode::EXCLUSIVE);
+      upgrade->cv_.notify_one();
+    }
+    return;
+  }
+  ModeCounts ahead{};
+  for (auto it = queue->waiting_.begin(); it != queue->waiting_.end();) {
+    auto next = std::next(it);
+    LockMode mode = it->lock_mode_;
+    if (it->txn_->GetState() == TransactionState::ABORTED) {
+      // it leaves the queue by itself
+    } else if (CompatibleWithAll(queue->granted_count_, mode) && CompatibleWithAll(ahead, mode)) {
+      queue->Grant(it);
+      it->cv_.notify_one();
+    } else if (record_queue || mode == LockMode::EXCLUSIVE) {
+      return;
+    } else {
+      ++ahead[static_cast<size_t>(mode)];
+    }
+    it = next;
+  }
+}
+
+auto LockManager::DropAbortedHolders(LockRequestQueue *queue) -> bool {
+  std::vector<txn_id_t> aborted;
+  for (auto &r : queue->granted_) {
+    if (r.txn_id_ != queue->upgrading_ && r.txn_->GetState() == TransactionState::ABORTED) {
+      aborted.push_back(r.txn_id_);
+    }
+  }
+  for (txn_id_t txn_id : aborted) {
+    queue->Erase(txn_id);
+  }
+  return !aborted.empty();
+}
+
+void LockManager::SetBlocking(txn_id_t txn_id, Shard *shard, std::condition_variable *cv) {
+  std::lock_guard lk(blocking_latch_);
+  blocking_[txn_id] = {shard, cv};
+}
+
+void LockManager::ClearBlocking(txn_id_t txn_id) {
+  std::lock_guard lk(blocking_latch_);
+  blocking_.erase(txn_id);
+}
+
+void LockManager::NotifyAborted(const std::vector<txn_id_t> &victims) {
+  if (!victims.empty()) {
+    std::lock_guard lk(stats_latch_);
+    aborts_[AbortReason::DEADLOCK] += victims.size();
+  }
+  for (txn_id_t txn_id : victims) {
+    Shard *shard;
+    {
+      std::lock_guard lk(blocking_latch_);
+      auto blk = blocking_.find(txn_id);
+      if (blk == blocking_.end()) {
+        // not blocked, it sees the abort before it waits next
+        continue;
+      }
+      shard = blk->second.first;
+    }
+    // the wait handle belongs to a request, which may be gone by now; under the shard latch it is only gone if the
+    // victim is no longer blocked there
+    std::lock_guard lk(shard->latch_);
+    std::lock_guard blk_lk(blocking_latch_);
+    auto blk = blocking_.find(txn_id);
+    if (blk != blocking_.end() && blk->second.first == shard) {
+      blk->second.second->notify_one();
+    }
+  }
+}
+
+void LockManager::AddEdge(txn_id_t t1, txn_id_t t2) { waits_for_[t1].insert(t2); }
+
+void LockManager::RemoveEdge(txn_id_t t1, txn_id_t t2) {
+  auto edges = waits_for_.find(t1);
+  if (edges == waits_for_.end()) {
+    return;
+  }
+  edges->second.erase(t2);
+  if (edges->second.empty()) {
+    waits_for_.erase(edges);
+  }
+}
+
+auto LockManager::HasCycle(txn_id_t *txn_id) -> bool {
+  std::set<txn_id_t> visited;
+  for (const auto &[start, edges] : waits_for_) {
+    std::vector<txn_id_t> path;
+    std::set<txn_id_t> on_path;
+    if (visited.count(start) == 0 && FindCycle(start, &path, &on_path, &visited, txn_id)) {
       return true;
     }
   }
   return false;
 }
 
-void LockManager::LockRequestQueue::Grant(txn_id_t txn_id) {
-  for (auto &r : request_queue_) {
-    if (r.txn_id_ == txn_id) {
-      r.granted_ = true;
-      return;
+auto LockManager::FindCycle(txn_id_t txn_id, std::vector<txn_id_t> *path, std::set<txn_id_t> *on_path,
+                            std::set<txn_id_t> *visited, txn_id_t *victim) -> bool {
+  visited->insert(txn_id);
+  path->push_back(txn_id);
+  on_path->insert(txn_id);
+  auto edges = waits_for_.find(txn_id);
+  if (edges != waits_for_.end()) {
+    for (txn_id_t next : edges->second) {
+      if (on_path->count(next) != 0) {
+        // the cycle is the part of the path from next on
+        *victim = *std::max_element(std::find(path->begin(), path->end(), next), path->end());
+        return true;
+      }
+      if (visited->count(next) == 0 && FindCycle(next, path, on_path, visited, victim)) {
+        return true;
+      }
+    }
+  }
+  path->pop_back();
+  on_path->erase(txn_id);
+  return false;
+}
+
+/*
+ * The shards are latched in order, as by DetectDeadlocks, for a consistent picture.
+ */
+auto LockManager::GetStats(size_t top_n) -> Stats {
+  Stats stats;
+  {
+    std::vector<std::unique_lock<std::mutex>> latches;
+    latches.reserve(num_shards_);
+    for (size_t i = 0; i < num_shards_; i++) {
+      latches.emplace_back(shards_[i].latch_);
+    }
+    for (size_t i = 0; i < num_shards_; i++) {
+      Shard &shard = shards_[i];
+      stats.waits_ += shard.waits_;
+      stats.wait_time_ += shard.wait_time_;
+      stats.max_wait_ = std::max(stats.max_wait_, shard.max_wait_);
+      stats.hot_rows_.insert(stats.hot_rows_.end(), shard.row_waits_.begin(), shard.row_waits_.end());
+      stats.hot_tables_.insert(stats.hot_tables_.end(), shard.table_waits_.begin(), shard.table_waits_.end());
+    }
+  }
+  {
+    std::lock_guard lk(stats_latch_);
+    stats.aborts_ = aborts_;
+  }
+  auto longest = [top_n](auto *keys) {
+    size_t n = std::min(top_n, keys->size());
+    std::partial_sort(keys->begin(), keys->begin() + n, keys->end(),
+                      [](const auto &l, const auto &r) { return l.second.time_ > r.second.time_; });
+    keys->resize(n);
+  };
+  longest(&stats.hot_rows_);
+  longest(&stats.hot_tables_);
+  return stats;
+}
+
+auto LockManager::GetQueueCount() -> size_t {
+  size_t count = 0;
+  for (size_t i = 0; i < num_shards_; i++) {
+    std::lock_guard lk(shards_[i].latch_);
+    count += shards_[i].lock_table_.size() + shards_[i].table_lock_table_.size();
+  }
+  return count;
+}
+
+auto LockManager::GetEdgeList() -> std::vector<std::pair<txn_id_t, txn_id_t>> {
+  std::vector<std::pair<txn_id_t, txn_id_t>> edge_list;
+  for (const auto &[t1, edges] : waits_for_) {
+    for (txn_id_t t2 : edges) {
+      edge_list.emplace_back(t1, t2);
+    }
+  }
+  return edge_list;
+}
+
+/*
+ * All shards are latched at once, in order, for a consistent graph. This cannot deadlock with the Lock functions, which
+ * never wait for a shard latch while holding another one.
+ */
+void LockManager::DetectDeadlocks() {
+  std::vector<std::unique_lock<std::mutex>> latches;
+  latches.reserve(num_shards_);
+  for (size_t i = 0; i < num_shards_; i++) {
+    latches.emplace_back(shards_[i].latch_);
+  }
+  waits_for_.clear();
+  std::unordered_map<txn_id_t, Transaction *> txns;
+  for (size_t i = 0; i < num_shards_; i++) {
+    for (auto &[rid, queue] : shards_[i].lock_table_) {
+      AddWaitEdges(&queue, true, &txns);
+    }
+    for (auto &[oid, queue] : shards_[i].table_lock_table_) {
+      AddWaitEdges(&queue, false, &txns);
+    }
+  }
+  std::vector<txn_id_t> victims;
+  txn_id_t victim;
+  while (HasCycle(&victim)) {
+    txns[victim]->SetState(TransactionState::ABORTED);
+    victims.push_back(victim);
+    waits_for_.erase(victim);
+    for (auto &[txn_id, edges] : waits_for_) {
+      edges.erase(victim);
+    }
+  }
+  latches.clear();
+  NotifyAborted(victims);
+}
+
+void LockManager::AddWaitEdges(LockRequestQueue *queue, bool record_queue,
+                               std::unordered_map<txn_id_t, Transaction *> *txns) {
+  auto mode_of = [&](const LockRequest &r) {
+    return record_queue && r.txn_id_ == queue->upgrading_ ? LockMode::EXCLUSIVE : r.lock_mode_;
+  };
+  if (record_queue && queue->upgrading_ != INVALID_TXN_ID) {
+    // the upgrade waits for every other holder
+    LockRequest *upgrade = queue->Find(queue->upgrading_);
+    if (upgrade->lock_mode_ != LockMode::EXCLUSIVE && upgrade->txn_->GetState() != TransactionState::ABORTED) {
+      (*txns)[upgrade->txn_id_] = upgrade->txn_;
+      for (auto &r : queue->granted_) {
+        if (&r != upgrade) {
+          AddEdge(upgrade->txn_id_, r.txn_id_);
+        }
+      }
+    }
+  }
+  for (auto &waiter : queue->waiting_) {
+    if (waiter.txn_->GetState() == TransactionState::ABORTED) {
+      continue;
+    }
+    (*txns)[waiter.txn_id_] = waiter.txn_;
+    for (auto &r : queue->granted_) {
+      if (!AreCompatible(mode_of(r), waiter.lock_mode_)) {
+        AddEdge(waiter.txn_id_, r.txn_id_);
+      }
+    }
+    for (auto &r : queue->waiting_) {
+      if (&r == &waiter) {
+        break;
+      }
+      if (!AreCompatible(r.lock_mode_, waiter.lock_mode_) && r.txn_->GetState() != TransactionState::ABORTED) {
+        AddEdge(waiter.txn_id_, r.txn_id_);
+      }
     }
   }
-  UNREACHABLE("grant failed");
+}
+
+void LockManager::RunCycleDetection() {
+  std::unique_lock lk(detection_latch_);
+  while (!detection_cv_.wait_for(lk, cycle_detection_interval, [&] { return !enable_cycle_detection_; })) {
+    DetectDeadlocks();
+  }
+}
+
+auto LockManager::LockRequestQueue::Find(txn_id_t txn_id) -> LockRequest * {
+  auto it = requests_.find(txn_id);
+  return it == requests_.end() ? nullptr : &*it->second;
+}
+
+auto LockManager::LockRequestQueue::Add(Transaction *txn, LockMode lock_mode, bool granted, bool front)
+    -> LockRequest * {
+  std::list<LockRequest> *list = granted ? &granted_ : &waiting_;
+  auto pos = granted || !front ? list->end() : list->begin();
+  std::list<LockRequest>::iterator it;
+  if (pool_->empty()) {
+    it = list->emplace(pos, txn->GetTransactionId(), lock_mode);
+  } else {
+    it = pool_->begin();
+    list->splice(pos, *pool_, it);
+    it->txn_id_ = txn->GetTransactionId();
+    it->lock_mode_ = lock_mode;
+  }
+  it->granted_ = granted;
+  it->txn_ = txn;
+  ++(granted ? granted_count_ : waiting_count_)[static_cast<size_t>(lock_mode)];
+  requests_[txn->GetTransactionId()] = it;
+  return &*it;
+}
+
+void LockManager::LockRequestQueue::Grant(std::list<LockRequest>::iterator request) {
+  granted_.splice(granted_.end(), waiting_, request);
+  request->granted_ = true;
+  --waiting_count_[static_cast<size_t>(request->lock_mode_)];
+  ++granted_count_[static_cast<size_t>(request->lock_mode_)];
+}
+
+void LockManager::LockRequestQueue::ChangeMode(LockRequest *request, LockMode lock_mode) {
+  --granted_count_[static_cast<size_t>(request->lock_mode_)];
+  ++granted_count_[static_cast<size_t>(lock_mode)];
+  request->lock_mode_ = lock_mode;
+}
+
+void LockManager::LockRequestQueue::Erase(txn_id_t txn_id) {
+  auto it = requests_.find(txn_id);
+  if (it == requests_.end()) {
+    return;
+  }
+  auto request = it->second;
+  if (request->granted_) {
+    --granted_count_[static_cast<size_t>(request->lock_mode_)];
+    pool_->splice(pool_->end(), granted_, request);
+  } else {
+    --waiting_count_[static_cast<size_t>(request->lock_mode_)];
+    pool_->splice(pool_->end(), waiting_, request);
+  }
+  requests_.erase(it);
 }
 
 auto LockManager::LockRequestQueue::ToString() -> std::string {
   std::ostringstream str_stream;
-  for (auto &r : request_queue_) {
+  for (auto &r : granted_) {
     str_stream << r.ToString() << " ";
   }
+  str_stream << "| ";
+  for (auto &r : waiting_) {
+    str_stream << r.ToString() << " ";
+  }
+  return str_stream.str();
+}
+
+static auto AbortReasonName(AbortReason reason) -> const char * {
+  switch (reason) {
+    case AbortReason::LOCK_ON_SHRINKING:
+      return "LOCK_ON_SHRINKING";
+    case AbortReason::UNLOCK_ON_SHRINKING:
+      return "UNLOCK_ON_SHRINKING";
+    case AbortReason::UPGRADE_CONFLICT:
+      return "UPGRADE_CONFLICT";
+    case AbortReason::DEADLOCK:
+      return "DEADLOCK";
+    case AbortReason::LOCKSHARED_ON_READ_UNCOMMITTED:
+      return "LOCKSHARED_ON_READ_UNCOMMITTED";
+    case AbortReason::SNAPSHOT_WRITE_CONFLICT:
+      return "SNAPSHOT_WRITE_CONFLICT";
+    case AbortReason::VALIDATION_FAILED:
+      return "VALIDATION_FAILED";
+    case AbortReason::WRITE_ON_READ_ONLY:
+      return "WRITE_ON_READ_ONLY";
+  }
+  UNREACHABLE("unknown abort reason");
+}
+
+auto LockManager::Stats::ToString() const -> std::string {
+  auto us = [](std::chrono::nanoseconds time) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(time).count();
+  };
+  std::ostringstream str_stream;
+  str_stream << "waits: " << waits_ << ", " << us(wait_time_) << " us in total, " << us(max_wait_) << " us at most\n";
+  str_stream << "aborts:";
+  for (const auto &[reason, count] : aborts_) {
+    str_stream << " " << AbortReasonName(reason) << "=" << count;
+  }
+  str_stream << "\n";
+  for (const auto &[rid, waits] : hot_rows_) {
+    str_stream << "row " << rid.GetPageId() << ":" << rid.GetSlotNum() << ": " << waits.count_ << " waits, "
+               << us(waits.time_) << " us\n";
+  }
+  for (const auto &[oid, waits] : hot_tables_) {
+    str_stream << "table " << oid << ": " << waits.count_ << " waits, " << us(waits.time_) << " us\n";
+  }
   return str_stream.str();
 }
 
@@ -12,34 +12,70 @@
 
 #include "concurrency/transaction_manager.h"
 
+#include <algorithm>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include "catalog/catalog.h"
 #include "storage/table/table_heap.h"
 
 namespace bustub {
 
-std::unordered_map<txn_id_t, Transaction *> TransactionManager::txn_map = {};
-std::shared_mutex TransactionManager::txn_map_mutex = {};
+TransactionRegistry TransactionManager::txn_registry = {};
 
 auto TransactionManager::Begin(Transaction *txn, IsolationLevel isolation_level) -> Transaction * {
+  if (txn != nullptr && txn->IsReadOnly()) {
+    return BeginReadOnly(txn);
+  }
   // Acquire the global transaction latch in shared mode.
   global_txn_latch_.RLock();
 
   if (txn == nullptr) {
     txn = new Transaction(next_txn_id_++, isolation_level);
   }
-  txn_map_mutex.lock();
-  txn_map[txn->GetTransactionId()] = txn;
-  txn_map_mutex.unlock();
+
+  if (txn->IsSnapshotRead()) {
+    std::lock_guard lk(timestamp_latch_);
+    txn->SetReadTimestamp(last_commit_ts_);
+    active_snapshots_.insert(last_commit_ts_);
+  }
+
+  if (enable_logging) {
+    LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(), LogRecordType::BEGIN);
+    txn->SetPrevLSN(log_manager_->AppendLogRecord(&log_record));
+  }
+  txn_registry.Register(txn);
+  return txn;
+}
+
+auto TransactionManager::BeginReadOnly(Transaction *txn) -> Transaction * {
+  if (txn == nullptr) {
+    txn = new Transaction(next_txn_id_++, IsolationLevel::SNAPSHOT_ISOLATION, true);
+  }
+  assert(txn->IsReadOnly());
+  std::lock_guard lk(timestamp_latch_);
+  txn->SetReadTimestamp(last_commit_ts_);
+  active_snapshots_.insert(last_commit_ts_);
+  // what it reads is only known to be durable once the commits of its snapshot are
+  txn->AddDependency(last_commit_lsn_);
   return txn;
 }
 
-void TransactionManager::Commit(Transaction *txn) {
+auto TransactionManager::Commit(Transaction *txn) -> bool {
+  if (txn->IsReadOnly()) {
+    FinishReadOnly(txn, TransactionState::COMMITTED);
+    return true;
+  }
+  if (txn->GetIsolationLevel() == IsolationLevel::OPTIMISTIC && !Validate(txn)) {
+    Abort(txn);
+    return false;
+  }
   txn->SetState(TransactionState::COMMITTED);
 
   // Perform all deletes before we commit.
+  std::vector<std::pair<TableHeap *, RID>> written;
   auto write_set = txn->GetWriteSet();
   while (!write_set->empty()) {
     auto &item = write_set->back();
@@ -48,17 +84,62 @@ void TransactionManager::Commit(Transaction *txn) {
       // Note that this also releases the lock when holding the page latch.
       table->ApplyDelete(item.rid_, txn);
     }
+    written.emplace_back(table, item.rid_);
     write_set->pop_back();
   }
   write_set->clear();
 
-  // Release all the locks.
+  if (enable_logging) {
+    LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(), LogRecordType::COMMIT);
+    txn->SetPrevLSN(log_manager_->AppendLogRecord(&log_record));
+  }
+
+  // Make the changes visible to new snapshots, all at once, before anyone can lock over them.
+  timestamp_t watermark;
+  {
+    std::lock_guard lk(timestamp_latch_);
+    txn->SetCommitTimestamp(++last_commit_ts_);
+    last_commit_lsn_ = std::max(last_commit_lsn_, txn->GetPrevLSN());
+    EndSnapshot(txn);
+    watermark = active_snapshots_.empty() ? last_commit_ts_ : *active_snapshots_.begin();
+  }
+  for (const auto &[table, rid] : written) {
+    table->PruneVersions(rid, watermark);
+  }
+
+  // Release all the locks as soon as the commit record is in the log buffer. Transactions that take them over depend
+  // on this commit, and the log is written in LSN order, so none of them can become durable before it.
   ReleaseLocks(txn);
+
+  if (enable_logging) {
+    // The commit is durable once its log record, and those of the commits it depends on, are.
+    log_manager_->GroupCommit(std::max(txn->GetPrevLSN(), txn->GetDependencyLSN()));
+  }
+  txn_registry.Deregister(txn);
   // Release the global transaction latch.
   global_txn_latch_.RUnlock();
+  return true;
+}
+
+/*
+ * Validation needs no latch against other commits. A change shows in the version chain from the moment it is written,
+ * so whatever was written before validation fails it. A change written after validation is ordered after this
+ * transaction anyway, since this transaction read the version before it.
+ */
+auto TransactionManager::Validate(Transaction *txn) -> bool {
+  auto read_set = txn->GetReadSet();
+  bool valid = std::none_of(read_set->begin(), read_set->end(), [txn](const TableReadRecord &item) {
+    return item.table_->IsChangedSince(item.rid_, txn);
+  });
+  read_set->clear();
+  return valid;
 }
 
 void TransactionManager::Abort(Transaction *txn) {
+  if (txn->IsReadOnly()) {
+    FinishReadOnly(txn, TransactionState::ABORTED);
+    return;
+  }
   txn->SetState(TransactionState::ABORTED);
   // Rollback before releasing the lock.
   auto table_write_set = txn->GetWriteSet();
@@ -72,10 +153,17 @@ void TransactionManager::Abort(Transaction *txn) {
       table->ApplyDelete(item.rid_, txn);
     } else if (item.wtype_ == WType::UPDATE) {
       table->UpdateTuple(item.tuple_, item.rid_, txn);
+    } else if (item.wtype_ == WType::INCREMENT) {
+      // Note that this also drops the undo record of the increment.
+      table->RollbackIncrement(item.increment_, item.rid_, txn);
+    }
+    if (item.wtype_ != WType::INCREMENT) {
+      table->RollbackVersion(item.rid_, txn);
     }
     table_write_set->pop_back();
   }
   table_write_set->clear();
+  txn->GetReadSet()->clear();
   // Rollback index updates
   auto index_write_set = txn->GetIndexWriteSet();
   while (!index_write_set->empty()) {
@@ -102,12 +190,38 @@ void TransactionManager::Abort(Transaction *txn) {
   table_write_set->clear();
   index_write_set->clear();
 
+  if (enable_logging) {
+    LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(), LogRecordType::ABORT);
+    txn->SetPrevLSN(log_manager_->AppendLogRecord(&log_record));
+  }
+
+  {
+    std::lock_guard lk(timestamp_latch_);
+    EndSnapshot(txn);
+  }
+
   // Release all the locks.
   ReleaseLocks(txn);
+  txn_registry.Deregister(txn);
   // Release the global transaction latch.
   global_txn_latch_.RUnlock();
 }
 
+/*
+ * A commit waits for the commits it read to become durable, so it never answers with data a crash may still undo.
+ */
+void TransactionManager::FinishReadOnly(Transaction *txn, TransactionState state) {
+  {
+    std::lock_guard lk(timestamp_latch_);
+    EndSnapshot(txn);
+  }
+  if (enable_logging && state == TransactionState::COMMITTED &&
+      txn->GetDependencyLSN() > log_manager_->GetPersistentLSN()) {
+    log_manager_->GroupCommit(txn->GetDependencyLSN());
+  }
+  txn->SetState(state);
+}
+
 void TransactionManager::BlockAllTransactions() { global_txn_latch_.WLock(); }
 
 void TransactionManager::ResumeTransactions() { global_txn_latch_.WUnlock(); }
@@ -0,0 +1,70 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// transaction_registry.cpp
+//
+// Identification: src/concurrency/transaction_registry.cpp
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include "concurrency/transaction_registry.h"
+
+#include <mutex>  // NOLINT
+
+#include "concurrency/transaction.h"
+
+namespace bustub {
+
+void TransactionRegistry::Register(Transaction *txn) {
+  txn_id_t txn_id = txn->GetTransactionId();
+  Slot &slot = SlotOf(txn_id);
+  txn_id_t expected = INVALID_TXN_ID;
+  if (slot.txn_id_.compare_exchange_strong(expected, txn_id) || expected == txn_id) {
+    slot.txn_.store(txn);
+    return;
+  }
+  std::unique_lock lk(overflow_latch_);
+  overflow_[txn_id] = txn;
+  overflow_size_.store(overflow_.size());
+}
+
+/*
+ * The transaction is cleared before the id, so a Find that saw the id before and after reading the transaction read
+ * this transaction or nothing: the slot cannot have passed to another id in between, ids are never reused while
+ * running.
+ */
+void TransactionRegistry::Deregister(Transaction *txn) {
+  txn_id_t txn_id = txn->GetTransactionId();
+  Slot &slot = SlotOf(txn_id);
+  if (slot.txn_id_.load() == txn_id) {
+    slot.txn_.store(nullptr);
+    slot.txn_id_.store(INVALID_TXN_ID);
+    return;
+  }
+  if (overflow_size_.load() != 0) {
+    std::unique_lock lk(overflow_latch_);
+    overflow_.erase(txn_id);
+    overflow_size_.store(overflow_.size());
+  }
+}
+
+auto TransactionRegistry::Find(txn_id_t txn_id) -> Transaction * {
+  Slot &slot = SlotOf(txn_id);
+  if (slot.txn_id_.load() == txn_id) {
+    Transaction *txn = slot.txn_.load();
+    if (txn != nullptr && slot.txn_id_.load() == txn_id) {
+      return txn;
+    }
+  }
+  if (overflow_size_.load() == 0) {
+    return nullptr;
+  }
+  std::shared_lock lk(overflow_latch_);
+  auto it = overflow_.find(txn_id);
+  return it == overflow_.end() ? nullptr : it->second;
+}
+
+}  // namespace bustub
@@ -0,0 +1,168 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// transaction_scheduler.cpp
+//
+// Identification: src/concurrency/transaction_scheduler.cpp
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include "concurrency/transaction_scheduler.h"
+
+#include <algorithm>
+#include <thread>  // NOLINT
+#include <utility>
+
+namespace bustub {
+
+TransactionScheduler::TransactionScheduler(TransactionManager *txn_manager, LockManager *lock_manager,
+                                           size_t max_in_flight, size_t max_attempts, size_t hot_keys)
+    : txn_manager_(txn_manager),
+      lock_manager_(lock_manager),
+      max_attempts_(max_attempts),
+      hot_keys_(hot_keys),
+      free_slots_(max_in_flight),
+      next_refresh_(std::chrono::steady_clock::now() + HOT_KEY_REFRESH_INTERVAL) {}
+
+/*
+ * The turns on hot records are taken before the slot, so a transaction waiting for its turn holds no slot, and in the
+ * order of the records, so no two transactions wait for each other's turns. A turn is kept through the retries.
+ */
+auto TransactionScheduler::Run(const Body &body, const std::vector<RID> &keys, IsolationLevel isolation_level)
+    -> bool {
+  std::vector<std::shared_ptr<std::mutex>> hot_turns = HotTurnsOf(keys);
+  std::vector<std::unique_lock<std::mutex>> turns;
+  turns.reserve(hot_turns.size());
+  for (const auto &turn : hot_turns) {
+    turns.emplace_back(*turn);
+  }
+  for (size_t attempt = 1; attempt <= max_attempts_; attempt++) {
+    if (attempt > 1) {
+      std::this_thread::sleep_for(Backoff(attempt));
+    }
+    Admit();
+    Transaction *txn = txn_manager_->Begin(nullptr, isolation_level);
+    bool done;
+    try {
+      done = body(txn);
+    } catch (TransactionAbortException &) {
+      done = true;
+    } catch (...) {
+      txn_manager_->Abort(txn);
+      delete txn;
+      Leave();
+      throw;
+    }
+    // a body that gives up because it was wounded is retried, like one that throws
+    if (!done && txn->GetState() != TransactionState::ABORTED) {
+      txn_manager_->Abort(txn);
+      delete txn;
+      Leave();
+      failures_++;
+      return false;
+    }
+    bool committed = false;
+    if (txn->GetState() == TransactionState::ABORTED) {
+      // a wound may also come after the last lock
+      txn_manager_->Abort(txn);
+    } else {
+      // an optimistic transaction may still fail validation, which aborts it
+      committed = txn_manager_->Commit(txn);
+    }
+    delete txn;
+    Leave();
+    if (committed) {
+      commits_++;
+      return true;
+    }
+    retries_++;
+  }
+  failures_++;
+  return false;
+}
+
+void TransactionScheduler::RefreshHotKeys() {
+  LockManager::Stats stats = lock_manager_->GetStats(hot_keys_);
+  std::lock_guard lk(latch_);
+  // a record that stays hot keeps its turn, whoever holds it
+  std::unordered_map<RID, std::shared_ptr<std::mutex>> hot_turns;
+  for (const auto &[rid, waits] : stats.hot_rows_) {
+    auto it = hot_turns_.find(rid);
+    hot_turns.emplace(rid, it != hot_turns_.end() ? it->second : std::make_shared<std::mutex>());
+  }
+  hot_turns_ = std::move(hot_turns);
+  next_refresh_ = std::chrono::steady_clock::now() + HOT_KEY_REFRESH_INTERVAL;
+}
+
+auto TransactionScheduler::GetHotKeys() -> std::vector<RID> {
+  std::lock_guard lk(latch_);
+  std::vector<RID> keys;
+  keys.reserve(hot_turns_.size());
+  for (const auto &[rid, turn] : hot_turns_) {
+    keys.push_back(rid);
+  }
+  return keys;
+}
+
+auto TransactionScheduler::GetStats() -> Stats { return {commits_.load(), retries_.load(), failures_.load()}; }
+
+void TransactionScheduler::Admit() {
+  std::unique_lock lk(admission_latch_);
+  admission_cv_.wait(lk, [&] { return free_slots_ > 0; });
+  free_slots_--;
+}
+
+void TransactionScheduler::Leave() {
+  {
+    std::lock_guard lk(admission_latch_);
+    free_slots_++;
+  }
+  admission_cv_.notify_one();
+}
+
+auto TransactionScheduler::HotTurnsOf(const std::vector<RID> &keys) -> std::vector<std::shared_ptr<std::mutex>> {
+  if (hot_keys_ == 0 || keys.empty()) {
+    return {};
+  }
+  bool refresh;
+  {
+    std::lock_guard lk(latch_);
+    refresh = std::chrono::steady_clock::now() >= next_refresh_;
+    if (refresh) {
+      // nobody else refreshes meanwhile
+      next_refresh_ = std::chrono::steady_clock::now() + HOT_KEY_REFRESH_INTERVAL;
+    }
+  }
+  if (refresh) {
+    RefreshHotKeys();
+  }
+  std::vector<RID> hot;
+  std::vector<std::shared_ptr<std::mutex>> turns;
+  std::lock_guard lk(latch_);
+  for (const RID &rid : keys) {
+    if (hot_turns_.count(rid) != 0) {
+      hot.push_back(rid);
+    }
+  }
+  std::sort(hot.begin(), hot.end(), [](const RID &l, const RID &r) { return l.Get() < r.Get(); });
+  hot.erase(std::unique(hot.begin(), hot.end()), hot.end());
+  turns.reserve(hot.size());
+  for (const RID &rid : hot) {
+    turns.push_back(hot_turns_[rid]);
+  }
+  return turns;
+}
+
+/*
+ * Full jitter: anywhere between nothing and the doubled backoff, so the transactions a wound sent back spread out.
+ */
+auto TransactionScheduler::Backoff(size_t attempt) -> std::chrono::microseconds {
+  auto cap = std::min(BACKOFF_MAX, BACKOFF_BASE * (int64_t{1} << std::min<size_t>(attempt - 2, 20)));
+  std::lock_guard lk(latch_);
+  return std::chrono::microseconds(std::uniform_int_distribution<int64_t>(0, cap.count())(random_));
+}
+
+}  // namespace bustub
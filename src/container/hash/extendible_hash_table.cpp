@@ -10,8 +10,11 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include <algorithm>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <thread>  // NOLINT
 #include <utility>
 #include <vector>
 
@@ -23,20 +26,56 @@ namespace bustub {
 
 template <typename KeyType, typename ValueType, typename KeyComparator>
 HASH_TABLE_TYPE::ExtendibleHashTable(const std::string &name, BufferPoolManager *buffer_pool_manager,
-                                     const KeyComparator &comparator, HashFunction<KeyType> hash_fn)
-    : buffer_pool_manager_(buffer_pool_manager), comparator_(comparator), hash_fn_(std::move(hash_fn)) {
-  auto *dir_p =
+                                     const KeyComparator &comparator, HashFunction<KeyType> hash_fn,
+                                     LogManager *log_manager)
+    : buffer_pool_manager_(buffer_pool_manager),
+      comparator_(comparator),
+      log_manager_(log_manager),
+      hash_fn_(std::move(hash_fn)) {
+  dir_page_ =
       reinterpret_cast<HashTableDirectoryPage *>(buffer_pool_manager_->NewPage(&directory_page_id_)->GetData());
-  dir_p->SetPageId(directory_page_id_);
+  dir_page_->SetPageId(directory_page_id_);
   page_id_t bucket0_id = INVALID_PAGE_ID;
   buffer_pool_manager_->NewPage(&bucket0_id);
   assert(bucket0_id != INVALID_PAGE_ID);
-  dir_p->SetBucketPageId(0, bucket0_id);
-  dir_p->SetLocalDepth(0, 0);
-  buffer_pool_manager_->UnpinPage(directory_page_id_, true);
+  dir_page_->SetBucketPageId(0, bucket0_id);
+  dir_page_->SetLocalDepth(0, 0);
+  mirror_.SetBucketPageId(0, bucket0_id);
+  lsn_t lsn = WriteLog(nullptr, LogRecordType::HASHDIRECTORY, directory_page_id_, 0,
+                       std::vector<HashDirectoryEntry>{{0, bucket0_id, 0}});
+  if (lsn != INVALID_LSN) {
+    dir_page_->SetLSN(lsn);
+  }
   buffer_pool_manager_->UnpinPage(bucket0_id, false);
 }
 
+template <typename KeyType, typename ValueType, typename KeyComparator>
+HASH_TABLE_TYPE::ExtendibleHashTable(const std::string &name, BufferPoolManager *buffer_pool_manager,
+                                     const KeyComparator &comparator, HashFunction<KeyType> hash_fn,
+                                     page_id_t directory_page_id, LogManager *log_manager)
+    : directory_page_id_(directory_page_id),
+      buffer_pool_manager_(buffer_pool_manager),
+      comparator_(comparator),
+      log_manager_(log_manager),
+      hash_fn_(std::move(hash_fn)) {
+  dir_page_ = FetchDirectoryPage();
+  if (dir_page_ == nullptr) {
+    throw Exception(ExceptionType::OUT_OF_MEMORY, "Couldn't fetch the hash directory.");
+  }
+  if (!HashTableDirectory(buffer_pool_manager_, dir_page_, log_manager_, &mirror_).LoadMirror()) {
+    buffer_pool_manager_->UnpinPage(directory_page_id_, false);
+    throw Exception(ExceptionType::OUT_OF_MEMORY, "Couldn't fetch the hash directory segments.");
+  }
+}
+
+/*
+ * The directory page was changed in place all along, so it is unpinned as dirty.
+ */
+template <typename KeyType, typename ValueType, typename KeyComparator>
+HASH_TABLE_TYPE::~ExtendibleHashTable() {
+  buffer_pool_manager_->UnpinPage(directory_page_id_, true);
+}
+
 /*****************************************************************************
  * HELPERS
  *****************************************************************************/
@@ -109,30 +148,99 @@ auto InvertBit(uint32_t num, uint8_t offset) -> uint32_t {
   return num ^ musk;
 }
 
+template <typename KeyType, typename ValueType, typename KeyComparator>
+template <typename... Args>
+auto HASH_TABLE_TYPE::WriteLog(Transaction *transaction, Args &&...args) -> lsn_t {
+  if (!enable_logging || log_manager_ == nullptr) {
+    return INVALID_LSN;
+  }
+  txn_id_t txn_id = transaction == nullptr ? INVALID_TXN_ID : transaction->GetTransactionId();
+  lsn_t prev_lsn = transaction == nullptr ? INVALID_LSN : transaction->GetPrevLSN();
+  LogRecord log_record(txn_id, prev_lsn, std::forward<Args>(args)...);
+  lsn_t lsn = log_manager_->AppendLogRecord(&log_record);
+  if (transaction != nullptr) {
+    transaction->SetPrevLSN(lsn);
+  }
+  return lsn;
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void HASH_TABLE_TYPE::LogSlot(Transaction *transaction, LogRecordType type, page_id_t bucket_page_id,
+                              HASH_TABLE_BUCKET_TYPE *bucket, uint32_t bucket_idx) {
+  lsn_t lsn = WriteLog(transaction, type, directory_page_id_, bucket_page_id, bucket->SlotImageAt(bucket_idx));
+  if (lsn != INVALID_LSN) {
+    bucket->SetLSN(lsn);
+  }
+}
+
+/*
+ * A seqlock read: the mirror is read without a latch and read again if a change overlapped. A torn read may find the
+ * segment of its entry not mirrored yet, never one that is gone.
+ */
+template <typename KeyType, typename ValueType, typename KeyComparator>
+auto HASH_TABLE_TYPE::BucketPageIdOf(uint32_t hash) -> page_id_t {
+  for (;;) {
+    uint64_t version = directory_version_.load(std::memory_order_acquire);
+    if ((version & 1) != 0) {
+      std::this_thread::yield();
+      continue;
+    }
+    page_id_t bucket_page_id = mirror_.GetBucketPageId(hash & dir_page_->GetGlobalDepthMask());
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (directory_version_.load(std::memory_order_relaxed) == version) {
+      return bucket_page_id;
+    }
+  }
+}
+
+/*
+ * Only a split or a merge of a bucket moves directory entries away from it, and either holds the write latch of the
+ * bucket meanwhile; growing or shrinking the directory keeps every key on its bucket. So a latched bucket that the
+ * directory still points to stays the bucket of the key until it is unlatched.
+ */
+template <typename KeyType, typename ValueType, typename KeyComparator>
+auto HASH_TABLE_TYPE::FetchLatchedBucket(uint64_t hash, bool exclusive) -> Page * {
+  for (;;) {
+    page_id_t bucket_page_id = BucketPageIdOf(hash);
+    Page *raw_page = buffer_pool_manager_->FetchPage(bucket_page_id);
+    if (raw_page == nullptr) {
+      return nullptr;
+    }
+    exclusive ? raw_page->WLatch() : raw_page->RLatch();
+    if (BucketPageIdOf(hash) == bucket_page_id) {
+      return raw_page;
+    }
+    // split or merged meanwhile
+    exclusive ? raw_page->WUnlatch() : raw_page->RUnlatch();
+    buffer_pool_manager_->UnpinPage(bucket_page_id, false);
+  }
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void HASH_TABLE_TYPE::BeginDirectoryChange() {
+  directory_version_.store(directory_version_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void HASH_TABLE_TYPE::EndDirectoryChange() {
+  directory_version_.store(directory_version_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
 /*****************************************************************************
  * SEARCH
  *****************************************************************************/
 template <typename KeyType, typename ValueType, typename KeyComparator>
 auto HASH_TABLE_TYPE::GetValue(Transaction *transaction, const KeyType &key, std::vector<ValueType> *result) -> bool {
-  HashTableDirectoryPage *dir_page = FetchDirectoryPage();
-  if (dir_page == nullptr) {
-    return false;
-  }
-  // TODO(zhanghao): consider this optimization, FetchPage -> RLock -> check page
-  table_latch_.RLock();
-  Page *raw_page = buffer_pool_manager_->FetchPage(KeyToPageId(key, dir_page));
+  // hashed once, for the directory by its low bits and for the tag by its top byte
+  uint64_t hash = hash_fn_.GetHash(key);
+  Page *raw_page = FetchLatchedBucket(hash, false);
   if (raw_page == nullptr) {
-    // LOG_WARN("HASH_TABLE_TYPE::GetValue failed to fetch bucket %d", KeyToPageId(key, dir_page));
-    buffer_pool_manager_->UnpinPage(directory_page_id_, false);
-    table_latch_.RUnlock();
     return false;
   }
   // start to scan bucket
-  raw_page->RLatch();
-  table_latch_.RUnlock();                                      // release lock of directory table
-  buffer_pool_manager_->UnpinPage(directory_page_id_, false);  // unpin directory page
   auto *bkt_page = reinterpret_cast<HASH_TABLE_BUCKET_TYPE *>(raw_page->GetData());
-  bool found = bkt_page->GetValue(key, comparator_, result);
+  bool found = bkt_page->GetValue(key, HASH_TABLE_BUCKET_TYPE::TagOf(hash), comparator_, result);
   raw_page->RUnlatch();
   buffer_pool_manager_->UnpinPage(raw_page->GetPageId(), false);
   return found;
@@ -143,106 +251,318 @@ auto HASH_TABLE_TYPE::GetValue(Transaction *transaction, const KeyType &key, std
  *****************************************************************************/
 template <typename KeyType, typename ValueType, typename KeyComparator>
 auto HASH_TABLE_TYPE::Insert(Transaction *transaction, const KeyType &key, const ValueType &value) -> bool {
-  HashTableDirectoryPage *dir_page = FetchDirectoryPage();
-  if (dir_page == nullptr) {
-    return false;
-  }
-  table_latch_.RLock();
-  Page *raw_page = buffer_pool_manager_->FetchPage(KeyToPageId(key, dir_page));
+  uint64_t hash = hash_fn_.GetHash(key);
+  Page *raw_page = FetchLatchedBucket(hash, true);
   if (raw_page == nullptr) {
-    // LOG_WARN("HASH_TABLE_TYPE::Insert failed to FetchPage(%d)", KeyToPageId(key, dir_page));
-    buffer_pool_manager_->UnpinPage(directory_page_id_, false);
-    table_latch_.RUnlock();
     return false;
   }
   // start to insert into bucket
-  raw_page->WLatch();
-  table_latch_.RUnlock();                                      // release lock of directory table
-  buffer_pool_manager_->UnpinPage(directory_page_id_, false);  // unpin directory page
   auto *bkt_page = reinterpret_cast<HASH_TABLE_BUCKET_TYPE *>(raw_page->GetData());
-  uint8_t code = bkt_page->Insert2(key, value, comparator_);
-  raw_page->WUnlatch();
-  buffer_pool_manager_->UnpinPage(raw_page->GetPageId(), code == CODE_OK);
+  uint32_t slot;
+  uint8_t code = bkt_page->Insert2(key, value, HASH_TABLE_BUCKET_TYPE::TagOf(hash), comparator_, &slot);
   if (code == CODE_FULL) {
-    return SplitInsert(transaction, key, value);
+    // the full bucket stays latched, so nobody fills its split images first
+    return SplitInsert(transaction, raw_page, key, value, hash);
   }
+  if (code == CODE_OK) {
+    LogSlot(transaction, LogRecordType::HASHBUCKETINSERT, raw_page->GetPageId(), bkt_page, slot);
+  }
+  raw_page->WUnlatch();
+  buffer_pool_manager_->UnpinPage(raw_page->GetPageId(), code == CODE_OK);
   return code == CODE_OK;
 }
 
+/*
+ * Only the directory change itself is made under the directory latch. The pairs are moved afterwards, under the latches
+ * of the two buckets: a lookup of another bucket goes on meanwhile, one of these two waits for the move to finish.
+ */
 template <typename KeyType, typename ValueType, typename KeyComparator>
-auto HASH_TABLE_TYPE::SplitInsert(Transaction *transaction, const KeyType &key, const ValueType &value) -> bool {
-  HashTableDirectoryPage *dir_page = FetchDirectoryPage();
-  if (dir_page == nullptr) {
-    return false;
+auto HASH_TABLE_TYPE::SplitInsert(Transaction *transaction, Page *raw_page, const KeyType &key, const ValueType &value,
+                                  uint64_t hash) -> bool {
+  for (;;) {
+    auto *bkt_page = reinterpret_cast<HASH_TABLE_BUCKET_TYPE *>(raw_page->GetData());
+    // create new page
+    page_id_t new_page_id;
+    Page *new_page = buffer_pool_manager_->NewPage(&new_page_id);
+    if (new_page == nullptr) {
+      raw_page->WUnlatch();
+      buffer_pool_manager_->UnpinPage(raw_page->GetPageId(), false);
+      return false;
+    }
+    // whoever finds the new bucket in the directory waits until the pairs are moved
+    new_page->WLatch();
+    auto *new_bkt = reinterpret_cast<HASH_TABLE_BUCKET_TYPE *>(new_page->GetData());
+    uint32_t local_dep;
+    {
+      std::lock_guard lk(directory_latch_);
+      // the split is logged as a redo-only change of the directory and of both buckets
+      HashTableDirectory directory(buffer_pool_manager_, dir_page_, log_manager_, &mirror_);
+      uint32_t index = hash & directory.GetGlobalDepthMask();
+      bool fetched = directory.Fetch(index);
+      local_dep = fetched ? directory.GetLocalDepth(index) : 0;
+      // increment global depth as needed
+      bool grow = directory.GetGlobalDepth() == local_dep;
+      fetched = fetched && (!grow || directory.PrepareGrowth());
+      // change pointers of pages in directory, which the lookups do not read, before they have to wait for the mirror
+      std::vector<HashDirectoryEntry> entries;
+      if (fetched) {
+        IterBuckets(index, directory.GetGlobalDepth() + (grow ? 1 : 0), local_dep, [&](uint32_t i) {
+          entries.push_back({i, CheckBit(i, local_dep + 1) ? new_page_id : raw_page->GetPageId(), local_dep + 1});
+        });
+        fetched = directory.SetEntries(entries);
+      }
+      if (!fetched) {
+        directory.Log();
+        new_page->WUnlatch();
+        buffer_pool_manager_->UnpinPage(new_page_id, false);
+        buffer_pool_manager_->DeletePage(new_page_id);
+        raw_page->WUnlatch();
+        buffer_pool_manager_->UnpinPage(raw_page->GetPageId(), false);
+        return false;
+      }
+      BeginDirectoryChange();
+      if (grow) {
+        directory.IncrGlobalDepth();
+      }
+      for (const auto &entry : entries) {
+        mirror_.SetBucketPageId(entry.bucket_idx_, entry.bucket_page_id_);
+      }
+      EndDirectoryChange();
+      directory.Log();
+    }
+    // move some pairs from origin bucket to new bucket, by the bit that tells the split images apart
+    std::vector<std::pair<uint32_t, HashSlotImage>> moves;
+    for (uint32_t i = 0; i != BUCKET_ARRAY_SIZE; ++i) {
+      if (!bkt_page->IsOccupied(i)) {
+        break;
+      }
+      if (!bkt_page->IsReadable(i)) {
+        continue;
+      }
+      uint64_t moved_hash = hash_fn_.GetHash(bkt_page->KeyAt(i));
+      if (CheckBit(moved_hash, local_dep + 1)) {
+        uint32_t slot = BUCKET_ARRAY_SIZE;
+        new_bkt->Insert2(bkt_page->KeyAt(i), bkt_page->ValueAt(i), HASH_TABLE_BUCKET_TYPE::TagOf(moved_hash),
+                         comparator_, &slot);
+        assert(slot != BUCKET_ARRAY_SIZE);
+        bkt_page->RemoveAt(i);
+        if (enable_logging && log_manager_ != nullptr) {
+          moves.emplace_back(i, new_bkt->SlotImageAt(slot));
+        }
+      }
+    }
+    lsn_t lsn = WriteLog(nullptr, LogRecordType::HASHBUCKETSPLIT, raw_page->GetPageId(), new_page_id, std::move(moves));
+    if (lsn != INVALID_LSN) {
+      bkt_page->SetLSN(lsn);
+      new_bkt->SetLSN(lsn);
+    }
+    // retry to insert key-value again failed just now
+    bool to_new = CheckBit(hash, local_dep + 1);
+    Page *target_page = to_new ? new_page : raw_page;
+    Page *other_page = to_new ? raw_page : new_page;
+    auto *target = to_new ? new_bkt : bkt_page;
+    other_page->WUnlatch();
+    buffer_pool_manager_->UnpinPage(other_page->GetPageId(), true);
+    uint32_t slot = BUCKET_ARRAY_SIZE;
+    if (target->Insert2(key, value, HASH_TABLE_BUCKET_TYPE::TagOf(hash), comparator_, &slot) == CODE_OK) {
+      LogSlot(transaction, LogRecordType::HASHBUCKETINSERT, target_page->GetPageId(), target, slot);
+      target_page->WUnlatch();
+      buffer_pool_manager_->UnpinPage(target_page->GetPageId(), true);
+      return true;
+    }
+    // every pair stayed with the key, split its bucket once more
+    raw_page = target_page;
   }
-  table_latch_.WLock();
-  Page *raw_page = buffer_pool_manager_->FetchPage(KeyToPageId(key, dir_page));
-  if (raw_page == nullptr) {
-    buffer_pool_manager_->UnpinPage(directory_page_id_, false);
-    table_latch_.WUnlock();
-    return false;
+}
+
+/*****************************************************************************
+ * BULK LOAD
+ *****************************************************************************/
+template <typename KeyType, typename ValueType, typename KeyComparator>
+auto HASH_TABLE_TYPE::BulkLoad(Transaction *transaction, const std::vector<std::pair<KeyType, ValueType>> &pairs)
+    -> bool {
+  std::vector<uint32_t> leftovers;
+  bool ok = BulkBuild(transaction, pairs, &leftovers);
+  for (uint32_t i : leftovers) {
+    ok = Insert(transaction, pairs[i].first, pairs[i].second) && ok;
   }
-  raw_page->WLatch();
-  auto *bkt_page = reinterpret_cast<HASH_TABLE_BUCKET_TYPE *>(raw_page->GetData());
-  // fixme: how to handle duplicated insert ?
-  // if (bkt_page->Insert(key, value, comparator_)) {
-  //   table_latch_.WUnlock();
-  //   raw_page->WUnlatch();
-  //   buffer_pool_manager_->UnpinPage(directory_page_id_, false);
-  //   buffer_pool_manager_->UnpinPage(raw_page->GetPageId(), true);
-  //   return true;
-  // }
-
-  // failed to insert directly, let's split bucket
-  // create new page
-  page_id_t new_page_id;
-  Page *new_page = buffer_pool_manager_->NewPage(&new_page_id);
-  if (new_page == nullptr) {
-    table_latch_.WUnlock();
-    raw_page->WUnlatch();
-    buffer_pool_manager_->UnpinPage(directory_page_id_, false);
-    buffer_pool_manager_->UnpinPage(raw_page->GetPageId(), false);
-    return false;
+  return ok;
+}
+
+/*
+ * The global depth is the least at which every partition of the pairs by the low bits of their hash fits into a
+ * bucket. Sibling partitions that fit into one bucket together share it, as if it had never been split, so the table
+ * ends up with the buckets inserting the pairs one by one would have made, give or take the order of the splits.
+ *
+ * Every directory entry points to bucket 0 until the new buckets are filled, so bucket 0 stays write latched from the
+ * check that the table is empty until the directory points to them: an insert meanwhile would land where the directory
+ * stops looking, and a split would move entries bucket 0 no longer owns. It is latched before the directory latch, in
+ * the order of a split.
+ */
+template <typename KeyType, typename ValueType, typename KeyComparator>
+auto HASH_TABLE_TYPE::BulkBuild(Transaction *transaction, const std::vector<std::pair<KeyType, ValueType>> &pairs,
+                                std::vector<uint32_t> *leftovers) -> bool {
+  auto leave_all = [&] {
+    for (uint32_t i = 0; i != pairs.size(); ++i) {
+      leftovers->push_back(i);
+    }
+    return true;
+  };
+  page_id_t bucket0_id = mirror_.GetBucketPageId(0);
+  Page *bucket0 = buffer_pool_manager_->FetchPage(bucket0_id);
+  if (bucket0 == nullptr) {
+    return leave_all();
   }
-  auto *new_bkt = reinterpret_cast<HASH_TABLE_BUCKET_TYPE *>(new_page->GetData());
-  uint32_t index = KeyToDirectoryIndex(key, dir_page);
-  uint32_t local_dep = dir_page->GetLocalDepth(index);
-  // increment global depth as needed
-  if (dir_page->GetGlobalDepth() == local_dep) {
-    dir_page->IncrGlobalDepth();
-  }
-  // change pointers of pages in directory
-  IterBuckets(index, dir_page->GetGlobalDepth(), local_dep, [&](uint32_t i) {
-    if (CheckBit(i, local_dep + 1)) {
-      dir_page->SetBucketPageId(i, new_page_id);
+  bucket0->WLatch();
+  std::lock_guard lk(directory_latch_);
+  if (dir_page_->GetGlobalDepth() != 0 || mirror_.GetBucketPageId(0) != bucket0_id ||
+      !reinterpret_cast<HASH_TABLE_BUCKET_TYPE *>(bucket0->GetData())->IsEmpty()) {
+    bucket0->WUnlatch();
+    buffer_pool_manager_->UnpinPage(bucket0_id, false);
+    return leave_all();
+  }
+
+  std::vector<uint64_t> hashes;
+  hashes.reserve(pairs.size());
+  for (const auto &pair : pairs) {
+    hashes.push_back(hash_fn_.GetHash(pair.first));
+  }
+  uint32_t max_depth = 0;
+  while ((1U << max_depth) < DIRECTORY_ARRAY_SIZE * DIRECTORY_SEGMENT_COUNT) {
+    ++max_depth;
+  }
+  // counts[i] is the size of the partition of directory entry i
+  std::vector<uint32_t> counts;
+  auto partition = [&](uint32_t depth) {
+    counts.assign(1U << depth, 0);
+    for (uint64_t hash : hashes) {
+      ++counts[hash & ((1U << depth) - 1)];
     }
-    dir_page->IncrLocalDepth(i);
-  });
-  // move some pairs from origin bucket to new bucket
-  for (uint32_t i = 0; i != BUCKET_ARRAY_SIZE; ++i) {
-    if (!bkt_page->IsOccupied(i)) {
-      break;
+  };
+  uint32_t global_depth = 0;
+  while (global_depth < max_depth && (static_cast<size_t>(BUCKET_ARRAY_SIZE) << global_depth) < pairs.size()) {
+    ++global_depth;
+  }
+  for (partition(global_depth);
+       global_depth < max_depth && *std::max_element(counts.begin(), counts.end()) > BUCKET_ARRAY_SIZE;) {
+    partition(++global_depth);
+  }
+
+  // grown as far as the buffer pool allows, every entry still points to bucket 0
+  HashTableDirectory directory(buffer_pool_manager_, dir_page_, log_manager_, &mirror_);
+  BeginDirectoryChange();
+  while (directory.GetGlobalDepth() < global_depth && directory.PrepareGrowth()) {
+    directory.IncrGlobalDepth();
+  }
+  EndDirectoryChange();
+  if (directory.GetGlobalDepth() < global_depth) {
+    global_depth = directory.GetGlobalDepth();
+    partition(global_depth);
+  }
+
+  // sums[d][p] is the number of pairs whose hash ends in the d low bits of p
+  std::vector<std::vector<uint32_t>> sums(global_depth + 1);
+  sums[global_depth] = counts;
+  for (uint32_t depth = global_depth; depth-- > 0;) {
+    sums[depth].resize(1U << depth);
+    for (uint32_t prefix = 0; prefix != sums[depth].size(); ++prefix) {
+      sums[depth][prefix] = sums[depth + 1][prefix] + sums[depth + 1][prefix | (1U << depth)];
     }
-    if (!bkt_page->IsReadable(i)) {
+  }
+  // the buckets by local depth and the hash bits their pairs share; the first one, of prefix 0, is bucket 0
+  std::vector<std::pair<uint32_t, uint32_t>> buckets;
+  std::vector<std::pair<uint32_t, uint32_t>> todo{{0, 0}};
+  while (!todo.empty()) {
+    auto [depth, prefix] = todo.back();
+    todo.pop_back();
+    if (depth == global_depth || sums[depth][prefix] <= BUCKET_ARRAY_SIZE) {
+      buckets.emplace_back(depth, prefix);
       continue;
     }
-    if (KeyToPageId(bkt_page->KeyAt(i), dir_page) == new_page_id) {
-      assert(new_bkt->Insert(bkt_page->KeyAt(i), bkt_page->ValueAt(i), comparator_));
-      bkt_page->RemoveAt(i);
+    todo.emplace_back(depth + 1, prefix | (1U << depth));
+    todo.emplace_back(depth + 1, prefix);
+  }
+
+  // the pages are allocated and the directory pages set first, so the table is still empty if the buffer pool runs out
+  // of frames; the lookups read the mirror, which is set last
+  auto give_up = [&](const std::vector<page_id_t> &page_ids) {
+    for (size_t j = 1; j != page_ids.size(); ++j) {
+      buffer_pool_manager_->DeletePage(page_ids[j]);
     }
+    bucket0->WUnlatch();
+    buffer_pool_manager_->UnpinPage(bucket0_id, false);
+    directory.Log();
+    return leave_all();
+  };
+  std::vector<page_id_t> page_ids{bucket0_id};
+  for (size_t k = 1; k != buckets.size(); ++k) {
+    page_id_t page_id;
+    if (buffer_pool_manager_->NewPage(&page_id) == nullptr) {
+      return give_up(page_ids);
+    }
+    buffer_pool_manager_->UnpinPage(page_id, false);
+    page_ids.push_back(page_id);
   }
-  // retry to insert key-value again failed just now
-  if (KeyToPageId(key, dir_page) == new_page_id) {
-    assert(new_bkt->Insert(key, value, comparator_));
-  } else {
-    assert(bkt_page->Insert(key, value, comparator_));
+  std::vector<HashDirectoryEntry> entries;
+  for (size_t k = 0; k != buckets.size(); ++k) {
+    auto [depth, prefix] = buckets[k];
+    IterBuckets(prefix, global_depth, depth, [&](uint32_t i) { entries.push_back({i, page_ids[k], depth}); });
   }
-  table_latch_.WUnlock();
-  raw_page->WUnlatch();
-  buffer_pool_manager_->UnpinPage(directory_page_id_, true);
-  buffer_pool_manager_->UnpinPage(raw_page->GetPageId(), true);  // FIXME: maybe not dirty
-  buffer_pool_manager_->UnpinPage(new_page_id, true);
-  return true;
+  std::sort(entries.begin(), entries.end(),
+            [](const auto &a, const auto &b) { return a.bucket_idx_ < b.bucket_idx_; });
+  if (!directory.SetEntries(entries)) {
+    return give_up(page_ids);
+  }
+
+  // the pairs ordered by their directory entry
+  std::vector<uint32_t> offsets(counts.size() + 1, 0);
+  for (uint32_t i = 0; i != counts.size(); ++i) {
+    offsets[i + 1] = offsets[i] + counts[i];
+  }
+  std::vector<uint32_t> order(pairs.size());
+  std::vector<uint32_t> cursors(offsets.begin(), offsets.end() - 1);
+  for (uint32_t i = 0; i != pairs.size(); ++i) {
+    order[cursors[hashes[i] & ((1U << global_depth) - 1)]++] = i;
+  }
+
+  bool ok = true;
+  for (size_t k = 0; k != buckets.size(); ++k) {
+    auto [depth, prefix] = buckets[k];
+    Page *page = k == 0 ? bucket0 : buffer_pool_manager_->FetchPage(page_ids[k]);
+    BUSTUB_ASSERT(page != nullptr, "Couldn't fetch a bucket page that was just allocated.");
+    auto *bucket = reinterpret_cast<HASH_TABLE_BUCKET_TYPE *>(page->GetData());
+    if (k != 0) {
+      page->WLatch();
+    }
+    for (uint32_t i = prefix; i < counts.size(); i += 1U << depth) {
+      for (uint32_t j = offsets[i]; j != offsets[i + 1]; ++j) {
+        const auto &[key, value] = pairs[order[j]];
+        uint32_t slot;
+        uint8_t code = bucket->Insert2(key, value, HASH_TABLE_BUCKET_TYPE::TagOf(hashes[order[j]]), comparator_, &slot);
+        if (code == CODE_OK) {
+          LogSlot(transaction, LogRecordType::HASHBUCKETINSERT, page_ids[k], bucket, slot);
+        } else if (code == CODE_FULL) {
+          leftovers->push_back(order[j]);
+        } else {
+          ok = false;
+        }
+      }
+    }
+    if (k != 0) {
+      page->WUnlatch();
+      buffer_pool_manager_->UnpinPage(page_ids[k], true);
+    }
+  }
+
+  BeginDirectoryChange();
+  for (const auto &entry : entries) {
+    mirror_.SetBucketPageId(entry.bucket_idx_, entry.bucket_page_id_);
+  }
+  EndDirectoryChange();
+  directory.Log();
+  bucket0->WUnlatch();
+  buffer_pool_manager_->UnpinPage(bucket0_id, true);
+  return ok;
 }
 
 /*****************************************************************************
@@ -250,25 +570,21 @@ auto HASH_TABLE_TYPE::SplitInsert(Transaction *transaction, const KeyType &key,
  *****************************************************************************/
 template <typename KeyType, typename ValueType, typename KeyComparator>
 auto HASH_TABLE_TYPE::Remove(Transaction *transaction, const KeyType &key, const ValueType &value) -> bool {
-  HashTableDirectoryPage *dir_page = FetchDirectoryPage();
-  if (dir_page == nullptr) {
-    return false;
-  }
-  table_latch_.RLock();
-  Page *raw_page = buffer_pool_manager_->FetchPage(KeyToPageId(key, dir_page));
+  uint64_t hash = hash_fn_.GetHash(key);
+  Page *raw_page = FetchLatchedBucket(hash, true);
   if (raw_page == nullptr) {
-    buffer_pool_manager_->UnpinPage(directory_page_id_, false);
-    table_latch_.RUnlock();
     return false;
   }
   // start to remove from bucket
-  raw_page->WLatch();
   auto *bkt_page = reinterpret_cast<HASH_TABLE_BUCKET_TYPE *>(raw_page->GetData());
-  bool ok = bkt_page->Remove(key, value, comparator_);
-  bool try_merge = bkt_page->IsEmpty() && dir_page->GetGlobalDepth() > 0;
+  uint32_t slot;
+  bool ok = bkt_page->Remove(key, value, HASH_TABLE_BUCKET_TYPE::TagOf(hash), comparator_, &slot);
+  if (ok) {
+    LogSlot(transaction, LogRecordType::HASHBUCKETREMOVE, raw_page->GetPageId(), bkt_page, slot);
+  }
+  // a hint only, Merge checks again
+  bool try_merge = bkt_page->IsEmpty() && dir_page_->GetGlobalDepth() > 0;
   raw_page->WUnlatch();
-  table_latch_.RUnlock();                                      // release lock of directory table
-  buffer_pool_manager_->UnpinPage(directory_page_id_, false);  // unpin directory page
   buffer_pool_manager_->UnpinPage(raw_page->GetPageId(), ok);
   // bucket maybe empty before remove
   if (try_merge) {
@@ -280,45 +596,52 @@ auto HASH_TABLE_TYPE::Remove(Transaction *transaction, const KeyType &key, const
 /*****************************************************************************
  * MERGE
  *****************************************************************************/
+/*
+ * The empty bucket stays latched while its directory entries move to its split image, which is left unlatched: the
+ * image keeps its own entries and its pairs.
+ */
 template <typename KeyType, typename ValueType, typename KeyComparator>
 void HASH_TABLE_TYPE::Merge(Transaction *transaction, const KeyType &key, const ValueType &value) {
-  HashTableDirectoryPage *dir_page = FetchDirectoryPage();
-  if (dir_page == nullptr) {
-    return;
-  }
-  table_latch_.WLock();
-  Page *raw_page = buffer_pool_manager_->FetchPage(KeyToPageId(key, dir_page));
+  uint32_t hash = Hash(key);
+  Page *raw_page = FetchLatchedBucket(hash, true);
   if (raw_page == nullptr) {
-    buffer_pool_manager_->UnpinPage(directory_page_id_, false);
-    table_latch_.WUnlock();
     return;
   }
-  raw_page->WLatch();
   auto *bkt_page = reinterpret_cast<HASH_TABLE_BUCKET_TYPE *>(raw_page->GetData());
   bool ok = false;
   if (bkt_page->IsEmpty()) {
-    uint32_t index = KeyToDirectoryIndex(key, dir_page);
-    uint32_t local_dep = dir_page->GetLocalDepth(index);
-    if (local_dep > 0) {
-      uint32_t img_idx = InvertBit(index, local_dep);
-      if (local_dep == dir_page->GetLocalDepth(img_idx)) {
-        page_id_t pg_id = dir_page->GetBucketPageId(img_idx);
-        IterBuckets(index, dir_page->GetGlobalDepth(), local_dep - 1, [&](uint32_t i) {
-          dir_page->SetBucketPageId(i, pg_id);
-          dir_page->DecrLocalDepth(i);
-        });
-        ok = true;
+    std::lock_guard lk(directory_latch_);
+    HashTableDirectory directory(buffer_pool_manager_, dir_page_, log_manager_, &mirror_);
+    uint32_t index = hash & directory.GetGlobalDepthMask();
+    uint32_t local_dep = directory.Fetch(index) ? directory.GetLocalDepth(index) : 0;
+    uint32_t img_idx = local_dep > 0 ? InvertBit(index, local_dep) : index;
+    std::vector<HashDirectoryEntry> entries;
+    if (local_dep > 0 && directory.Fetch(img_idx) && local_dep == directory.GetLocalDepth(img_idx)) {
+      page_id_t pg_id = directory.GetBucketPageId(img_idx);
+      // change the pages before the lookups have to wait for the mirror
+      IterBuckets(index, directory.GetGlobalDepth(), local_dep - 1,
+                  [&](uint32_t i) { entries.push_back({i, pg_id, local_dep - 1}); });
+      ok = directory.SetEntries(entries);
+    }
+    if (ok) {
+      BeginDirectoryChange();
+      for (const auto &entry : entries) {
+        mirror_.SetBucketPageId(entry.bucket_idx_, entry.bucket_page_id_);
+      }
+      EndDirectoryChange();
+      // a scan of the whole directory, which the lookups need not wait for
+      if (directory.CanShrink()) {
+        BeginDirectoryChange();
+        directory.DecrGlobalDepth();
+        EndDirectoryChange();
       }
     }
+    LOG_DEBUG("HASH_TABLE_TYPE::Merge ok=%d", ok);
+    if (ok) {
+      directory.Log();
+    }
   }
-  LOG_DEBUG("HASH_TABLE_TYPE::Merge ok=%d, canShrink=%d", ok, dir_page->CanShrink());
-  dir_page->PrintDirectory();
-  if (ok && dir_page->CanShrink()) {
-    dir_page->DecrGlobalDepth();
-  }
-  table_latch_.WUnlock();
   raw_page->WUnlatch();
-  buffer_pool_manager_->UnpinPage(directory_page_id_, ok);
   buffer_pool_manager_->UnpinPage(raw_page->GetPageId(), false);
 }
 
@@ -327,12 +650,8 @@ void HASH_TABLE_TYPE::Merge(Transaction *transaction, const KeyType &key, const
  *****************************************************************************/
 template <typename KeyType, typename ValueType, typename KeyComparator>
 auto HASH_TABLE_TYPE::GetGlobalDepth() -> uint32_t {
-  table_latch_.RLock();
-  HashTableDirectoryPage *dir_page = FetchDirectoryPage();
-  uint32_t global_depth = dir_page->GetGlobalDepth();
-  assert(buffer_pool_manager_->UnpinPage(directory_page_id_, false, nullptr));
-  table_latch_.RUnlock();
-  return global_depth;
+  std::lock_guard lk(directory_latch_);
+  return dir_page_->GetGlobalDepth();
 }
 
 /*****************************************************************************
@@ -340,20 +659,19 @@ auto HASH_TABLE_TYPE::GetGlobalDepth() -> uint32_t {
  *****************************************************************************/
 template <typename KeyType, typename ValueType, typename KeyComparator>
 void HASH_TABLE_TYPE::VerifyIntegrity() {
-  table_latch_.RLock();
-  HashTableDirectoryPage *dir_page = FetchDirectoryPage();
-  dir_page->VerifyIntegrity();
-  assert(buffer_pool_manager_->UnpinPage(directory_page_id_, false, nullptr));
-  table_latch_.RUnlock();
+  std::lock_guard lk(directory_latch_);
+  HashTableDirectory directory(buffer_pool_manager_, dir_page_, log_manager_);
+  directory.VerifyIntegrity();
+  // the mirror has to agree with the pages
+  for (uint32_t i = 0; i != directory.Size(); ++i) {
+    assert(directory.GetBucketPageId(i) == mirror_.GetBucketPageId(i));
+  }
 }
 
 template <typename KeyType, typename ValueType, typename KeyComparator>
 void HASH_TABLE_TYPE::PrintDirectory() {
-  table_latch_.RLock();
-  HashTableDirectoryPage *dir_page = FetchDirectoryPage();
-  dir_page->PrintDirectory();
-  assert(buffer_pool_manager_->UnpinPage(directory_page_id_, false, nullptr));
-  table_latch_.RUnlock();
+  std::lock_guard lk(directory_latch_);
+  dir_page_->PrintDirectory();
 }
 
 /*****************************************************************************
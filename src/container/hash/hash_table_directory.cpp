@@ -0,0 +1,315 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// hash_table_directory.cpp
+//
+// Identification: src/container/hash/hash_table_directory.cpp
+//
+// Copyright (c) 2015-2021, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include "container/hash/hash_table_directory.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <utility>
+
+#include "common/logger.h"
+
+namespace bustub {
+
+HashTableDirectoryMirror::~HashTableDirectoryMirror() {
+  for (auto &segment : segments_) {
+    delete[] segment.load(std::memory_order_relaxed);
+  }
+}
+
+void HashTableDirectoryMirror::SetBucketPageId(uint32_t bucket_idx, page_id_t bucket_page_id) {
+  auto &segment = segments_[bucket_idx / DIRECTORY_ARRAY_SIZE];
+  if (segment.load(std::memory_order_relaxed) == nullptr) {
+    segment.store(new page_id_t[DIRECTORY_ARRAY_SIZE], std::memory_order_release);
+  }
+  segment.load(std::memory_order_relaxed)[bucket_idx % DIRECTORY_ARRAY_SIZE] = bucket_page_id;
+}
+
+HashTableDirectory::HashTableDirectory(BufferPoolManager *buffer_pool_manager, HashTableDirectoryPage *dir_page,
+                                       LogManager *log_manager, HashTableDirectoryMirror *mirror)
+    : buffer_pool_manager_(buffer_pool_manager),
+      dir_page_(dir_page),
+      log_manager_(log_manager),
+      mirror_(mirror),
+      segments_(DIRECTORY_SEGMENT_COUNT, nullptr),
+      dirty_(DIRECTORY_SEGMENT_COUNT, false) {}
+
+HashTableDirectory::~HashTableDirectory() {
+  for (uint32_t segment : pinned_) {
+    buffer_pool_manager_->UnpinPage(segments_[segment]->GetPageId(), dirty_[segment]);
+  }
+}
+
+auto HashTableDirectory::LookUp(BufferPoolManager *buffer_pool_manager, HashTableDirectoryPage *dir_page,
+                                uint32_t hash) -> page_id_t {
+  uint32_t bucket_idx = hash & dir_page->GetGlobalDepthMask();
+  if (bucket_idx < DIRECTORY_ARRAY_SIZE) {
+    return dir_page->GetBucketPageId(bucket_idx);
+  }
+  page_id_t segment_page_id = dir_page->GetSegmentPageId(bucket_idx / DIRECTORY_ARRAY_SIZE);
+  Page *page = buffer_pool_manager->FetchPage(segment_page_id);
+  if (page == nullptr) {
+    return INVALID_PAGE_ID;
+  }
+  page_id_t bucket_page_id =
+      reinterpret_cast<HashTableDirectoryPage *>(page->GetData())->GetBucketPageId(bucket_idx % DIRECTORY_ARRAY_SIZE);
+  buffer_pool_manager->UnpinPage(segment_page_id, false);
+  return bucket_page_id;
+}
+
+auto HashTableDirectory::Fetch(uint32_t bucket_idx) -> bool {
+  return bucket_idx < DIRECTORY_ARRAY_SIZE || SegmentPage(bucket_idx / DIRECTORY_ARRAY_SIZE) != nullptr;
+}
+
+auto HashTableDirectory::GetBucketPageId(uint32_t bucket_idx) -> page_id_t {
+  return PageOf(bucket_idx)->GetBucketPageId(bucket_idx % DIRECTORY_ARRAY_SIZE);
+}
+
+void HashTableDirectory::SetBucketPageId(uint32_t bucket_idx, page_id_t bucket_page_id) {
+  PageOf(bucket_idx)->SetBucketPageId(bucket_idx % DIRECTORY_ARRAY_SIZE, bucket_page_id);
+  changed_.insert(bucket_idx);
+  dirty_[bucket_idx / DIRECTORY_ARRAY_SIZE] = true;
+}
+
+auto HashTableDirectory::GetLocalDepth(uint32_t bucket_idx) -> uint32_t {
+  return PageOf(bucket_idx)->GetLocalDepth(bucket_idx % DIRECTORY_ARRAY_SIZE);
+}
+
+void HashTableDirectory::SetLocalDepth(uint32_t bucket_idx, uint8_t local_depth) {
+  PageOf(bucket_idx)->SetLocalDepth(bucket_idx % DIRECTORY_ARRAY_SIZE, local_depth);
+  changed_.insert(bucket_idx);
+  dirty_[bucket_idx / DIRECTORY_ARRAY_SIZE] = true;
+}
+
+void HashTableDirectory::IncrLocalDepth(uint32_t bucket_idx) {
+  PageOf(bucket_idx)->IncrLocalDepth(bucket_idx % DIRECTORY_ARRAY_SIZE);
+  changed_.insert(bucket_idx);
+  dirty_[bucket_idx / DIRECTORY_ARRAY_SIZE] = true;
+}
+
+void HashTableDirectory::DecrLocalDepth(uint32_t bucket_idx) {
+  PageOf(bucket_idx)->DecrLocalDepth(bucket_idx % DIRECTORY_ARRAY_SIZE);
+  changed_.insert(bucket_idx);
+  dirty_[bucket_idx / DIRECTORY_ARRAY_SIZE] = true;
+}
+
+auto HashTableDirectory::SetEntries(const std::vector<HashDirectoryEntry> &entries) -> bool {
+  std::vector<HashDirectoryEntry> before;
+  for (const auto &entry : entries) {
+    if (!Fetch(entry.bucket_idx_)) {
+      // the segments of the entries set before were fetched already, so they can be fetched again
+      for (const auto &old : before) {
+        SetBucketPageId(old.bucket_idx_, old.bucket_page_id_);
+        SetLocalDepth(old.bucket_idx_, old.local_depth_);
+      }
+      return false;
+    }
+    before.push_back({entry.bucket_idx_, GetBucketPageId(entry.bucket_idx_), GetLocalDepth(entry.bucket_idx_)});
+    SetBucketPageId(entry.bucket_idx_, entry.bucket_page_id_);
+    SetLocalDepth(entry.bucket_idx_, entry.local_depth_);
+  }
+  return true;
+}
+
+/*
+ * Up to DIRECTORY_ARRAY_SIZE entries the copy stays in the directory page. Past that the directory grows by whole
+ * segments: segment s + n becomes a copy of segment s, for the n segments in use.
+ */
+auto HashTableDirectory::PrepareGrowth() -> bool {
+  uint32_t size = Size();
+  if (size == DIRECTORY_ARRAY_SIZE * DIRECTORY_SEGMENT_COUNT) {
+    return false;
+  }
+  if (size < DIRECTORY_ARRAY_SIZE) {
+    for (uint32_t i = 0; i != size; ++i) {
+      dir_page_->SetBucketPageId(i | size, dir_page_->GetBucketPageId(i));
+      dir_page_->SetLocalDepth(i | size, dir_page_->GetLocalDepth(i));
+      changed_.insert(i | size);
+      if (mirror_ != nullptr) {
+        mirror_->SetBucketPageId(i | size, dir_page_->GetBucketPageId(i));
+      }
+    }
+    return true;
+  }
+  uint32_t segment_count = size / DIRECTORY_ARRAY_SIZE;
+  for (uint32_t segment = segment_count; segment != 2 * segment_count; ++segment) {
+    HashTableDirectoryPage *from = segment == segment_count ? dir_page_ : SegmentPage(segment - segment_count);
+    HashTableDirectoryPage *to = SegmentPage(segment);
+    if (from == nullptr || to == nullptr) {
+      return false;
+    }
+    dirty_[segment] = true;
+    for (uint32_t i = 0; i != DIRECTORY_ARRAY_SIZE; ++i) {
+      to->SetBucketPageId(i, from->GetBucketPageId(i));
+      to->SetLocalDepth(i, from->GetLocalDepth(i));
+      changed_.insert(segment * DIRECTORY_ARRAY_SIZE + i);
+      if (mirror_ != nullptr) {
+        mirror_->SetBucketPageId(segment * DIRECTORY_ARRAY_SIZE + i, from->GetBucketPageId(i));
+      }
+    }
+  }
+  return true;
+}
+
+auto HashTableDirectory::CanShrink() -> bool {
+  uint32_t global_depth = GetGlobalDepth();
+  if (global_depth == 0) {
+    return false;
+  }
+  for (uint32_t i = 0; i != Size(); ++i) {
+    if (!Fetch(i) || GetLocalDepth(i) == global_depth) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+ * The directory page is logged last, with the global depth: its record is the one that makes the segments logged
+ * before it part of the directory. The segment pages unpinned before were logged then.
+ */
+void HashTableDirectory::Log() {
+  for (uint32_t segment : pinned_) {
+    LogPage(segments_[segment], segment);
+  }
+  LogPage(dir_page_, 0);
+}
+
+/*
+ * Each segment page is unpinned once it is copied, before the next one is fetched.
+ */
+auto HashTableDirectory::LoadMirror() -> bool {
+  for (uint32_t first = 0; first < Size(); first += DIRECTORY_ARRAY_SIZE) {
+    uint32_t segment = first / DIRECTORY_ARRAY_SIZE;
+    HashTableDirectoryPage *page = segment == 0 ? dir_page_ : SegmentPage(segment);
+    if (page == nullptr) {
+      return false;
+    }
+    for (uint32_t slot = 0; slot != std::min<uint32_t>(Size(), DIRECTORY_ARRAY_SIZE); ++slot) {
+      mirror_->SetBucketPageId(first + slot, page->GetBucketPageId(slot));
+    }
+    if (segment != 0) {
+      Unpin(segment);
+    }
+  }
+  return true;
+}
+
+/*
+ * The same checks as HashTableDirectoryPage::VerifyIntegrity, which only reads the directory page.
+ */
+void HashTableDirectory::VerifyIntegrity() {
+  if (Size() <= DIRECTORY_ARRAY_SIZE) {
+    dir_page_->VerifyIntegrity();
+    return;
+  }
+  std::unordered_map<page_id_t, uint32_t> page_id_to_count;
+  std::unordered_map<page_id_t, uint32_t> page_id_to_ld;
+  for (uint32_t curr_idx = 0; curr_idx < Size(); curr_idx++) {
+    page_id_t curr_page_id = GetBucketPageId(curr_idx);
+    uint32_t curr_ld = GetLocalDepth(curr_idx);
+    assert(curr_ld <= GetGlobalDepth());
+    ++page_id_to_count[curr_page_id];
+    auto [it, inserted] = page_id_to_ld.emplace(curr_page_id, curr_ld);
+    if (!inserted && it->second != curr_ld) {
+      LOG_WARN("Verify Integrity: curr_local_depth: %u, old_local_depth %u, for page_id: %u", curr_ld, it->second,
+               curr_page_id);
+      assert(curr_ld == it->second);
+    }
+  }
+  for (const auto &[curr_page_id, curr_count] : page_id_to_count) {
+    uint32_t required_count = 0x1 << (GetGlobalDepth() - page_id_to_ld[curr_page_id]);
+    if (curr_count != required_count) {
+      LOG_WARN("Verify Integrity: curr_count: %u, required_count %u, for page_id: %u", curr_count, required_count,
+               curr_page_id);
+      assert(curr_count == required_count);
+    }
+  }
+}
+
+auto HashTableDirectory::PageOf(uint32_t bucket_idx) -> HashTableDirectoryPage * {
+  if (bucket_idx < DIRECTORY_ARRAY_SIZE) {
+    return dir_page_;
+  }
+  HashTableDirectoryPage *page = SegmentPage(bucket_idx / DIRECTORY_ARRAY_SIZE);
+  BUSTUB_ASSERT(page != nullptr, "Couldn't fetch the hash directory segment.");
+  return page;
+}
+
+auto HashTableDirectory::SegmentPage(uint32_t segment) -> HashTableDirectoryPage * {
+  if (segments_[segment] != nullptr) {
+    auto it = std::find(pinned_.begin(), pinned_.end(), segment);
+    std::rotate(it, it + 1, pinned_.end());
+    return segments_[segment];
+  }
+  if (pinned_.size() == MAX_PINNED_SEGMENTS) {
+    Unpin(pinned_.front());
+  }
+  page_id_t segment_page_id;
+  Page *page;
+  if (segment < dir_page_->GetSegmentCount()) {
+    segment_page_id = dir_page_->GetSegmentPageId(segment);
+    page = buffer_pool_manager_->FetchPage(segment_page_id);
+  } else {
+    page = buffer_pool_manager_->NewPage(&segment_page_id);
+    if (page != nullptr) {
+      reinterpret_cast<HashTableDirectoryPage *>(page->GetData())->SetPageId(segment_page_id);
+      dir_page_->SetSegmentPageId(segment, segment_page_id);
+      changed_segments_.insert(segment);
+      dirty_[segment] = true;
+    }
+  }
+  if (page == nullptr) {
+    return nullptr;
+  }
+  segments_[segment] = reinterpret_cast<HashTableDirectoryPage *>(page->GetData());
+  pinned_.push_back(segment);
+  return segments_[segment];
+}
+
+/*
+ * The page is logged before it is unpinned: the buffer pool flushes the log up to its LSN before writing it out.
+ */
+void HashTableDirectory::Unpin(uint32_t segment) {
+  LogPage(segments_[segment], segment);
+  buffer_pool_manager_->UnpinPage(segments_[segment]->GetPageId(), dirty_[segment]);
+  segments_[segment] = nullptr;
+  dirty_[segment] = false;
+  pinned_.erase(std::find(pinned_.begin(), pinned_.end(), segment));
+}
+
+void HashTableDirectory::LogPage(HashTableDirectoryPage *page, uint32_t segment) {
+  if (!enable_logging || log_manager_ == nullptr) {
+    return;
+  }
+  std::vector<HashDirectoryEntry> entries;
+  auto first = changed_.lower_bound(segment * DIRECTORY_ARRAY_SIZE);
+  auto last = changed_.lower_bound((segment + 1) * DIRECTORY_ARRAY_SIZE);
+  for (auto it = first; it != last; ++it) {
+    uint32_t slot = *it % DIRECTORY_ARRAY_SIZE;
+    entries.push_back({slot, page->GetBucketPageId(slot), page->GetLocalDepth(slot)});
+  }
+  changed_.erase(first, last);
+  if (segment == 0) {
+    for (uint32_t changed_segment : changed_segments_) {
+      entries.push_back({DIRECTORY_ARRAY_SIZE + changed_segment, dir_page_->GetSegmentPageId(changed_segment), 0});
+    }
+    changed_segments_.clear();
+  } else if (entries.empty()) {
+    return;
+  }
+  LogRecord log_record(INVALID_TXN_ID, INVALID_LSN, LogRecordType::HASHDIRECTORY, page->GetPageId(), GetGlobalDepth(),
+                       std::move(entries));
+  page->SetLSN(log_manager_->AppendLogRecord(&log_record));
+}
+
+}  // namespace bustub
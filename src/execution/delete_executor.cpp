@@ -20,9 +20,17 @@ DeleteExecutor::DeleteExecutor(ExecutorContext *exec_ctx, const DeletePlanNode *
                                std::unique_ptr<AbstractExecutor> &&child_executor)
     : AbstractExecutor(exec_ctx), plan_(plan), child_executor_(std::move(child_executor)) {}
 
-void DeleteExecutor::Init() { child_executor_->Init(); }
+void DeleteExecutor::Init() {
+  // before the child, so that a scan of this table sees the intention lock and locks records instead of the table
+  table_locked_ = exec_ctx_->GetLockManager()->LockTable(exec_ctx_->GetTransaction(),
+                                                         LockManager::LockMode::INTENTION_EXCLUSIVE, plan_->TableOid());
+  child_executor_->Init();
+}
 
 auto DeleteExecutor::Next([[maybe_unused]] Tuple *tuple, RID *rid) -> bool {
+  if (!table_locked_) {
+    return false;
+  }
   Tuple tp;
   RID r;
   if (!child_executor_->Next(&tp, &r)) {
@@ -32,17 +40,22 @@ auto DeleteExecutor::Next([[maybe_unused]] Tuple *tuple, RID *rid) -> bool {
   // acquire lock
   bool locked = false;
   if (txn->IsSharedLocked(r)) {
-    locked = exec_ctx_->GetLockManager()->LockUpgrade(txn, r);
+    locked = exec_ctx_->GetLockManager()->LockUpgrade(txn, r, plan_->TableOid());
   } else if (txn->IsExclusiveLocked(r)) {
     locked = true;
   } else {
-    locked = exec_ctx_->GetLockManager()->LockExclusive(txn, r);
+    locked = exec_ctx_->GetLockManager()->LockExclusive(txn, r, plan_->TableOid());
   }
   if (!locked) {
     return false;
   }
 
   TableInfo *table_info = exec_ctx_->GetCatalog()->GetTable(plan_->TableOid());
+  // the first writer wins: a snapshot must not overwrite a change it does not see
+  if (txn->IsSnapshotRead() && table_info->table_->IsChangedSince(r, txn)) {
+    txn->SetState(TransactionState::ABORTED);
+    throw TransactionAbortException(txn->GetTransactionId(), AbortReason::SNAPSHOT_WRITE_CONFLICT);
+  }
   if (!table_info->table_->MarkDelete(r, txn)) {
     return false;
   }
@@ -22,12 +22,18 @@ InsertExecutor::InsertExecutor(ExecutorContext *exec_ctx, const InsertPlanNode *
     : AbstractExecutor(exec_ctx), plan_(plan), child_(std::move(child_executor)) {}
 
 void InsertExecutor::Init() {
+  auto *lock_mgr = exec_ctx_->GetLockManager();
+  table_locked_ = lock_mgr->LockTable(exec_ctx_->GetTransaction(), LockManager::LockMode::INTENTION_EXCLUSIVE,
+                                      plan_->TableOid());
   if (!plan_->IsRawInsert()) {
     child_->Init();
   }
 }
 
 auto InsertExecutor::Next([[maybe_unused]] Tuple *tuple, RID *rid) -> bool {
+  if (!table_locked_) {
+    return false;
+  }
   TableInfo *tbl_info = exec_ctx_->GetCatalog()->GetTable(plan_->TableOid());
   Tuple tup;
   if (plan_->IsRawInsert()) {
@@ -46,7 +52,7 @@ auto InsertExecutor::Next([[maybe_unused]] Tuple *tuple, RID *rid) -> bool {
     return false;
   }
   Transaction *txn = exec_ctx_->GetTransaction();
-  if (!exec_ctx_->GetLockManager()->LockExclusive(txn, rid_ins)) {
+  if (!exec_ctx_->GetLockManager()->LockExclusive(txn, rid_ins, tbl_info->oid_)) {
     return false;
   }
   for (IndexInfo *index : exec_ctx_->GetCatalog()->GetTableIndexes(tbl_info->name_)) {
@@ -20,7 +20,29 @@ SeqScanExecutor::SeqScanExecutor(ExecutorContext *exec_ctx, const SeqScanPlanNod
       itr_(exec_ctx_->GetCatalog()->GetTable(plan_->GetTableOid())->table_->End()) {}
 
 void SeqScanExecutor::Init() {
-  itr_ = exec_ctx_->GetCatalog()->GetTable(plan_->GetTableOid())->table_->Begin(exec_ctx_->GetTransaction());
+  TableInfo *tbl_info = exec_ctx_->GetCatalog()->GetTable(plan_->GetTableOid());
+  Transaction *txn = exec_ctx_->GetTransaction();
+  LockManager *lock_mgr = exec_ctx_->GetLockManager();
+  // REPEATABLE_READ keeps every record it reads locked, so one table lock does; READ_COMMITTED releases each record
+  // after reading it and announces that with an intention lock. Snapshot reads need no locks.
+  // Under a writer of the same table, which holds IX already, S would make SIX and keep out every other writer; the
+  // scan locks the records it reads instead.
+  bool locked = true;
+  if (txn->GetIsolationLevel() == IsolationLevel::REPEATABLE_READ) {
+    bool writing = LockManager::GetTableLockMode(txn, tbl_info->oid_) == LockManager::LockMode::INTENTION_EXCLUSIVE;
+    auto mode = writing ? LockManager::LockMode::INTENTION_SHARED : LockManager::LockMode::SHARED;
+    locked = lock_mgr->LockTable(txn, mode, tbl_info->oid_);
+  } else if (txn->GetIsolationLevel() == IsolationLevel::READ_COMMITTED) {
+    locked = lock_mgr->LockTable(txn, LockManager::LockMode::INTENTION_SHARED, tbl_info->oid_);
+  }
+  if (!locked) {
+    itr_ = tbl_info->table_->End();
+    return;
+  }
+  auto mode = LockManager::GetTableLockMode(txn, tbl_info->oid_);
+  table_read_locked_ = mode == LockManager::LockMode::SHARED || mode == LockManager::LockMode::EXCLUSIVE ||
+                       mode == LockManager::LockMode::SHARED_INTENTION_EXCLUSIVE;
+  itr_ = tbl_info->table_->Begin(txn);
 }
 
 auto SeqScanExecutor::Next(Tuple *tuple, RID *rid) -> bool {
@@ -31,9 +53,12 @@ auto SeqScanExecutor::Next(Tuple *tuple, RID *rid) -> bool {
     *rid = itr_->GetRid();
     Transaction *txn = exec_ctx_->GetTransaction();
     // acquire shared lock
-    bool locked = (txn->IsSharedLocked(*rid) || txn->IsExclusiveLocked(*rid));
-    if (txn->GetIsolationLevel() != IsolationLevel::READ_UNCOMMITTED && !locked) {
-      if (!exec_ctx_->GetLockManager()->LockShared(txn, *rid)) {
+    bool locked = (table_read_locked_ || txn->IsSharedLocked(*rid) || txn->IsExclusiveLocked(*rid) ||
+                   txn->IsIncrementLocked(*rid));
+    if (txn->GetIsolationLevel() != IsolationLevel::READ_UNCOMMITTED && !txn->IsSnapshotRead() && !locked) {
+      // the increment lock is kept for the update, a shared lock would stop the other increments of the record
+      if (lock_for_increment_ ? !exec_ctx_->GetLockManager()->LockIncrement(txn, *rid, tbl_info->oid_)
+                              : !exec_ctx_->GetLockManager()->LockShared(txn, *rid, tbl_info->oid_)) {
         return false;
       }
     }
@@ -9,19 +9,36 @@
 // Copyright (c) 2015-2021, Carnegie Mellon University Database Group
 //
 //===----------------------------------------------------------------------===//
+#include <algorithm>
 #include <memory>
+#include <utility>
 
 #include "execution/executors/update_executor.h"
+#include "execution/executors/seq_scan_executor.h"
+#include "execution/expressions/column_value_expression.h"
 
 namespace bustub {
 
+/** @return whether the expression reads any of the columns */
+static auto ReadsAnyColumn(const AbstractExpression *expr, const std::unordered_map<uint32_t, UpdateInfo> &columns)
+    -> bool {
+  const auto *column = dynamic_cast<const ColumnValueExpression *>(expr);
+  if (column != nullptr && columns.find(column->GetColIdx()) != columns.end()) {
+    return true;
+  }
+  return std::any_of(expr->GetChildren().begin(), expr->GetChildren().end(),
+                     [&](const AbstractExpression *child) { return ReadsAnyColumn(child, columns); });
+}
+
 UpdateExecutor::UpdateExecutor(ExecutorContext *exec_ctx, const UpdatePlanNode *plan,
                                std::unique_ptr<AbstractExecutor> &&child_executor)
     : AbstractExecutor(exec_ctx), plan_(plan), child_executor_(std::move(child_executor)) {}
 
 void UpdateExecutor::Init() {
   table_info_ = exec_ctx_->GetCatalog()->GetTable(plan_->TableOid());
-  child_executor_->Init();
+  // before the child, so that a scan of this table sees the intention lock and locks records instead of the table
+  table_locked_ = exec_ctx_->GetLockManager()->LockTable(exec_ctx_->GetTransaction(),
+                                                         LockManager::LockMode::INTENTION_EXCLUSIVE, table_info_->oid_);
   std::unordered_map<uint32_t, UpdateInfo> update_attrs = plan_->GetUpdateAttr();
   for (IndexInfo *index : exec_ctx_->GetCatalog()->GetTableIndexes(table_info_->name_)) {
     for (auto attr : index->index_->GetKeyAttrs()) {
@@ -31,28 +48,72 @@ void UpdateExecutor::Init() {
       }
     }
   }
+  // Adding to integers commutes, so such an update only needs an increment lock, unless the new values go into an
+  // index. A snapshot keeps its exclusive locks, it must not add to a value it does not see.
+  increment_.reset();
+  if (indexes_.empty() && !exec_ctx_->GetTransaction()->IsSnapshotRead()) {
+    TupleIncrement increment;
+    bool adds_only = true;
+    for (const auto &[idx, info] : update_attrs) {
+      const Column &column = table_info_->schema_.GetColumn(idx);
+      if (info.type_ != UpdateType::Add || column.GetType() != TypeId::INTEGER) {
+        adds_only = false;
+        break;
+      }
+      increment.Add(column.GetOffset(), info.update_val_);
+    }
+    if (adds_only) {
+      increment_ = std::move(increment);
+    }
+  }
+  // A shared lock taken by the scan would keep out the increments of other transactions, and turn this one's into an
+  // exclusive lock. A scan of this table that filters on other columns only takes the increment locks itself.
+  auto *scan = dynamic_cast<SeqScanExecutor *>(child_executor_.get());
+  if (increment_.has_value() && scan != nullptr) {
+    const auto *scan_plan = dynamic_cast<const SeqScanPlanNode *>(plan_->GetChildPlan());
+    if (scan_plan->GetTableOid() == table_info_->oid_ &&
+        (scan_plan->GetPredicate() == nullptr || !ReadsAnyColumn(scan_plan->GetPredicate(), update_attrs))) {
+      scan->LockForIncrement();
+    }
+  }
+  child_executor_->Init();
 }
 
 auto UpdateExecutor::Next([[maybe_unused]] Tuple *tuple, RID *rid) -> bool {
+  if (!table_locked_) {
+    return false;
+  }
   Tuple old_tp;
   RID r;
   if (!child_executor_->Next(&old_tp, &r)) {
     return false;
   }
-  Tuple new_tp = GenerateUpdatedTuple(old_tp);
   Transaction *txn = exec_ctx_->GetTransaction();
+  if (increment_.has_value()) {
+    if (!txn->IsIncrementLocked(r) && !txn->IsExclusiveLocked(r) &&
+        !exec_ctx_->GetLockManager()->LockIncrement(txn, r, table_info_->oid_)) {
+      return false;
+    }
+    return table_info_->table_->IncrementTuple(*increment_, r, txn);
+  }
+  Tuple new_tp = GenerateUpdatedTuple(old_tp);
   // acquire lock
   bool locked = false;
   if (txn->IsSharedLocked(r)) {
-    locked = exec_ctx_->GetLockManager()->LockUpgrade(txn, r);
+    locked = exec_ctx_->GetLockManager()->LockUpgrade(txn, r, table_info_->oid_);
   } else if (txn->IsExclusiveLocked(r)) {
     locked = true;
   } else {
-    locked = exec_ctx_->GetLockManager()->LockExclusive(txn, r);
+    locked = exec_ctx_->GetLockManager()->LockExclusive(txn, r, table_info_->oid_);
   }
   if (!locked) {
     return false;
   }
+  // the first writer wins: a snapshot must not overwrite a change it does not see
+  if (txn->IsSnapshotRead() && table_info_->table_->IsChangedSince(r, txn)) {
+    txn->SetState(TransactionState::ABORTED);
+    throw TransactionAbortException(txn->GetTransactionId(), AbortReason::SNAPSHOT_WRITE_CONFLICT);
+  }
 
   if (!table_info_->table_->UpdateTuple(new_tp, r, exec_ctx_->GetTransaction())) {
     return false;
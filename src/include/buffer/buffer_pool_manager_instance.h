@@ -123,6 +123,9 @@ class BufferPoolManagerInstance : public BufferPoolManager {
 
   auto AcquireFrame() -> frame_id_t;
 
+  /** Force the log up to the page LSN before the page is written out. */
+  void ForceLogFor(Page *page);
+
   /** Number of pages in the buffer pool. */
   const size_t pool_size_;
   /** How many instances are in the parallel BPM (if present, otherwise just 1 BPI) */
@@ -137,7 +140,7 @@ class BufferPoolManagerInstance : public BufferPoolManager {
   /** Pointer to the disk manager. */
   DiskManager *disk_manager_ __attribute__((__unused__));
   /** Pointer to the log manager. */
-  LogManager *log_manager_ __attribute__((__unused__));
+  LogManager *log_manager_;
   /** Replacer to find unpinned pages for replacement. */
   Replacer *replacer_;
   /** This latch protects page_table_ and free_list_ */
@@ -27,19 +27,31 @@ extern std::atomic<bool> enable_logging;
 /** If ENABLE_LOGGING is true, the log should be flushed to disk every LOG_TIMEOUT. */
 extern std::chrono::duration<int64_t> log_timeout;
 
+/** A group commit leader waits at most GROUP_COMMIT_MAX_WAIT for more commits to share its log write. */
+extern std::chrono::microseconds group_commit_max_wait;
+
+/** A group commit leader stops waiting as soon as GROUP_COMMIT_MAX_BATCH commits share its log write. */
+extern int group_commit_max_batch;
+
+/** Row locks a transaction may hold on one table before they are escalated to a table lock, 0 to never escalate. */
+extern int lock_escalation_threshold;
+
 static constexpr int INVALID_PAGE_ID = -1;                                    // invalid page id
 static constexpr int INVALID_TXN_ID = -1;                                     // invalid transaction id
 static constexpr int INVALID_LSN = -1;                                        // invalid log sequence number
+static constexpr int64_t INVALID_TIMESTAMP = -1;                              // not committed (yet)
 static constexpr int HEADER_PAGE_ID = 0;                                      // the header page id
 static constexpr int PAGE_SIZE = 4096;                                        // size of a data page in byte
 static constexpr int BUFFER_POOL_SIZE = 10;                                   // size of buffer pool
 static constexpr int LOG_BUFFER_SIZE = ((BUFFER_POOL_SIZE + 1) * PAGE_SIZE);  // size of a log buffer in byte
 static constexpr int BUCKET_SIZE = 50;                                        // size of extendible hash bucket
+static constexpr int LOCK_TABLE_SHARDS = 16;                                  // latched partitions of the lock table
 
 using frame_id_t = int32_t;    // frame id type
 using page_id_t = int32_t;     // page id type
 using txn_id_t = int32_t;      // transaction id type
 using lsn_t = int32_t;         // log sequence number type
+using timestamp_t = int64_t;   // commit timestamp type
 using slot_offset_t = size_t;  // slot offset type
 using oid_t = uint16_t;
 
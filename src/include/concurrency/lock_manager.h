@@ -13,12 +13,19 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
+#include <chrono>              // NOLINT
 #include <condition_variable>  // NOLINT
 #include <list>
+#include <map>
 #include <memory>
 #include <mutex>  // NOLINT
+#include <optional>
+#include <set>
 #include <string>
+#include <thread>  // NOLINT
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
@@ -32,10 +39,79 @@ class TransactionManager;
 
 /**
  * LockManager handles transactions asking for locks on records.
+ *
+ * Tables can be locked as well, in the usual multi-granularity modes: a transaction reading a whole table takes one S
+ * lock instead of locking each record, and a transaction touching some records takes an IS or IX lock on the table
+ * before locking the records themselves. Record locks do not check the table lock; that is the caller's protocol.
+ *
+ * A record lock requested along with its table is skipped if the table lock already covers it. Once a transaction
+ * holds lock_escalation_threshold such record locks on one table, they are traded for a single S or X table lock.
+ *
+ * A read-only transaction that asks for an exclusive or increment lock of any kind is aborted with WRITE_ON_READ_ONLY.
+ *
+ * A transaction asking for a record lock that does not go along with the one it holds, e.g. S on a record it holds in
+ * INCREMENT, is upgraded to X instead.
+ *
+ * The lock table is split into shards by RID, each under its own latch, so that requests on different records do not
+ * serialize on one mutex. A wounded transaction may be blocked in another shard than its wounder; the wounder records
+ * the victims, leaves its own shard and then wakes each victim under the latch of the shard it is blocked in.
+ *
+ * Locks are granted by whoever makes them grantable: a release grants the waiting requests that no longer conflict,
+ * e.g. all the shared requests in front of the next exclusive one, and wakes exactly those, each on its own condition
+ * variable.
+ *
+ * Deadlocks are prevented by wound-wait, or, with DeadlockPolicy::DETECTION, every conflicting request waits and a
+ * background thread breaks the cycles of the waits-for graph every cycle_detection_interval.
+ *
+ * Requests that have to wait are timed, per record and table, so hot spots show in GetStats. Requests granted at once
+ * cost nothing extra.
  */
 class LockManager {
-  enum class LockMode { SHARED, EXCLUSIVE };
+ public:
+  /**
+   * Records are locked SHARED, EXCLUSIVE or INCREMENT, tables in any of the modes but INCREMENT. INCREMENT is the
+   * escrow mode of commutative updates: it is compatible with itself only, so any number of transactions may add to a
+   * record at once, while nobody reads it.
+   */
+  enum class LockMode {
+    SHARED,
+    EXCLUSIVE,
+    INTENTION_SHARED,
+    INTENTION_EXCLUSIVE,
+    SHARED_INTENTION_EXCLUSIVE,
+    INCREMENT
+  };
 
+  /** How conflicting requests avoid deadlocks. */
+  enum class DeadlockPolicy {
+    /** An older transaction aborts the younger ones in its way, a younger one waits for the older ones. */
+    WOUND_WAIT,
+    /** Everybody waits; the youngest transaction of each cycle in the waits-for graph is aborted. */
+    DETECTION
+  };
+
+  /** How often and how long requests waited on one record or table. */
+  struct KeyWaits {
+    uint64_t count_{0};
+    std::chrono::nanoseconds time_{0};
+  };
+
+  /** Lock contention counters, see GetStats. */
+  struct Stats {
+    /** The requests that had to wait, how long they waited in total and the longest wait. */
+    uint64_t waits_{0};
+    std::chrono::nanoseconds wait_time_{0};
+    std::chrono::nanoseconds max_wait_{0};
+    /** The transactions aborted by the lock manager, by reason; DEADLOCK counts the wounds or the cycle victims. */
+    std::map<AbortReason, uint64_t> aborts_;
+    /** The records and tables waited on longest, longest first. */
+    std::vector<std::pair<RID, KeyWaits>> hot_rows_;
+    std::vector<std::pair<table_oid_t, KeyWaits>> hot_tables_;
+
+    auto ToString() const -> std::string;
+  };
+
+ private:
   class LockRequest {
    public:
     LockRequest(txn_id_t txn_id, LockMode lock_mode) : txn_id_(txn_id), lock_mode_(lock_mode) {}
@@ -44,27 +120,63 @@ class LockManager {
     LockMode lock_mode_;
     bool granted_{false};
     Transaction *txn_;
+    /** Signalled when the request may have become grantable, or its transaction was aborted. */
+    std::condition_variable cv_;
   };
 
+  static constexpr size_t LOCK_MODE_COUNT = 6;
+  /** The number of requests in each mode. */
+  using ModeCounts = std::array<uint32_t, LOCK_MODE_COUNT>;
+
+  /**
+   * The requests on one record or table. The granted requests and the waiting ones, in arrival order, are kept apart
+   * and the modes of both are counted, so whether a request can be granted is decided from the counters instead of by
+   * walking the requests. Requests move between the lists, and from and to the pool of their shard, by splicing, so
+   * their addresses never change. A queue is reclaimed as soon as it is empty.
+   */
   class LockRequestQueue {
    public:
-    auto IsLocked() -> bool;
-    void Grant(txn_id_t txn_id);
+    /** @return the request of the transaction, nullptr if it has none */
+    auto Find(txn_id_t txn_id) -> LockRequest *;
+    /**
+     * Add a granted request, or a waiting one behind the other waiting requests, or in front of them. The request node
+     * is taken from the pool if it has one.
+     */
+    auto Add(Transaction *txn, LockMode lock_mode, bool granted, bool front = false) -> LockRequest *;
+    /** Move a waiting request to the granted ones. */
+    void Grant(std::list<LockRequest>::iterator request);
+    /** Change the mode of a granted request. */
+    void ChangeMode(LockRequest *request, LockMode lock_mode);
+    /** Remove the request of the transaction, granted or not, and put its node back into the pool. */
+    void Erase(txn_id_t txn_id);
+    /** @return true if the queue has no requests left */
+    inline auto IsEmpty() const -> bool { return granted_.empty() && waiting_.empty(); }
     auto ToString() -> std::string;
-    std::list<LockRequest> request_queue_;
-    // for notifying blocked transactions on this rid
-    std::condition_variable cv_;
+
+    std::list<LockRequest> granted_;
+    /** The first waiting request is the next to be granted. */
+    std::list<LockRequest> waiting_;
+    std::unordered_map<txn_id_t, std::list<LockRequest>::iterator> requests_;
+    ModeCounts granted_count_{};
+    ModeCounts waiting_count_{};
     // txn_id of an upgrading transaction (if any)
     txn_id_t upgrading_ = INVALID_TXN_ID;
+    // latest commit LSN of a transaction that released a writing lock here before its commit was durable; every later
+    // grant, of any mode, depends on it
+    lsn_t released_commit_lsn_ = INVALID_LSN;
+    // the request nodes of the shard that are not in use
+    std::list<LockRequest> *pool_ = nullptr;
   };
 
  public:
   /**
-   * Creates a new lock manager configured for the deadlock prevention policy.
+   * Creates a new lock manager.
+   * @param num_shards the number of partitions of the lock table
+   * @param policy the deadlock policy; DETECTION starts the cycle detection thread
    */
-  LockManager() = default;
+  explicit LockManager(size_t num_shards = LOCK_TABLE_SHARDS, DeadlockPolicy policy = DeadlockPolicy::WOUND_WAIT);
 
-  ~LockManager() = default;
+  ~LockManager();
 
   /*
    * [LOCK_NOTE]: For all locking functions, we:
@@ -79,29 +191,44 @@ class LockManager {
    * Acquire a lock on RID in shared mode. See [LOCK_NOTE] in header file.
    * @param txn the transaction requesting the shared lock
    * @param rid the RID to be locked in shared mode
+   * @param oid the table of the RID, if known; see escalation in the class comment
    * @return true if the lock is granted, false otherwise
    */
-  auto LockShared(Transaction *txn, const RID &rid) -> bool;
+  auto LockShared(Transaction *txn, const RID &rid, std::optional<table_oid_t> oid = std::nullopt) -> bool;
 
   /**
    * Acquire a lock on RID in exclusive mode. See [LOCK_NOTE] in header file.
    * @param txn the transaction requesting the exclusive lock
    * @param rid the RID to be locked in exclusive mode
+   * @param oid the table of the RID, if known; see escalation in the class comment
+   * @return true if the lock is granted, false otherwise
+   */
+  auto LockExclusive(Transaction *txn, const RID &rid, std::optional<table_oid_t> oid = std::nullopt) -> bool;
+
+  /**
+   * Acquire a lock on RID in increment mode, for updates that only add to integer columns. See [LOCK_NOTE] in header
+   * file.
+   * @param txn the transaction requesting the increment lock
+   * @param rid the RID to be locked in increment mode
+   * @param oid the table of the RID, if known; see escalation in the class comment
    * @return true if the lock is granted, false otherwise
    */
-  auto LockExclusive(Transaction *txn, const RID &rid) -> bool;
+  auto LockIncrement(Transaction *txn, const RID &rid, std::optional<table_oid_t> oid = std::nullopt) -> bool;
 
   /**
-   * Upgrade a lock from a shared lock to an exclusive lock.
+   * Upgrade a lock from a shared or increment lock to an exclusive lock.
    * @param txn the transaction requesting the lock upgrade
-   * @param rid the RID that should already be locked in shared mode by the
+   * @param rid the RID that should already be locked in shared or increment mode by the
    * requesting transaction
+   * @param oid the table of the RID, if known; see escalation in the class comment
    * @return true if the upgrade is successful, false otherwise
    */
-  auto LockUpgrade(Transaction *txn, const RID &rid) -> bool;
+  auto LockUpgrade(Transaction *txn, const RID &rid, std::optional<table_oid_t> oid = std::nullopt) -> bool;
 
   /**
-   * Release the lock held by the transaction.
+   * Release the lock held by the transaction. A committed transaction may release its locks before its commit record
+   * is durable; whoever is granted a lock on the record afterwards, shared as well as exclusive, depends on that commit
+   * if the released lock let it write, see Transaction::AddDependency.
    * @param txn the transaction releasing the lock, it should actually hold the
    * lock
    * @param rid the RID that is locked by the transaction
@@ -109,12 +236,231 @@ class LockManager {
    */
   auto Unlock(Transaction *txn, const RID &rid) -> bool;
 
+  /**
+   * Acquire a lock on a table. See [LOCK_NOTE] in header file, except that locking an already locked table is fine:
+   * if the held mode does not cover the requested one, the lock is upgraded to the weakest mode covering both, e.g. S
+   * and IX to SIX. Only one transaction may upgrade its lock on a table at a time.
+   * @param txn the transaction requesting the lock
+   * @param lock_mode the requested mode
+   * @param oid the table to be locked
+   * @return true if the lock is granted, false otherwise
+   */
+  auto LockTable(Transaction *txn, LockMode lock_mode, table_oid_t oid) -> bool;
+
+  /**
+   * Release the table lock held by the transaction. Releasing an S or SIX lock under REPEATABLE_READ, or an X lock,
+   * starts the shrinking phase.
+   * @param txn the transaction releasing the lock
+   * @param oid the table locked by the transaction
+   * @return false if the transaction holds no lock on the table
+   */
+  auto UnlockTable(Transaction *txn, table_oid_t oid) -> bool;
+
+  /**
+   * Release every record and table lock held by the transaction, the records before the tables, taking the latch of
+   * each shard once per kind instead of once per lock. Meant for a transaction that commits or aborts; a growing one
+   * starts shrinking as if its locks were released one by one.
+   * @param txn the transaction releasing its locks
+   */
+  void UnlockAll(Transaction *txn);
+
+  /** @return the mode in which the transaction locks the table, if it does */
+  static auto GetTableLockMode(Transaction *txn, table_oid_t oid) -> std::optional<LockMode>;
+
+  /** @return true if two transactions may hold locks in these modes on the same table at once */
+  static auto AreCompatible(LockMode l, LockMode r) -> bool;
+
+  /** @return the weakest mode that covers both modes */
+  static auto Combine(LockMode l, LockMode r) -> LockMode;
+
+  /*** Graph API, used by the cycle detection thread only ***/
+
+  /** Adds an edge from t1 -> t2, t1 waits for t2. */
+  void AddEdge(txn_id_t t1, txn_id_t t2);
+
+  /** Removes an edge from t1 -> t2. */
+  void RemoveEdge(txn_id_t t1, txn_id_t t2);
+
+  /**
+   * Checks if the graph has a cycle. The search starts from the oldest transaction and follows the older waitee first,
+   * so the answer is deterministic.
+   * @param[out] txn_id if the graph has a cycle, the youngest transaction in it
+   * @return false if the graph has no cycle, otherwise true
+   */
+  auto HasCycle(txn_id_t *txn_id) -> bool;
+
+  /**
+   * Collect the contention counters of all shards.
+   * @param top_n the number of hot records and tables to return
+   */
+  auto GetStats(size_t top_n = 10) -> Stats;
+
+  /** @return the number of record and table lock queues, used for testing only */
+  auto GetQueueCount() -> size_t;
+
+  /** @return the list of all edges in the graph, used for testing only */
+  auto GetEdgeList() -> std::vector<std::pair<txn_id_t, txn_id_t>>;
+
+  /**
+   * Builds the waits-for graph from the whole lock table and aborts the youngest transaction of each cycle, until none
+   * is left. The cycle detection thread runs this every cycle_detection_interval.
+   */
+  void DetectDeadlocks();
+
  private:
-  std::mutex latch_;
+  /** A partition of the lock table. */
+  struct Shard {
+    std::mutex latch_;
+    /** Lock table for lock requests. */
+    std::unordered_map<RID, LockRequestQueue> lock_table_;
+    std::unordered_map<table_oid_t, LockRequestQueue> table_lock_table_;
+    /** The nodes of released requests, reused by the next requests in the shard. */
+    std::list<LockRequest> request_pool_;
+    /** The latest released_commit_lsn_ of the reclaimed queues; a new queue starts from it. */
+    lsn_t reclaimed_commit_lsn_ = INVALID_LSN;
+    /** The waits in the shard, see Stats. At most HOT_KEYS_PER_SHARD records and tables are tracked each. */
+    uint64_t waits_ = 0;
+    std::chrono::nanoseconds wait_time_{0};
+    std::chrono::nanoseconds max_wait_{0};
+    std::unordered_map<RID, KeyWaits> row_waits_;
+    std::unordered_map<table_oid_t, KeyWaits> table_waits_;
+  };
+
+  static constexpr size_t HOT_KEYS_PER_SHARD = 64;
+
+  /**
+   * Account a wait on the key. Once HOT_KEYS_PER_SHARD keys are tracked, a new key replaces the one waited on the
+   * shortest. The caller holds the shard latch.
+   */
+  template <typename K>
+  static void RecordWait(Shard *shard, std::unordered_map<K, KeyWaits> *waits, const K &key,
+                         std::chrono::nanoseconds waited);
+
+  /** Abort the transaction for the reason and throw. */
+  [[noreturn]] void AbortWith(Transaction *txn, AbortReason reason);
+
+  /** @return the queue of the key in the table of the shard, created if there is none */
+  template <typename K>
+  static auto QueueOf(Shard *shard, std::unordered_map<K, LockRequestQueue> *table, const K &key)
+      -> LockRequestQueue *;
+
+  /**
+   * Remove the request of the transaction from the queue of the key, if it has one, grant the requests that no longer
+   * conflict and reclaim the queue if it is empty. The caller holds the shard latch.
+   * @param record_queue whether the key is a record
+   */
+  template <typename K>
+  void ReleaseRequest(Shard *shard, std::unordered_map<K, LockRequestQueue> *table, const K &key, Transaction *txn,
+                      bool record_queue);
+
+  /** Lock a record in a mode compatible with itself, SHARED or INCREMENT. */
+  auto LockGroupRow(Transaction *txn, const RID &rid, LockMode lock_mode) -> bool;
+  auto LockExclusiveRow(Transaction *txn, const RID &rid) -> bool;
+  auto LockUpgradeRow(Transaction *txn, const RID &rid) -> bool;
+
+  /** Remove the record lock of the transaction from its queue, without any 2PL state change. */
+  void ReleaseRow(Transaction *txn, const RID &rid);
+
+  /** @return true if the table lock held by the transaction makes a record lock in this mode unnecessary */
+  static auto TableLockCovers(Transaction *txn, table_oid_t oid, LockMode lock_mode) -> bool;
+
+  /**
+   * Count a record lock granted on the table and escalate the record locks of the table once there are enough.
+   * @return false if the transaction was aborted while waiting for the table lock
+   */
+  auto CountRowLock(Transaction *txn, table_oid_t oid, const RID &rid) -> bool;
+
+  /** @return the index of the shard that owns the lock request queue of rid */
+  auto ShardIndexOf(const RID &rid) const -> size_t;
+
+  /** @return the shard that owns the lock request queue of rid */
+  inline auto ShardOf(const RID &rid) -> Shard & { return shards_[ShardIndexOf(rid)]; }
+
+  /** @return the shard that owns the lock request queue of the table */
+  inline auto ShardOf(table_oid_t oid) -> Shard & { return shards_[oid % num_shards_]; }
+
+  /** @return the table lock set of the transaction for the mode */
+  static auto TableLockSetOf(Transaction *txn, LockMode lock_mode) -> std::shared_ptr<std::unordered_set<table_oid_t>>;
+
+  /**
+   * Wait until the request is granted in the mode or its transaction is aborted.
+   * @param lk the held latch of the shard
+   * @return how long the request was blocked, 0 if it was not
+   */
+  auto WaitForGrant(Transaction *txn, Shard *shard, LockRequest *request, LockMode lock_mode,
+                    std::unique_lock<std::mutex> *lk) -> std::chrono::nanoseconds;
+
+  /** @return true if a request in the mode is compatible with all the counted requests */
+  static auto CompatibleWithAll(const ModeCounts &counts, LockMode lock_mode) -> bool;
+
+  /**
+   * @return the requests of a table queue a new request in the mode has to wait for: the incompatible granted ones,
+   * and, unless it goes in front, the incompatible waiting ones of transactions that are not aborted
+   */
+  static auto TableConflicts(LockRequestQueue *queue, LockMode lock_mode, bool front) -> std::vector<LockRequest *>;
+
+  /**
+   * Grant the waiting requests of the queue that no longer conflict, in order, and wake them. The caller holds the
+   * shard latch.
+   * @param record_queue whether the queue locks a record, where nothing behind a blocked request is granted
+   */
+  void GrantWaiting(LockRequestQueue *queue, bool record_queue);
+
+  /**
+   * Under wound-wait, drop the granted record locks of aborted transactions, except the one of the upgrade: they are
+   * no longer waited for. Their waiting requests are left for their transactions to remove.
+   * @return true if any lock was dropped
+   */
+  static auto DropAbortedHolders(LockRequestQueue *queue) -> bool;
+
+  /**
+   * Record that the transaction is blocked on a request notified through cv. The caller holds the latch of the shard
+   * and must check again whether the transaction was wounded before it waits.
+   */
+  void SetBlocking(txn_id_t txn_id, Shard *shard, std::condition_variable *cv);
+
+  void ClearBlocking(txn_id_t txn_id);
+
+  /**
+   * Wake up the wounded or deadlocked transactions that are blocked, in whichever shard. Must be called without holding
+   * any shard latch.
+   */
+  void NotifyAborted(const std::vector<txn_id_t> &victims);
+
+  /**
+   * Add the edges of the transactions waiting in the queue to the waits-for graph. A request waits for the incompatible
+   * requests in front of it and the incompatible granted ones behind it, which is what each Lock function waits for.
+   * @param record_queue whether the queue locks a record, where an upgrading request is granted in S or INCREMENT but
+   * conflicts as X
+   * @param[out] txns the waiting transactions
+   */
+  void AddWaitEdges(LockRequestQueue *queue, bool record_queue, std::unordered_map<txn_id_t, Transaction *> *txns);
+
+  /** Depth-first search for a cycle through the waits-for graph, see HasCycle. */
+  auto FindCycle(txn_id_t txn_id, std::vector<txn_id_t> *path, std::set<txn_id_t> *on_path,
+                 std::set<txn_id_t> *visited, txn_id_t *victim) -> bool;
+
+  /** The body of the cycle detection thread. */
+  void RunCycleDetection();
+
+  size_t num_shards_;
+  std::unique_ptr<Shard[]> shards_;
+  DeadlockPolicy policy_;
+
+  /** Where each blocked transaction waits, across all shards. Latched after a shard latch, never before. */
+  std::mutex blocking_latch_;
+  std::unordered_map<txn_id_t, std::pair<Shard *, std::condition_variable *>> blocking_;
+
+  /** The aborts of Stats; the rest of the counters is kept per shard. */
+  std::mutex stats_latch_;
+  std::map<AbortReason, uint64_t> aborts_;
 
-  /** Lock table for lock requests. */
-  std::unordered_map<RID, LockRequestQueue> lock_table_;
-  std::unordered_map<txn_id_t, RID> blocking_;
+  /** The waits-for graph, ordered so that the search for cycles is deterministic. */
+  std::map<txn_id_t, std::set<txn_id_t>> waits_for_;
+  std::mutex detection_latch_;
+  std::condition_variable detection_cv_;
+  bool enable_cycle_detection_{false};
+  std::thread cycle_detection_thread_;
 };
 
 }  // namespace bustub
@@ -12,15 +12,19 @@
 
 #pragma once
 
+#include <algorithm>
 #include <atomic>
 #include <deque>
 #include <memory>
 #include <string>
 #include <thread>  // NOLINT
+#include <unordered_map>
 #include <unordered_set>
+#include <utility>
 
 #include "common/config.h"
 #include "common/logger.h"
+#include "recovery/log_record.h"
 #include "storage/page/page.h"
 #include "storage/table/tuple.h"
 
@@ -44,14 +48,16 @@ namespace bustub {
 enum class TransactionState { GROWING, SHRINKING, COMMITTED, ABORTED };
 
 /**
- * Transaction isolation level.
+ * Transaction isolation level. SNAPSHOT_ISOLATION reads the versions committed before the transaction began, without
+ * any lock, and aborts a write to a tuple changed since. OPTIMISTIC reads the same way, records what it read, and
+ * fails validation on commit if any of it was changed since.
  */
-enum class IsolationLevel { READ_UNCOMMITTED, REPEATABLE_READ, READ_COMMITTED };
+enum class IsolationLevel { READ_UNCOMMITTED, REPEATABLE_READ, READ_COMMITTED, SNAPSHOT_ISOLATION, OPTIMISTIC };
 
 /**
  * Type of write operation.
  */
-enum class WType { INSERT = 0, DELETE, UPDATE };
+enum class WType { INSERT = 0, DELETE, UPDATE, INCREMENT };
 
 class TableHeap;
 class Catalog;
@@ -66,14 +72,31 @@ class TableWriteRecord {
   TableWriteRecord(RID rid, WType wtype, const Tuple &tuple, TableHeap *table)
       : rid_(rid), wtype_(wtype), tuple_(tuple), table_(table) {}
 
+  TableWriteRecord(RID rid, TupleIncrement increment, TableHeap *table)
+      : rid_(rid), wtype_(WType::INCREMENT), increment_(std::move(increment)), table_(table) {}
+
   RID rid_;
   WType wtype_;
   /** The tuple is only used for the update operation. */
   Tuple tuple_;
+  /** The deltas of the increment operation, undone by subtracting them. */
+  TupleIncrement increment_;
   /** The table heap specifies which table this write record is for. */
   TableHeap *table_;
 };
 
+/**
+ * ReadRecord tracks a tuple read by an optimistic transaction. The version read is the one as of the transaction's
+ * read timestamp, which is what validation checks against.
+ */
+class TableReadRecord {
+ public:
+  TableReadRecord(RID rid, TableHeap *table) : rid_(rid), table_(table) {}
+
+  RID rid_;
+  TableHeap *table_;
+};
+
 /**
  * WriteRecord tracks information related to a write.
  */
@@ -120,7 +143,10 @@ enum class AbortReason {
   UNLOCK_ON_SHRINKING,
   UPGRADE_CONFLICT,
   DEADLOCK,
-  LOCKSHARED_ON_READ_UNCOMMITTED
+  LOCKSHARED_ON_READ_UNCOMMITTED,
+  SNAPSHOT_WRITE_CONFLICT,
+  VALIDATION_FAILED,
+  WRITE_ON_READ_ONLY
 };
 
 /**
@@ -150,6 +176,13 @@ class TransactionAbortException : public std::exception {
         return "Transaction " + std::to_string(txn_id_) + " aborted on deadlock\n";
       case AbortReason::LOCKSHARED_ON_READ_UNCOMMITTED:
         return "Transaction " + std::to_string(txn_id_) + " aborted on lockshared on READ_UNCOMMITTED\n";
+      case AbortReason::SNAPSHOT_WRITE_CONFLICT:
+        return "Transaction " + std::to_string(txn_id_) +
+               " aborted because a tuple it writes was changed after its snapshot was taken\n";
+      case AbortReason::VALIDATION_FAILED:
+        return "Transaction " + std::to_string(txn_id_) + " aborted because a tuple it read was changed since\n";
+      case AbortReason::WRITE_ON_READ_ONLY:
+        return "Transaction " + std::to_string(txn_id_) + " aborted because it was declared read-only\n";
     }
     // Todo: Should fail with unreachable.
     return "";
@@ -161,18 +194,35 @@ class TransactionAbortException : public std::exception {
  */
 class Transaction {
  public:
-  explicit Transaction(txn_id_t txn_id, IsolationLevel isolation_level = IsolationLevel::REPEATABLE_READ)
+  /**
+   * @param read_only a read-only transaction reads a snapshot, whatever its isolation level, and may not write: it has
+   * no write sets and begins and commits without the bookkeeping of writers, see TransactionManager::BeginReadOnly
+   */
+  explicit Transaction(txn_id_t txn_id, IsolationLevel isolation_level = IsolationLevel::REPEATABLE_READ,
+                       bool read_only = false)
       : isolation_level_(isolation_level),
+        read_only_(read_only),
         thread_id_(std::this_thread::get_id()),
         txn_id_(txn_id),
         prev_lsn_(INVALID_LSN),
         shared_lock_set_{new std::unordered_set<RID>},
-        exclusive_lock_set_{new std::unordered_set<RID>} {
+        exclusive_lock_set_{new std::unordered_set<RID>},
+        increment_lock_set_{new std::unordered_set<RID>},
+        table_row_lock_set_{new std::unordered_map<table_oid_t, std::unordered_set<RID>>},
+        shared_table_lock_set_{new std::unordered_set<table_oid_t>},
+        exclusive_table_lock_set_{new std::unordered_set<table_oid_t>},
+        intention_shared_table_lock_set_{new std::unordered_set<table_oid_t>},
+        intention_exclusive_table_lock_set_{new std::unordered_set<table_oid_t>},
+        shared_intention_exclusive_table_lock_set_{new std::unordered_set<table_oid_t>} {
     // Initialize the sets that will be tracked.
-    table_write_set_ = std::make_shared<std::deque<TableWriteRecord>>();
-    index_write_set_ = std::make_shared<std::deque<IndexWriteRecord>>();
     page_set_ = std::make_shared<std::deque<bustub::Page *>>();
     deleted_page_set_ = std::make_shared<std::unordered_set<page_id_t>>();
+    if (!read_only_) {
+      commit_ts_ = std::make_shared<std::atomic<timestamp_t>>(INVALID_TIMESTAMP);
+      table_read_set_ = std::make_shared<std::deque<TableReadRecord>>();
+      table_write_set_ = std::make_shared<std::deque<TableWriteRecord>>();
+      index_write_set_ = std::make_shared<std::deque<IndexWriteRecord>>();
+    }
   }
 
   ~Transaction() = default;
@@ -188,6 +238,18 @@ class Transaction {
   /** @return the isolation level of this transaction */
   inline auto GetIsolationLevel() const -> IsolationLevel { return isolation_level_; }
 
+  /** @return true if the transaction was declared read-only */
+  inline auto IsReadOnly() const -> bool { return read_only_; }
+
+  /** @return true if the transaction reads the snapshot of its read timestamp instead of locking */
+  inline auto IsSnapshotRead() const -> bool {
+    return read_only_ || isolation_level_ == IsolationLevel::SNAPSHOT_ISOLATION ||
+           isolation_level_ == IsolationLevel::OPTIMISTIC;
+  }
+
+  /** @return the list of table read records of this transaction, only kept by optimistic transactions */
+  inline auto GetReadSet() -> std::shared_ptr<std::deque<TableReadRecord>> { return table_read_set_; }
+
   /** @return the list of table write records of this transaction */
   inline auto GetWriteSet() -> std::shared_ptr<std::deque<TableWriteRecord>> { return table_write_set_; }
 
@@ -242,6 +304,44 @@ class Transaction {
     return exclusive_lock_set_->find(rid) != exclusive_lock_set_->end();
   }
 
+  /** @return the set of resources under an increment lock */
+  inline auto GetIncrementLockSet() -> std::shared_ptr<std::unordered_set<RID>> { return increment_lock_set_; }
+
+  /** @return true if rid is increment locked by this transaction */
+  auto IsIncrementLocked(const RID &rid) -> bool {
+    return increment_lock_set_->find(rid) != increment_lock_set_->end();
+  }
+
+  /** @return the locked tuples whose table is known to the lock manager, by table */
+  inline auto GetTableRowLockSet() -> std::shared_ptr<std::unordered_map<table_oid_t, std::unordered_set<RID>>> {
+    return table_row_lock_set_;
+  }
+
+  /** @return the set of tables under a shared lock */
+  inline auto GetSharedTableLockSet() -> std::shared_ptr<std::unordered_set<table_oid_t>> {
+    return shared_table_lock_set_;
+  }
+
+  /** @return the set of tables under an exclusive lock */
+  inline auto GetExclusiveTableLockSet() -> std::shared_ptr<std::unordered_set<table_oid_t>> {
+    return exclusive_table_lock_set_;
+  }
+
+  /** @return the set of tables under an intention shared lock */
+  inline auto GetIntentionSharedTableLockSet() -> std::shared_ptr<std::unordered_set<table_oid_t>> {
+    return intention_shared_table_lock_set_;
+  }
+
+  /** @return the set of tables under an intention exclusive lock */
+  inline auto GetIntentionExclusiveTableLockSet() -> std::shared_ptr<std::unordered_set<table_oid_t>> {
+    return intention_exclusive_table_lock_set_;
+  }
+
+  /** @return the set of tables under a shared intention exclusive lock */
+  inline auto GetSharedIntentionExclusiveTableLockSet() -> std::shared_ptr<std::unordered_set<table_oid_t>> {
+    return shared_intention_exclusive_table_lock_set_;
+  }
+
   /** @return the current state of the transaction */
   inline auto GetState() -> TransactionState { return state_; }
 
@@ -260,22 +360,59 @@ class Transaction {
    */
   inline void SetPrevLSN(lsn_t prev_lsn) { prev_lsn_ = prev_lsn; }
 
+  /** @return the timestamp of the last commit visible to this transaction's snapshot */
+  inline auto GetReadTimestamp() -> timestamp_t { return read_ts_; }
+
+  /**
+   * Set the snapshot of the transaction.
+   * @param read_ts the timestamp of the last commit visible to it
+   */
+  inline void SetReadTimestamp(timestamp_t read_ts) { read_ts_ = read_ts; }
+
+  /** @return the commit timestamp, shared with the tuple versions this transaction wrote; INVALID_TIMESTAMP before */
+  inline auto GetCommitTimestamp() -> std::shared_ptr<const std::atomic<timestamp_t>> { return commit_ts_; }
+
+  /**
+   * Stamp the transaction, and with it every tuple version it wrote, as committed.
+   * @param commit_ts the commit timestamp
+   */
+  inline void SetCommitTimestamp(timestamp_t commit_ts) { commit_ts_->store(commit_ts); }
+
+  /** @return the latest commit LSN of the transactions whose early released locks this transaction acquired */
+  inline auto GetDependencyLSN() -> lsn_t { return dependency_lsn_; }
+
+  /**
+   * Record that this transaction acquired a lock released by a commit that may not be durable yet.
+   * @param commit_lsn the LSN of that commit record
+   */
+  inline void AddDependency(lsn_t commit_lsn) { dependency_lsn_ = std::max(dependency_lsn_, commit_lsn); }
+
  private:
-  /** The current transaction state. */
-  TransactionState state_{TransactionState::GROWING};
+  /** The current transaction state, wounding transactions set it from other threads. */
+  std::atomic<TransactionState> state_{TransactionState::GROWING};
   /** The isolation level of the transaction. */
   IsolationLevel isolation_level_;
+  /** A read-only transaction has no read, write or commit timestamp state besides its snapshot. */
+  bool read_only_;
   /** The thread ID, used in single-threaded transactions. */
   std::thread::id thread_id_;
   /** The ID of this transaction. */
   txn_id_t txn_id_;
 
+  /** The tuples read, validated on commit. */
+  std::shared_ptr<std::deque<TableReadRecord>> table_read_set_;
   /** The undo set of table tuples. */
   std::shared_ptr<std::deque<TableWriteRecord>> table_write_set_;
   /** The undo set of indexes. */
   std::shared_ptr<std::deque<IndexWriteRecord>> index_write_set_;
   /** The LSN of the last record written by the transaction. */
   lsn_t prev_lsn_;
+  /** This transaction must not become durable before the commit record at this LSN, see AddDependency. */
+  lsn_t dependency_lsn_{INVALID_LSN};
+  /** Snapshot isolation: the last commit visible to this transaction. */
+  timestamp_t read_ts_{INVALID_TIMESTAMP};
+  /** Snapshot isolation: set once, on commit. */
+  std::shared_ptr<std::atomic<timestamp_t>> commit_ts_;
 
   /** Concurrent index: the pages that were latched during index operation. */
   std::shared_ptr<std::deque<Page *>> page_set_;
@@ -286,6 +423,16 @@ class Transaction {
   std::shared_ptr<std::unordered_set<RID>> shared_lock_set_;
   /** LockManager: the set of exclusive-locked tuples held by this transaction. */
   std::shared_ptr<std::unordered_set<RID>> exclusive_lock_set_;
+  /** LockManager: the set of increment-locked tuples held by this transaction. */
+  std::shared_ptr<std::unordered_set<RID>> increment_lock_set_;
+  /** LockManager: the tuples of the sets above that were locked along with their table, counted for escalation. */
+  std::shared_ptr<std::unordered_map<table_oid_t, std::unordered_set<RID>>> table_row_lock_set_;
+  /** LockManager: the tables locked by this transaction, one set per mode. A table is in at most one of them. */
+  std::shared_ptr<std::unordered_set<table_oid_t>> shared_table_lock_set_;
+  std::shared_ptr<std::unordered_set<table_oid_t>> exclusive_table_lock_set_;
+  std::shared_ptr<std::unordered_set<table_oid_t>> intention_shared_table_lock_set_;
+  std::shared_ptr<std::unordered_set<table_oid_t>> intention_exclusive_table_lock_set_;
+  std::shared_ptr<std::unordered_set<table_oid_t>> shared_intention_exclusive_table_lock_set_;
 };
 
 }  // namespace bustub
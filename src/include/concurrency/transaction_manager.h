@@ -13,13 +13,13 @@
 #pragma once
 
 #include <atomic>
-#include <shared_mutex>
-#include <unordered_map>
-#include <unordered_set>
+#include <mutex>  // NOLINT
+#include <set>
 
 #include "common/config.h"
 #include "concurrency/lock_manager.h"
 #include "concurrency/transaction.h"
+#include "concurrency/transaction_registry.h"
 #include "recovery/log_manager.h"
 
 namespace bustub {
@@ -45,10 +45,21 @@ class TransactionManager {
       -> Transaction *;
 
   /**
-   * Commits a transaction.
+   * Begins a read-only transaction. It reads the snapshot of the latest commit without taking any lock, and only
+   * registers that snapshot: it does not block checkpoints, is not logged and is not found by GetTransaction. Its
+   * abort only retires the snapshot; its commit also waits for the commits of the snapshot to be durable. Begin hands
+   * a transaction constructed read-only over to this.
+   * @param txn an optional read-only transaction object to be initialized, otherwise a new one is created.
+   * @return an initialized transaction
+   */
+  auto BeginReadOnly(Transaction *txn = nullptr) -> Transaction *;
+
+  /**
+   * Commits a transaction. An optimistic transaction is validated first, and aborted instead if that fails.
    * @param txn the transaction to commit
+   * @return false if the transaction was aborted instead
    */
-  void Commit(Transaction *txn);
+  auto Commit(Transaction *txn) -> bool;
 
   /**
    * Aborts a transaction
@@ -56,25 +67,17 @@ class TransactionManager {
    */
   void Abort(Transaction *txn);
 
-  /**
-   * Global list of running transactions
-   */
-
-  /** The transaction map is a global list of all the running transactions in the system. */
-  static std::unordered_map<txn_id_t, Transaction *> txn_map;
-  static std::shared_mutex txn_map_mutex;
+  /** The global registry of all the running transactions in the system. A transaction leaves it when it finishes. */
+  static TransactionRegistry txn_registry;
 
   /**
    * Locates and returns the transaction with the given transaction ID.
-   * @param txn_id the id of the transaction to be found, it must exist!
+   * @param txn_id the id of the transaction to be found, it must be running!
    * @return the transaction with the given transaction id
    */
   static auto GetTransaction(txn_id_t txn_id) -> Transaction * {
-    TransactionManager::txn_map_mutex.lock_shared();
-    assert(TransactionManager::txn_map.find(txn_id) != TransactionManager::txn_map.end());
-    auto *res = TransactionManager::txn_map[txn_id];
+    auto *res = txn_registry.Find(txn_id);
     assert(res != nullptr);
-    TransactionManager::txn_map_mutex.unlock_shared();
     return res;
   }
 
@@ -89,22 +92,37 @@ class TransactionManager {
    * Releases all the locks held by the given transaction.
    * @param txn the transaction whose locks should be released
    */
-  void ReleaseLocks(Transaction *txn) {
-    std::unordered_set<RID> lock_set;
-    for (auto item : *txn->GetExclusiveLockSet()) {
-      lock_set.emplace(item);
-    }
-    for (auto item : *txn->GetSharedLockSet()) {
-      lock_set.emplace(item);
-    }
-    for (auto locked_rid : lock_set) {
-      lock_manager_->Unlock(txn, locked_rid);
+  void ReleaseLocks(Transaction *txn) { lock_manager_->UnlockAll(txn); }
+
+  /**
+   * Validate an optimistic transaction: no tuple it read was changed by anyone else since its read timestamp.
+   * A change that is not committed yet fails validation too, since it may commit before this transaction does.
+   */
+  auto Validate(Transaction *txn) -> bool;
+
+  /** Commit or abort a read-only transaction: retire its snapshot and, to commit, wait for it to be durable. */
+  void FinishReadOnly(Transaction *txn, TransactionState state);
+
+  /** Stop counting the snapshot of txn, if it has one, as running. The caller holds timestamp_latch_. */
+  void EndSnapshot(Transaction *txn) {
+    if (txn->IsSnapshotRead()) {
+      active_snapshots_.erase(active_snapshots_.find(txn->GetReadTimestamp()));
     }
   }
 
   std::atomic<txn_id_t> next_txn_id_{0};
+
+  /** Protects the commit timestamps and the running snapshots. */
+  std::mutex timestamp_latch_;
+  /** The commit timestamp of the latest commit, which is what new snapshots read. */
+  timestamp_t last_commit_ts_{0};
+  /** The latest LSN of the commit records of the commits up to last_commit_ts_. */
+  lsn_t last_commit_lsn_{INVALID_LSN};
+  /** The read timestamps of the running snapshot isolation and optimistic transactions. */
+  std::multiset<timestamp_t> active_snapshots_;
+
   LockManager *lock_manager_ __attribute__((__unused__));
-  LogManager *log_manager_ __attribute__((__unused__));
+  LogManager *log_manager_;
 
   /** The global transaction latch is used for checkpointing. */
   ReaderWriterLatch global_txn_latch_;
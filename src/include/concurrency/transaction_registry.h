@@ -0,0 +1,63 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// transaction_registry.h
+//
+// Identification: src/include/concurrency/transaction_registry.h
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <atomic>
+#include <shared_mutex>
+#include <unordered_map>
+
+#include "common/config.h"
+
+namespace bustub {
+
+class Transaction;
+
+/**
+ * TransactionRegistry maps the ids of the running transactions to the transactions.
+ *
+ * Each transaction takes the slot its id hashes to, by compare-and-swap, so registering, finding and deregistering
+ * take no latch. Transaction ids are handed out in order, so two running transactions only want the same slot if one
+ * runs while SLOT_COUNT younger ones begin; the younger one then goes to an overflow map behind a latch, which is only
+ * looked at while it has entries. Slots are never freed and the transactions are owned by whoever began them, so
+ * nothing has to be reclaimed.
+ */
+class TransactionRegistry {
+ public:
+  static constexpr size_t SLOT_COUNT = 4096;
+
+  /** Register a transaction as running; a transaction registered with the same id before is replaced. */
+  void Register(Transaction *txn);
+
+  /** Deregister a transaction, once it finished. */
+  void Deregister(Transaction *txn);
+
+  /** @return the running transaction with the id, nullptr if there is none */
+  auto Find(txn_id_t txn_id) -> Transaction *;
+
+ private:
+  /** A slot on its own cache line, so that transactions beginning one after the other do not share one. */
+  struct alignas(64) Slot {
+    std::atomic<txn_id_t> txn_id_{INVALID_TXN_ID};
+    std::atomic<Transaction *> txn_{nullptr};
+  };
+
+  inline auto SlotOf(txn_id_t txn_id) -> Slot & { return slots_[static_cast<uint32_t>(txn_id) % SLOT_COUNT]; }
+
+  Slot slots_[SLOT_COUNT];
+
+  std::shared_mutex overflow_latch_;
+  std::unordered_map<txn_id_t, Transaction *> overflow_;
+  std::atomic<size_t> overflow_size_{0};
+};
+
+}  // namespace bustub
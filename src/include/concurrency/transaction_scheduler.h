@@ -0,0 +1,127 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// transaction_scheduler.h
+//
+// Identification: src/include/concurrency/transaction_scheduler.h
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <atomic>
+#include <chrono>              // NOLINT
+#include <condition_variable>  // NOLINT
+#include <functional>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include "common/config.h"
+#include "common/rid.h"
+#include "concurrency/lock_manager.h"
+#include "concurrency/transaction_manager.h"
+
+namespace bustub {
+
+/**
+ * TransactionScheduler runs transactions on behalf of their clients, in front of the TransactionManager.
+ *
+ * At most max_in_flight transactions run at once; the others wait for a slot. A transaction aborted by the lock
+ * manager is retried after a random backoff, which doubles with every attempt, so that wounded transactions do not
+ * come straight back and collide with their wounders again. Its slot is handed on while it backs off.
+ *
+ * The records waited on longest, as GetStats of the lock manager reports them, are hot: the transactions that name one
+ * of them run one after the other instead of fighting over its lock. The hot records are looked up again every
+ * HOT_KEY_REFRESH_INTERVAL.
+ */
+class TransactionScheduler {
+ public:
+  /**
+   * The work of a transaction: it takes its locks, may throw TransactionAbortException, and returns false to abort
+   * the transaction without a retry.
+   */
+  using Body = std::function<bool(Transaction *)>;
+
+  /** How the transactions run so far ended. */
+  struct Stats {
+    uint64_t commits_{0};
+    /** The attempts that were aborted and retried. */
+    uint64_t retries_{0};
+    /** The transactions given up after max_attempts, or aborted by their body. */
+    uint64_t failures_{0};
+  };
+
+  static constexpr std::chrono::microseconds BACKOFF_BASE{50};
+  static constexpr std::chrono::microseconds BACKOFF_MAX{10000};
+  static constexpr std::chrono::milliseconds HOT_KEY_REFRESH_INTERVAL{100};
+
+  /**
+   * @param txn_manager the transaction manager the transactions run in
+   * @param lock_manager the lock manager of the transactions, asked for the hot records
+   * @param max_in_flight the number of transactions running at once
+   * @param max_attempts the number of times a transaction is tried before it is given up
+   * @param hot_keys the number of hot records whose transactions run one after the other, 0 for none
+   */
+  TransactionScheduler(TransactionManager *txn_manager, LockManager *lock_manager, size_t max_in_flight,
+                       size_t max_attempts = 16, size_t hot_keys = 0);
+
+  /**
+   * Run a transaction until it commits, it was tried max_attempts times, or its body gives up.
+   * @param body the work of the transaction, run once per attempt; returning false gives up, unless the transaction
+   * was aborted, e.g. wounded while waiting for a lock, which is retried
+   * @param keys the records the transaction is going to lock, if known
+   * @param isolation_level the isolation level of the transaction
+   * @return true if the transaction committed
+   */
+  auto Run(const Body &body, const std::vector<RID> &keys = {},
+           IsolationLevel isolation_level = IsolationLevel::REPEATABLE_READ) -> bool;
+
+  /** Look up the hot records in the lock manager now. */
+  void RefreshHotKeys();
+
+  /** @return the records currently treated as hot */
+  auto GetHotKeys() -> std::vector<RID>;
+
+  auto GetStats() -> Stats;
+
+ private:
+  /** Wait for a free slot. */
+  void Admit();
+
+  /** Hand the slot on. */
+  void Leave();
+
+  /** @return the turns of the hot records among the keys, in a fixed order, refreshing the hot records if due */
+  auto HotTurnsOf(const std::vector<RID> &keys) -> std::vector<std::shared_ptr<std::mutex>>;
+
+  /** @return how long to back off before the attempt, which has to be at least the second one */
+  auto Backoff(size_t attempt) -> std::chrono::microseconds;
+
+  TransactionManager *txn_manager_;
+  LockManager *lock_manager_;
+  size_t max_attempts_;
+  size_t hot_keys_;
+
+  std::mutex admission_latch_;
+  std::condition_variable admission_cv_;
+  size_t free_slots_;
+
+  /** Guards the hot records and the random generator. */
+  std::mutex latch_;
+  /** The turn of each hot record: whoever holds it runs a transaction on the record. */
+  std::unordered_map<RID, std::shared_ptr<std::mutex>> hot_turns_;
+  std::chrono::steady_clock::time_point next_refresh_;
+  std::mt19937 random_;
+
+  std::atomic<uint64_t> commits_{0};
+  std::atomic<uint64_t> retries_{0};
+  std::atomic<uint64_t> failures_{0};
+};
+
+}  // namespace bustub
@@ -12,13 +12,18 @@
 
 #pragma once
 
+#include <atomic>
+#include <mutex>  // NOLINT
 #include <queue>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "buffer/buffer_pool_manager.h"
 #include "concurrency/transaction.h"
 #include "container/hash/hash_function.h"
+#include "container/hash/hash_table_directory.h"
+#include "recovery/log_manager.h"
 #include "storage/page/hash_table_bucket_page.h"
 #include "storage/page/hash_table_directory_page.h"
 
@@ -30,6 +35,10 @@ namespace bustub {
  * Implementation of extendible hash table that is backed by a buffer pool
  * manager. Non-unique keys are supported. Supports insert and delete. The
  * table grows/shrinks dynamically as buckets become full/empty.
+ *
+ * The directory page stays pinned as long as the table is open, and the bucket
+ * page ids of the directory are mirrored in memory, so a lookup fetches nothing
+ * but its bucket page.
  */
 template <typename KeyType, typename ValueType, typename KeyComparator>
 class ExtendibleHashTable {
@@ -40,9 +49,29 @@ class ExtendibleHashTable {
    * @param buffer_pool_manager buffer pool manager to be used
    * @param comparator comparator for keys
    * @param hash_fn the hash function
+   * @param log_manager the log manager, changes to the directory and bucket pages are logged when it is set
    */
   explicit ExtendibleHashTable(const std::string &name, BufferPoolManager *buffer_pool_manager,
-                               const KeyComparator &comparator, HashFunction<KeyType> hash_fn);
+                               const KeyComparator &comparator, HashFunction<KeyType> hash_fn,
+                               LogManager *log_manager = nullptr);
+
+  /**
+   * Opens an ExtendibleHashTable whose pages already exist, e.g. after they were recovered from the log.
+   *
+   * @param buffer_pool_manager buffer pool manager to be used
+   * @param comparator comparator for keys
+   * @param hash_fn the hash function
+   * @param directory_page_id the page id of the existing directory
+   * @param log_manager the log manager, changes to the directory and bucket pages are logged when it is set
+   * @throws Exception OUT_OF_MEMORY if the buffer pool has no frame left for a page of the directory
+   */
+  ExtendibleHashTable(const std::string &name, BufferPoolManager *buffer_pool_manager, const KeyComparator &comparator,
+                      HashFunction<KeyType> hash_fn, page_id_t directory_page_id, LogManager *log_manager = nullptr);
+
+  /**
+   * Unpins the directory page, so the buffer pool manager has to outlive the table.
+   */
+  ~ExtendibleHashTable();
 
   /**
    * Inserts a key-value pair into the hash table.
@@ -74,6 +103,21 @@ class ExtendibleHashTable {
    */
   auto GetValue(Transaction *transaction, const KeyType &key, std::vector<ValueType> *result) -> bool;
 
+  /**
+   * Inserts many key-value pairs at once. Into an empty table, the directory is sized for them up front and every
+   * bucket page is filled in one go, without any split; into a table that is not empty, they are inserted one by one.
+   *
+   * @param transaction the current transaction
+   * @param pairs the key-value pairs to insert
+   * @return true if all of them were inserted, false if some were duplicates or did not fit
+   */
+  auto BulkLoad(Transaction *transaction, const std::vector<std::pair<KeyType, ValueType>> &pairs) -> bool;
+
+  /**
+   * @return the page id of the directory, enough to open the table again with the constructor above
+   */
+  auto GetDirectoryPageId() const -> page_id_t { return directory_page_id_; }
+
   /**
    * Returns the global depth.  Do not touch.
    */
@@ -139,14 +183,51 @@ class ExtendibleHashTable {
   auto FetchBucketPage(page_id_t bucket_page_id) -> HASH_TABLE_BUCKET_TYPE *;
 
   /**
-   * Performs insertion with an optional bucket splitting.
+   * Read the bucket page_id of a key from the mirror of the directory, consistently with the changes made meanwhile.
+   *
+   * @param hash the hash of the key, by hash_fn_
+   * @return the bucket page_id corresponding to the key
+   */
+  auto BucketPageIdOf(uint32_t hash) -> page_id_t;
+
+  /**
+   * Fetches and latches the bucket page of a key, retrying until the directory still points to it once latched.
+   *
+   * @param hash the hash of the key, by hash_fn_
+   * @param exclusive whether to take the write latch
+   * @return the latched bucket page, nullptr if it could not be fetched
+   */
+  auto FetchLatchedBucket(uint64_t hash, bool exclusive) -> Page *;
+
+  /** Bracket a change of the directory, made under directory_latch_, for the lookups reading it meanwhile. */
+  void BeginDirectoryChange();
+  void EndDirectoryChange();
+
+  /**
+   * Splits the full bucket of the key, again if all of its pairs stay together, and inserts the pair.
    *
    * @param transaction a pointer to the current transaction
+   * @param raw_page the full bucket page of the key, write latched; it is unlatched and unpinned on return
    * @param key the key to insert
    * @param value the value to insert
+   * @param hash the hash of the key, by hash_fn_
    * @return whether or not the insertion was successful
    */
-  auto SplitInsert(Transaction *transaction, const KeyType &key, const ValueType &value) -> bool;
+  auto SplitInsert(Transaction *transaction, Page *raw_page, const KeyType &key, const ValueType &value, uint64_t hash)
+      -> bool;
+
+  /**
+   * Builds the directory and the buckets of an empty table for the pairs, under the latch of bucket 0 and the
+   * directory latch.
+   *
+   * @param transaction the current transaction
+   * @param pairs the key-value pairs to insert
+   * @param[out] leftovers the pairs, by index, that are left to insert one by one: all of them if the table is not
+   * empty or the buffer pool ran out of pages, and those that did not fit into a bucket of the deepest directory
+   * @return false if some pairs were duplicates
+   */
+  auto BulkBuild(Transaction *transaction, const std::vector<std::pair<KeyType, ValueType>> &pairs,
+                 std::vector<uint32_t> *leftovers) -> bool;
 
   /**
    * Optionally merges an empty bucket into it's pair.  This is called by Remove,
@@ -163,13 +244,37 @@ class ExtendibleHashTable {
    */
   void Merge(Transaction *transaction, const KeyType &key, const ValueType &value);
 
+  /**
+   * Write ahead a log record of a change to the index pages. Changes made without a transaction, which includes
+   * every split and merge, are logged under INVALID_TXN_ID: recovery redoes them but never undoes them.
+   *
+   * @param transaction the transaction making the change, or nullptr
+   * @param args the type and payload of the log record
+   * @return the LSN of the record, INVALID_LSN if logging is disabled
+   */
+  template <typename... Args>
+  auto WriteLog(Transaction *transaction, Args &&...args) -> lsn_t;
+
+  /**
+   * Log an insert or a remove on one slot of a bucket and stamp the bucket with its LSN.
+   */
+  void LogSlot(Transaction *transaction, LogRecordType type, page_id_t bucket_page_id, HASH_TABLE_BUCKET_TYPE *bucket,
+               uint32_t bucket_idx);
+
   // member variables
   page_id_t directory_page_id_;
+  // The directory page, pinned for the lifetime of the table
+  HashTableDirectoryPage *dir_page_;
   BufferPoolManager *buffer_pool_manager_;
   KeyComparator comparator_;
+  LogManager *log_manager_;
 
-  // Readers includes inserts and removes, writers are splits and merges
-  ReaderWriterLatch table_latch_;
+  // Serializes the directory changes of splits and merges; lookups, inserts and removes never take it
+  std::mutex directory_latch_;
+  // Odd while the directory is being changed, see BucketPageIdOf
+  std::atomic<uint64_t> directory_version_{0};
+  // The bucket page ids of the directory, changed along with its pages under directory_latch_
+  HashTableDirectoryMirror mirror_;
   HashFunction<KeyType> hash_fn_;
 };
 
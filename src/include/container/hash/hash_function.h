@@ -12,12 +12,26 @@
 
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 
 #include "murmur3/MurmurHash3.h"
 
 namespace bustub {
 
+/**
+ * Hashes the bytes of a key the way HashFunction does, for those that only have the bytes, e.g. recovery.
+ *
+ * @param data the bytes of the key
+ * @param size the number of bytes
+ * @return the hashed value
+ */
+inline auto HashBytes(const void *data, size_t size) -> uint64_t {
+  uint64_t hash[2];
+  murmur3::MurmurHash3_x64_128(data, static_cast<int>(size), 0, reinterpret_cast<void *>(&hash));
+  return hash[0];
+}
+
 template <typename KeyType>
 class HashFunction {
  public:
@@ -25,12 +39,7 @@ class HashFunction {
    * @param key the key to be hashed
    * @return the hashed value
    */
-  virtual auto GetHash(KeyType key) -> uint64_t {
-    uint64_t hash[2];
-    murmur3::MurmurHash3_x64_128(reinterpret_cast<const void *>(&key), static_cast<int>(sizeof(KeyType)), 0,
-                                 reinterpret_cast<void *>(&hash));
-    return hash[0];
-  }
+  virtual auto GetHash(KeyType key) -> uint64_t { return HashBytes(&key, sizeof(KeyType)); }
 };
 
 }  // namespace bustub
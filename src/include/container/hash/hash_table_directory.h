@@ -0,0 +1,183 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// hash_table_directory.h
+//
+// Identification: src/include/container/hash/hash_table_directory.h
+//
+// Copyright (c) 2015-2021, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <set>
+#include <vector>
+
+#include "buffer/buffer_pool_manager.h"
+#include "recovery/log_manager.h"
+#include "storage/page/hash_table_directory_page.h"
+
+namespace bustub {
+
+/**
+ * HashTableDirectoryMirror keeps the bucket page ids of a directory in memory, for the lookups, which read it without
+ * fetching any directory page. The table writes each change of the directory to it once the pages are changed, and
+ * the HashTableDirectory it is given to copies the entries into it as the directory grows. It grows by whole segments,
+ * like the directory; a segment, once allocated, stays until the mirror is destroyed.
+ */
+class HashTableDirectoryMirror {
+ public:
+  HashTableDirectoryMirror() = default;
+  ~HashTableDirectoryMirror();
+
+  HashTableDirectoryMirror(const HashTableDirectoryMirror &) = delete;
+  auto operator=(const HashTableDirectoryMirror &) -> HashTableDirectoryMirror & = delete;
+
+  /**
+   * @return the bucket page id of the entry, INVALID_PAGE_ID if its segment is not mirrored (yet), which a lookup
+   * only sees on a torn read
+   */
+  inline auto GetBucketPageId(uint32_t bucket_idx) const -> page_id_t {
+    const page_id_t *segment = segments_[bucket_idx / DIRECTORY_ARRAY_SIZE].load(std::memory_order_acquire);
+    return segment == nullptr ? INVALID_PAGE_ID : segment[bucket_idx % DIRECTORY_ARRAY_SIZE];
+  }
+
+  /** Set the bucket page id of the entry, allocating its segment if needed. */
+  void SetBucketPageId(uint32_t bucket_idx, page_id_t bucket_page_id);
+
+ private:
+  std::array<std::atomic<page_id_t *>, DIRECTORY_SEGMENT_COUNT> segments_{};
+};
+
+/**
+ * HashTableDirectory is the whole directory of an extendible hash table, which spans the directory page and, once it
+ * outgrows it, up to DIRECTORY_SEGMENT_COUNT - 1 segment pages. It is opened for one split or merge, under the latch
+ * the table serializes them with, and fetches the segment pages it needs on the way. At most MAX_PINNED_SEGMENTS of
+ * them stay pinned: fetching another one first unpins the one used least recently, so walking the whole directory
+ * needs no more frames than copying one segment to another.
+ *
+ * The entries it changes are logged page by page, as redo-only HASHDIRECTORY records: a segment page when it is
+ * unpinned, the rest by Log. The segment pages of the directory page are logged as entries past DIRECTORY_ARRAY_SIZE.
+ */
+class HashTableDirectory {
+ public:
+  /**
+   * @param buffer_pool_manager the buffer pool of the table
+   * @param dir_page the pinned directory page
+   * @param log_manager the log manager, Log writes nothing without it
+   * @param mirror the mirror PrepareGrowth and LoadMirror write to, if any
+   */
+  HashTableDirectory(BufferPoolManager *buffer_pool_manager, HashTableDirectoryPage *dir_page,
+                     LogManager *log_manager, HashTableDirectoryMirror *mirror = nullptr);
+
+  ~HashTableDirectory();
+
+  HashTableDirectory(const HashTableDirectory &) = delete;
+  auto operator=(const HashTableDirectory &) -> HashTableDirectory & = delete;
+
+  /**
+   * Look the bucket of a hash up, without any concurrent change; used by recovery.
+   * @return the bucket page id, INVALID_PAGE_ID if a segment page could not be fetched
+   */
+  static auto LookUp(BufferPoolManager *buffer_pool_manager, HashTableDirectoryPage *dir_page, uint32_t hash)
+      -> page_id_t;
+
+  /**
+   * Fetch the page holding an entry ahead of the accessors, which expect it to be there; it stays pinned until
+   * MAX_PINNED_SEGMENTS other segment pages were fetched after it.
+   * @return false if it is a segment page that could not be fetched
+   */
+  auto Fetch(uint32_t bucket_idx) -> bool;
+
+  inline auto GetGlobalDepth() -> uint32_t { return dir_page_->GetGlobalDepth(); }
+
+  inline auto GetGlobalDepthMask() -> uint32_t { return dir_page_->GetGlobalDepthMask(); }
+
+  inline auto Size() -> uint32_t { return dir_page_->Size(); }
+
+  auto GetBucketPageId(uint32_t bucket_idx) -> page_id_t;
+
+  void SetBucketPageId(uint32_t bucket_idx, page_id_t bucket_page_id);
+
+  auto GetLocalDepth(uint32_t bucket_idx) -> uint32_t;
+
+  void SetLocalDepth(uint32_t bucket_idx, uint8_t local_depth);
+
+  void IncrLocalDepth(uint32_t bucket_idx);
+
+  void DecrLocalDepth(uint32_t bucket_idx);
+
+  /**
+   * Set the bucket page ids and local depths of the entries, walking them in order, so that the segment pages of
+   * sorted entries are fetched once each. The mirror is left to the caller, which updates it once the change is made.
+   * @return false if a segment page could not be fetched, the entries set before being set back then
+   */
+  auto SetEntries(const std::vector<HashDirectoryEntry> &entries) -> bool;
+
+  /**
+   * Copy the directory into the slots past its end, allocating the segment pages needed for that, without changing
+   * the global depth yet: lookups never read past the end, so this needs no care for them, unlike IncrGlobalDepth.
+   * @return false if the directory cannot grow any more or a segment page could not be allocated
+   */
+  auto PrepareGrowth() -> bool;
+
+  /** Double the directory, which PrepareGrowth filled already. */
+  inline void IncrGlobalDepth() { dir_page_->SetGlobalDepth(GetGlobalDepth() + 1); }
+
+  /** Halve the directory; its segment pages are kept for growing again. */
+  inline void DecrGlobalDepth() { dir_page_->DecrGlobalDepth(); }
+
+  /** @return true if no bucket has the global depth as its local depth, false as well if a segment is missing */
+  auto CanShrink() -> bool;
+
+  /** Write ahead the entries changed, one record per page, and stamp the pages with their LSN. Called once, last. */
+  void Log();
+
+  /**
+   * Copy the whole directory into the mirror, e.g. when the table is opened, one segment page pinned at a time.
+   * @return false if a segment page could not be fetched
+   */
+  auto LoadMirror() -> bool;
+
+  /** Verify the invariants of HashTableDirectoryPage::VerifyIntegrity over all pages. */
+  void VerifyIntegrity();
+
+ private:
+  /** @return the page holding the slot of the entry, fetched if it is a segment page */
+  auto PageOf(uint32_t bucket_idx) -> HashTableDirectoryPage *;
+
+  /**
+   * @return the page of a segment, fetched or, past the allocated ones, allocated, after unpinning the segment page
+   * used least recently if MAX_PINNED_SEGMENTS are pinned
+   */
+  auto SegmentPage(uint32_t segment) -> HashTableDirectoryPage *;
+
+  /** Log the entries changed in a pinned segment page and unpin it. */
+  void Unpin(uint32_t segment);
+
+  /** Write ahead the entries changed in a page, if any, and stamp the page with the LSN of the record. */
+  void LogPage(HashTableDirectoryPage *page, uint32_t segment);
+
+  /** The segment pages kept pinned at most, two for copying one segment to another. */
+  static constexpr size_t MAX_PINNED_SEGMENTS = 2;
+
+  BufferPoolManager *buffer_pool_manager_;
+  HashTableDirectoryPage *dir_page_;
+  LogManager *log_manager_;
+  HashTableDirectoryMirror *mirror_;
+  /** The segment pages pinned by segment, nullptr for the others. */
+  std::vector<HashTableDirectoryPage *> segments_;
+  /** The segments pinned, the one used least recently first. */
+  std::vector<uint32_t> pinned_;
+  /** The segments changed since they were pinned. */
+  std::vector<bool> dirty_;
+  /** The entries changed and not logged yet, and the segments whose page ids were set. */
+  std::set<uint32_t> changed_;
+  std::set<uint32_t> changed_segments_;
+};
+
+}  // namespace bustub
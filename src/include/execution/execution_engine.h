@@ -52,11 +52,11 @@ class ExecutionEngine {
     // Construct and executor for the plan
     auto executor = ExecutorFactory::CreateExecutor(exec_ctx, plan);
 
-    // Prepare the root executor
-    executor->Init();
-
-    // Execute the query plan
     try {
+      // Prepare the root executor, which takes the table locks
+      executor->Init();
+
+      // Execute the query plan
       Tuple tuple;
       RID rid;
       while (executor->Next(&tuple, &rid)) {
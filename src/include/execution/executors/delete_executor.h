@@ -60,5 +60,7 @@ class DeleteExecutor : public AbstractExecutor {
   const DeletePlanNode *plan_;
   /** The child executor from which RIDs for deleted tuples are pulled */
   std::unique_ptr<AbstractExecutor> child_executor_;
+  /** Whether the table is locked in intention exclusive mode, the deleted records are locked one by one */
+  bool table_locked_{false};
 };
 }  // namespace bustub
@@ -61,6 +61,8 @@ class InsertExecutor : public AbstractExecutor {
   const InsertPlanNode *plan_;
   uint32_t raw_val_idx_{0};
   std::unique_ptr<AbstractExecutor> child_;
+  /** Whether the table is locked in intention exclusive mode, the inserted records are locked one by one */
+  bool table_locked_{false};
 };
 
 }  // namespace bustub
@@ -47,9 +47,19 @@ class SeqScanExecutor : public AbstractExecutor {
   /** @return The output schema for the sequential scan */
   auto GetOutputSchema() -> const Schema * override { return plan_->OutputSchema(); }
 
+  /**
+   * Lock the records in INCREMENT mode instead of reading them under a shared lock, for an update that only adds to
+   * them. The predicate must not read the columns added to. Called before Init.
+   */
+  void LockForIncrement() { lock_for_increment_ = true; }
+
  private:
   /** The sequential scan plan node to be executed */
   const SeqScanPlanNode *plan_;
   TableIterator itr_;
+  /** Whether the table lock covers reading every record, so that the records are not locked one by one */
+  bool table_read_locked_{false};
+  /** Whether the records are locked for the increments of the update above */
+  bool lock_for_increment_{false};
 };
 }  // namespace bustub
@@ -13,12 +13,14 @@
 #pragma once
 
 #include <memory>
+#include <optional>
 #include <utility>
 #include <vector>
 
 #include "execution/executor_context.h"
 #include "execution/executors/abstract_executor.h"
 #include "execution/plans/update_plan.h"
+#include "recovery/log_record.h"
 #include "storage/table/tuple.h"
 #include "type/value_factory.h"
 
@@ -73,5 +75,9 @@ class UpdateExecutor : public AbstractExecutor {
   /** The child executor to obtain value from */
   std::unique_ptr<AbstractExecutor> child_executor_;
   std::vector<IndexInfo *> indexes_;
+  /** Whether the table is locked in intention exclusive mode, the updated records are locked one by one */
+  bool table_locked_{false};
+  /** The integers added to each record, if the update is applied as an increment under increment locks */
+  std::optional<TupleIncrement> increment_;
 };
 }  // namespace bustub
@@ -16,6 +16,7 @@
 #include <condition_variable>  // NOLINT
 #include <future>              // NOLINT
 #include <mutex>               // NOLINT
+#include <vector>
 
 #include "recovery/log_record.h"
 #include "storage/disk/disk_manager.h"
@@ -46,13 +47,26 @@ class LogManager {
 
   auto AppendLogRecord(LogRecord *log_record) -> lsn_t;
 
+  /**
+   * Force a flush and block until every log record appended so far is persistent.
+   */
+  void Flush();
+
+  /**
+   * Block until the commit record at commit_lsn is persistent. Concurrent committers share a single log write, see
+   * group_commit_max_wait and group_commit_max_batch in common/config.h.
+   * @param commit_lsn the LSN of the commit record
+   */
+  void GroupCommit(lsn_t commit_lsn);
+
   inline auto GetNextLSN() -> lsn_t { return next_lsn_; }
   inline auto GetPersistentLSN() -> lsn_t { return persistent_lsn_; }
   inline void SetPersistentLSN(lsn_t lsn) { persistent_lsn_ = lsn; }
   inline auto GetLogBuffer() -> char * { return log_buffer_; }
 
  private:
-  // TODO(students): you may add your own member variables
+  /** Swap the buffers and write the full one out, lk is released during the write. One write at a time. */
+  void FlushBuffer(std::unique_lock<std::mutex> *lk);
 
   /** The atomic counter which records the next log sequence number. */
   std::atomic<lsn_t> next_lsn_;
@@ -61,14 +75,30 @@ class LogManager {
 
   char *log_buffer_;
   char *flush_buffer_;
+  /** Bytes used in log_buffer_. */
+  int log_buffer_offset_{0};
 
   std::mutex latch_;
 
-  std::thread *flush_thread_ __attribute__((__unused__));
-
+  std::thread *flush_thread_{nullptr};
+  bool flush_requested_{false};
+  bool stop_flush_{false};
+  /** flush_buffer_ is being written out. */
+  bool flushing_{false};
+
+  /** A group commit leader is gathering commits or writing the log for them. */
+  bool commit_leader_{false};
+  /** Commit LSNs that are not persistent yet, the leader's included. */
+  std::vector<lsn_t> commit_queue_;
+  /** Wakes a group commit leader waiting for its batch to fill up. */
+  std::condition_variable commit_cv_;
+
+  /** Wakes the flush thread. */
+  std::condition_variable flush_cv_;
+  /** Wakes appenders waiting for buffer space and transactions waiting for durability. */
   std::condition_variable cv_;
 
-  DiskManager *disk_manager_ __attribute__((__unused__));
+  DiskManager *disk_manager_;
 };
 
 }  // namespace bustub
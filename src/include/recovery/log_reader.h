@@ -0,0 +1,137 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// log_reader.h
+//
+// Identification: src/include/recovery/log_reader.h
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#pragma once
+
+#include <condition_variable>  // NOLINT
+#include <memory>
+#include <mutex>   // NOLINT
+#include <thread>  // NOLINT
+
+#include "recovery/log_record.h"
+#include "storage/disk/disk_manager.h"
+
+namespace bustub {
+
+/**
+ * LogReader scans the log file from front to back and decodes one LogRecord at a time.
+ *
+ * The file is read in large sequential blocks by a read-ahead thread into two buffers, so the next block is already
+ * in memory while the records of the current one are decoded. Each buffer reserves LOG_BUFFER_SIZE bytes in front of
+ * its block: a record straddling two blocks is completed by copying only its head in front of the next block, which
+ * keeps every record contiguous without copying whole blocks around.
+ */
+class LogReader {
+ public:
+  /**
+   * Start reading ahead.
+   * @param disk_manager the disk manager owning the log file
+   * @param block_size the number of bytes each sequential read asks for
+   * @param offset the file offset of the first record to decode
+   */
+  explicit LogReader(DiskManager *disk_manager, int block_size = LOG_BUFFER_SIZE, int offset = 0);
+
+  ~LogReader();
+
+  LogReader(const LogReader &) = delete;
+  auto operator=(const LogReader &) -> LogReader & = delete;
+
+  /**
+   * Decode the next record of the log.
+   * @param[out] log_record the decoded record
+   * @return false at the end of the log, which includes a torn last record
+   */
+  auto Next(LogRecord *log_record) -> bool;
+
+  /** @return the file offset of the record Next returned last */
+  inline auto GetOffset() const -> int { return record_offset_; }
+
+  /**
+   * Decode a log record from a contiguous image.
+   * @return false if the image does not hold a valid record, e.g. the zeroed tail of the log
+   */
+  static auto Deserialize(const char *data, LogRecord *log_record) -> bool;
+
+  /** Input iterator over the records of a LogReader. */
+  class Iterator {
+   public:
+    explicit Iterator(LogReader *reader) : reader_(reader) {
+      if (reader_ != nullptr) {
+        ++(*this);
+      }
+    }
+
+    inline auto operator*() -> LogRecord & { return log_record_; }
+
+    inline auto operator->() -> LogRecord * { return &log_record_; }
+
+    inline auto operator++() -> Iterator & {
+      if (!reader_->Next(&log_record_)) {
+        reader_ = nullptr;
+      }
+      return *this;
+    }
+
+    inline auto operator==(const Iterator &other) const -> bool { return reader_ == other.reader_; }
+
+    inline auto operator!=(const Iterator &other) const -> bool { return reader_ != other.reader_; }
+
+   private:
+    LogReader *reader_;
+    LogRecord log_record_;
+  };
+
+  inline auto Begin() -> Iterator { return Iterator(this); }
+
+  inline auto End() -> Iterator { return Iterator(nullptr); }
+
+ private:
+  /** One read-ahead buffer: a reserved area for the head of a straddling record, then the block. */
+  struct Buffer {
+    std::unique_ptr<char[]> data_;
+    /** File offset of the first byte of the block. */
+    int offset_{0};
+    /** Bytes of the block that were read, 0 at the end of the log. */
+    int length_{0};
+    /** Filled by the read-ahead thread and not yet handed back by the decoder. */
+    bool ready_{false};
+  };
+
+  void RunReadAhead(int offset);
+
+  /** Wait for buffers_[index] to be filled. */
+  void WaitReady(int index);
+
+  /** Hand buffers_[index] back to the read-ahead thread. */
+  void Release(int index);
+
+  inline auto BlockOf(int index) -> char * { return buffers_[index].data_.get() + LOG_BUFFER_SIZE; }
+
+  DiskManager *disk_manager_;
+  int block_size_;
+  Buffer buffers_[2];
+
+  std::mutex latch_;
+  std::condition_variable cv_;
+  bool stop_{false};
+  std::thread read_ahead_thread_;
+
+  /** Index of the buffer being decoded, -1 before the first one arrives. */
+  int current_{-1};
+  /** Decoding position in the current buffer, may point into the reserved area. */
+  char *pos_{nullptr};
+  char *end_{nullptr};
+  bool end_of_log_{false};
+  int record_offset_{0};
+};
+
+}  // namespace bustub
@@ -14,6 +14,8 @@
 
 #include <cassert>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "common/config.h"
 #include "storage/table/tuple.h"
@@ -32,10 +34,202 @@ enum class LogRecordType {
   ABORT,
   /** Creating a new page in the table heap. */
   NEWPAGE,
+  /** In-place update that only carries the changed byte ranges of the tuple. */
+  DELTAUPDATE,
+  /** Key/value pair written into a slot of a hash bucket page. */
+  HASHBUCKETINSERT,
+  /** Key/value pair in a slot of a hash bucket page turned into a tombstone. */
+  HASHBUCKETREMOVE,
+  /** Pairs moved from a hash bucket page into its split image, redo only. */
+  HASHBUCKETSPLIT,
+  /** Changed slots and global depth of a hash directory page, redo only. */
+  HASHDIRECTORY,
+  /** In-place increment of integer columns of a tuple, undone by subtracting it. */
+  INCREMENT,
 };
 
 /**
- * For every write operation on the table page, you should write ahead a corresponding log record.
+ * TupleDelta is the compact image of an update that keeps the tuple size unchanged. Only the byte ranges that differ
+ * between the old and the new tuple are stored, each with its before-image (for undo) and after-image (for redo).
+ *
+ * Serialized format (size in bytes):
+ *---------------------------------------------------------------------------------------------
+ * | tuple_size (4) | range_count (4) | offset (4) | length (4) | old_bytes | new_bytes | ... |
+ *---------------------------------------------------------------------------------------------
+ */
+class TupleDelta {
+ public:
+  TupleDelta() = default;
+
+  /**
+   * Diff two tuples of the same size.
+   * @param old_tuple the before-image
+   * @param new_tuple the after-image
+   */
+  TupleDelta(const Tuple &old_tuple, const Tuple &new_tuple);
+
+  /** @return the size of the tuple this delta applies to */
+  inline auto GetTupleSize() const -> uint32_t { return tuple_size_; }
+
+  /** @return the number of changed byte ranges */
+  inline auto GetRangeCount() const -> uint32_t { return range_count_; }
+
+  /** @return the number of bytes SerializeTo writes */
+  inline auto GetSerializedSize() const -> uint32_t { return 2 * sizeof(uint32_t) + ranges_.size(); }
+
+  void SerializeTo(char *storage) const;
+
+  void DeserializeFrom(const char *storage);
+
+  /**
+   * Overwrite the changed byte ranges of a tuple image.
+   * @param tuple_data the tuple image to patch, must be GetTupleSize() bytes long
+   * @param undo true to install the before-image, false to install the after-image
+   */
+  void ApplyTo(char *tuple_data, bool undo) const;
+
+ private:
+  uint32_t tuple_size_{0};
+  uint32_t range_count_{0};
+  /** Ranges laid out exactly as they are serialized. */
+  std::vector<char> ranges_;
+};
+
+/**
+ * TupleIncrement is a commutative change of a tuple: integers added to INTEGER columns, each at the offset of its
+ * column in the tuple image. Increments of concurrent transactions interleave on the same tuple, so one is undone by
+ * subtracting it again, never by restoring a before-image.
+ *
+ * Serialized format (size in bytes):
+ *-------------------------------------------------
+ * | count (4) | offset (4) | delta (4) | ... |
+ *-------------------------------------------------
+ */
+class TupleIncrement {
+ public:
+  TupleIncrement() = default;
+
+  /** Add delta to the INTEGER value at offset of the tuple image. */
+  inline void Add(uint32_t offset, int32_t delta) { deltas_.emplace_back(offset, delta); }
+
+  /** @return the number of incremented values */
+  inline auto GetCount() const -> uint32_t { return deltas_.size(); }
+
+  /** @return the number of bytes SerializeTo writes */
+  inline auto GetSerializedSize() const -> uint32_t {
+    return sizeof(uint32_t) + deltas_.size() * (sizeof(uint32_t) + sizeof(int32_t));
+  }
+
+  void SerializeTo(char *storage) const;
+
+  void DeserializeFrom(const char *storage);
+
+  /** @return the increment that takes this one back */
+  auto Inverse() const -> TupleIncrement;
+
+  /** @return false if adding the deltas would take a value of the tuple image out of the INTEGER range */
+  auto Fits(const char *tuple_data) const -> bool;
+
+  /**
+   * Add the deltas to a tuple image, or subtract them. NULL values stay NULL. Out of range results wrap around: an
+   * undo has to go through, and lands back in range once the other increments are undone or committed as well.
+   * @param tuple_data the tuple image to patch
+   * @param undo true to subtract the deltas
+   */
+  void ApplyTo(char *tuple_data, bool undo) const;
+
+ private:
+  std::vector<std::pair<uint32_t, int32_t>> deltas_;
+};
+
+/**
+ * HashBucketLayout describes where the bitmaps and the pair array of a hash bucket page live. It is logged along
+ * with every slot image, so recovery can work on bucket pages without knowing the key and value types of the index.
+ */
+struct HashBucketLayout {
+  uint32_t array_size_{0};
+  uint32_t occupied_offset_{0};
+  uint32_t readable_offset_{0};
+  uint32_t tags_offset_{0};
+  uint32_t array_offset_{0};
+  uint32_t pair_size_{0};
+  uint32_t key_size_{0};
+};
+
+/**
+ * HashSlotImage is one key/value pair of a hash bucket page together with the slot it was logged at and the tag the
+ * bucket keeps for its key. The pair bytes start with the raw key, which is all recovery needs to find the bucket a
+ * key hashes to.
+ *
+ * Serialized format (size in bytes):
+ *-------------------------------------------------------------
+ * | HashBucketLayout (28) | slot (4) | tag (1) | pair_bytes |
+ *-------------------------------------------------------------
+ */
+class HashSlotImage {
+ public:
+  HashSlotImage() = default;
+
+  /**
+   * @param layout the layout of the bucket page
+   * @param slot the slot of the pair in the bucket page
+   * @param pair the pair bytes, layout.pair_size_ long
+   * @param tag the tag of the key
+   */
+  HashSlotImage(const HashBucketLayout &layout, uint32_t slot, const char *pair, uint8_t tag)
+      : layout_(layout), slot_(slot), tag_(tag), pair_(pair, pair + layout.pair_size_) {}
+
+  inline auto GetLayout() const -> const HashBucketLayout & { return layout_; }
+
+  inline auto GetSlot() const -> uint32_t { return slot_; }
+
+  /** @return the raw key, layout.key_size_ bytes long */
+  inline auto GetKeyData() const -> const char * { return pair_.data(); }
+
+  /** @return the number of bytes SerializeTo writes */
+  inline auto GetSerializedSize() const -> uint32_t {
+    return sizeof(HashBucketLayout) + sizeof(uint32_t) + sizeof(uint8_t) + layout_.pair_size_;
+  }
+
+  void SerializeTo(char *storage) const;
+
+  void DeserializeFrom(const char *storage);
+
+  /** Write the pair and its tag into a slot of a bucket page image and mark the slot occupied and readable. */
+  void InstallAt(char *bucket_data, uint32_t slot) const;
+
+  /** Turn a slot of a bucket page image into a tombstone. */
+  void EraseAt(char *bucket_data, uint32_t slot) const;
+
+  /** @return the readable slot of a bucket page image holding exactly this pair, or the array size if none does */
+  auto FindIn(const char *bucket_data) const -> uint32_t;
+
+  /** @return a tombstone or never used slot of a bucket page image, or the array size if the bucket is full */
+  auto FreeSlotIn(const char *bucket_data) const -> uint32_t;
+
+  /** @return whether a slot of a bucket page image holds a readable pair */
+  auto IsReadableIn(const char *bucket_data, uint32_t slot) const -> bool;
+
+ private:
+  HashBucketLayout layout_;
+  uint32_t slot_{0};
+  uint8_t tag_{0};
+  std::vector<char> pair_;
+};
+
+/**
+ * One slot of a hash directory page as logged by a HASHDIRECTORY record. A bucket_idx_ of DIRECTORY_ARRAY_SIZE + s
+ * records the page of directory segment s instead, see HashTableDirectoryPage::SetSegmentPageId.
+ */
+struct HashDirectoryEntry {
+  uint32_t bucket_idx_;
+  page_id_t bucket_page_id_;
+  uint32_t local_depth_;
+};
+
+/**
+ * For every write operation on the table page or the hash index pages, you should write ahead a corresponding log
+ * record.
  *
  * For EACH log record, HEADER is like (5 fields in common, 20 bytes in total).
  *---------------------------------------------
@@ -54,12 +248,33 @@ enum class LogRecordType {
  * | HEADER | tuple_rid | tuple_size | old_tuple_data | tuple_size | new_tuple_data |
  *-----------------------------------------------------------------------------------
  * For new page type log record
- *--------------------------
- * | HEADER | prev_page_id |
- *--------------------------
+ *------------------------------------
+ * | HEADER | prev_page_id | page_id |
+ *------------------------------------
+ * For delta update type log record, see TupleDelta for the delta format
+ *-----------------------------------
+ * | HEADER | tuple_rid | tuple_delta |
+ *-----------------------------------
+ * For increment type log record, see TupleIncrement for the increment format
+ *---------------------------------------
+ * | HEADER | tuple_rid | tuple_increment |
+ *---------------------------------------
+ * For hash bucket insert and remove type log record, see HashSlotImage for the slot image format
+ *---------------------------------------------------------------
+ * | HEADER | directory_page_id | bucket_page_id | slot_image |
+ *---------------------------------------------------------------
+ * For hash bucket split type log record, the slot images describe the pairs in their new slots
+ *--------------------------------------------------------------------------------------------
+ * | HEADER | bucket_page_id | image_page_id | count | old_slot | slot_image | ... |
+ *--------------------------------------------------------------------------------------------
+ * For hash directory type log record
+ *---------------------------------------------------------------------------------------------------------
+ * | HEADER | directory_page_id | global_depth | count | bucket_idx | bucket_page_id | local_depth | ... |
+ *---------------------------------------------------------------------------------------------------------
  */
 class LogRecord {
   friend class LogManager;
+  friend class LogReader;
   friend class LogRecovery;
 
  public:
@@ -110,6 +325,71 @@ class LogRecord {
     size_ = HEADER_SIZE + sizeof(page_id_t) * 2;
   }
 
+  // constructor for DELTAUPDATE type
+  LogRecord(txn_id_t txn_id, lsn_t prev_lsn, LogRecordType log_record_type, const RID &update_rid, TupleDelta delta)
+      : txn_id_(txn_id),
+        prev_lsn_(prev_lsn),
+        log_record_type_(log_record_type),
+        update_rid_(update_rid),
+        delta_(std::move(delta)) {
+    // calculate log record size
+    size_ = HEADER_SIZE + sizeof(RID) + delta_.GetSerializedSize();
+  }
+
+  // constructor for INCREMENT type
+  LogRecord(txn_id_t txn_id, lsn_t prev_lsn, LogRecordType log_record_type, const RID &update_rid,
+            TupleIncrement increment)
+      : txn_id_(txn_id),
+        prev_lsn_(prev_lsn),
+        log_record_type_(log_record_type),
+        update_rid_(update_rid),
+        increment_(std::move(increment)) {
+    // calculate log record size
+    size_ = HEADER_SIZE + sizeof(RID) + increment_.GetSerializedSize();
+  }
+
+  // constructor for HASHBUCKETINSERT/HASHBUCKETREMOVE type
+  LogRecord(txn_id_t txn_id, lsn_t prev_lsn, LogRecordType log_record_type, page_id_t directory_page_id,
+            page_id_t bucket_page_id, HashSlotImage slot_image)
+      : txn_id_(txn_id),
+        prev_lsn_(prev_lsn),
+        log_record_type_(log_record_type),
+        directory_page_id_(directory_page_id),
+        bucket_page_id_(bucket_page_id),
+        slot_image_(std::move(slot_image)) {
+    // calculate log record size
+    size_ = HEADER_SIZE + 2 * sizeof(page_id_t) + slot_image_.GetSerializedSize();
+  }
+
+  // constructor for HASHBUCKETSPLIT type
+  LogRecord(txn_id_t txn_id, lsn_t prev_lsn, LogRecordType log_record_type, page_id_t bucket_page_id,
+            page_id_t image_page_id, std::vector<std::pair<uint32_t, HashSlotImage>> moves)
+      : txn_id_(txn_id),
+        prev_lsn_(prev_lsn),
+        log_record_type_(log_record_type),
+        bucket_page_id_(bucket_page_id),
+        image_page_id_(image_page_id),
+        moves_(std::move(moves)) {
+    // calculate log record size
+    size_ = HEADER_SIZE + 2 * sizeof(page_id_t) + sizeof(uint32_t);
+    for (const auto &move : moves_) {
+      size_ += sizeof(uint32_t) + move.second.GetSerializedSize();
+    }
+  }
+
+  // constructor for HASHDIRECTORY type
+  LogRecord(txn_id_t txn_id, lsn_t prev_lsn, LogRecordType log_record_type, page_id_t directory_page_id,
+            uint32_t global_depth, std::vector<HashDirectoryEntry> entries)
+      : txn_id_(txn_id),
+        prev_lsn_(prev_lsn),
+        log_record_type_(log_record_type),
+        directory_page_id_(directory_page_id),
+        global_depth_(global_depth),
+        entries_(std::move(entries)) {
+    // calculate log record size
+    size_ = HEADER_SIZE + sizeof(page_id_t) + 2 * sizeof(uint32_t) + entries_.size() * sizeof(HashDirectoryEntry);
+  }
+
   ~LogRecord() = default;
 
   inline auto GetDeleteTuple() -> Tuple & { return delete_tuple_; }
@@ -126,8 +406,18 @@ class LogRecord {
 
   inline auto GetUpdateRID() -> RID & { return update_rid_; }
 
+  inline auto GetTupleDelta() -> TupleDelta & { return delta_; }
+
+  inline auto GetTupleIncrement() -> TupleIncrement & { return increment_; }
+
   inline auto GetNewPageRecord() -> page_id_t { return prev_page_id_; }
 
+  inline auto GetNewPageId() -> page_id_t { return page_id_; }
+
+  inline auto GetBucketPageId() -> page_id_t { return bucket_page_id_; }
+
+  inline auto GetSlotImage() -> HashSlotImage & { return slot_image_; }
+
   inline auto GetSize() -> int32_t { return size_; }
 
   inline auto GetLSN() -> lsn_t { return lsn_; }
@@ -172,10 +462,24 @@ class LogRecord {
   RID update_rid_;
   Tuple old_tuple_;
   Tuple new_tuple_;
+  // only the changed bytes, for delta update operation
+  TupleDelta delta_;
+  // only the added integers, for increment operation
+  TupleIncrement increment_;
 
   // case4: for new page operation
   page_id_t prev_page_id_{INVALID_PAGE_ID};
   page_id_t page_id_{INVALID_PAGE_ID};
+
+  // case5: for hash index operations
+  page_id_t directory_page_id_{INVALID_PAGE_ID};
+  page_id_t bucket_page_id_{INVALID_PAGE_ID};
+  HashSlotImage slot_image_;
+  // split image of bucket_page_id_, and the pairs moved into it along with their old slots
+  page_id_t image_page_id_{INVALID_PAGE_ID};
+  std::vector<std::pair<uint32_t, HashSlotImage>> moves_;
+  uint32_t global_depth_{0};
+  std::vector<HashDirectoryEntry> entries_;
   static const int HEADER_SIZE = 20;
 };  // namespace bustub
 
@@ -28,7 +28,7 @@ namespace bustub {
 class LogRecovery {
  public:
   LogRecovery(DiskManager *disk_manager, BufferPoolManager *buffer_pool_manager)
-      : disk_manager_(disk_manager), buffer_pool_manager_(buffer_pool_manager), offset_(0) {
+      : disk_manager_(disk_manager), buffer_pool_manager_(buffer_pool_manager) {
     log_buffer_ = new char[LOG_BUFFER_SIZE];
   }
 
@@ -42,15 +42,26 @@ class LogRecovery {
   auto DeserializeLogRecord(const char *data, LogRecord *log_record) -> bool;
 
  private:
-  DiskManager *disk_manager_ __attribute__((__unused__));
-  BufferPoolManager *buffer_pool_manager_ __attribute__((__unused__));
+  /** Reapply the change of a log record to its table page if the page has not seen it yet. */
+  void RedoLogRecord(LogRecord *log_record);
+  /** Revert the change of a log record on its table page. */
+  void UndoLogRecord(LogRecord *log_record);
+  /** Reapply the change of a hash index log record to every page it touches that has not seen it yet. */
+  void RedoHashIndexLogRecord(LogRecord *log_record);
+  /** Revert a hash bucket insert or remove in the bucket the key hashes to now, which a split may have changed. */
+  void UndoHashIndexLogRecord(LogRecord *log_record);
+  /** @return the bucket page the key of a slot image hashes to in the recovered directory */
+  auto LocateHashBucket(page_id_t directory_page_id, const HashSlotImage &slot_image) -> page_id_t;
+
+  DiskManager *disk_manager_;
+  BufferPoolManager *buffer_pool_manager_;
 
   /** Maintain active transactions and its corresponding latest lsn. */
   std::unordered_map<txn_id_t, lsn_t> active_txn_;
   /** Mapping the log sequence number to log file offset for undos. */
   std::unordered_map<lsn_t, int> lsn_mapping_;
 
-  int offset_ __attribute__((__unused__));  // NOLINT
+  /** Buffer for the records undo reads back one at a time. */
   char *log_buffer_;
 };
 
@@ -71,6 +71,15 @@ class DiskManager {
    */
   auto ReadLog(char *log_data, int size, int offset) -> bool;
 
+  /**
+   * Read a block of the log file for a sequential scan. Unlike ReadLog, the file size is not looked up first.
+   * @param[out] log_data output buffer
+   * @param size the number of bytes to read
+   * @param offset offset of the block in the file
+   * @return the number of bytes read, 0 at the end of the log
+   */
+  auto ReadLogBlock(char *log_data, int size, int offset) -> int;
+
   /** @return the number of disk flushes */
   auto GetNumFlushes() const -> int;
 
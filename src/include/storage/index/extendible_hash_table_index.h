@@ -15,6 +15,7 @@
 #include <map>
 #include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "container/hash/extendible_hash_table.h"
@@ -29,7 +30,7 @@ template <typename KeyType, typename ValueType, typename KeyComparator>
 class ExtendibleHashTableIndex : public Index {
  public:
   ExtendibleHashTableIndex(std::unique_ptr<IndexMetadata> &&metadata, BufferPoolManager *buffer_pool_manager,
-                           const HashFunction<KeyType> &hash_fn);
+                           const HashFunction<KeyType> &hash_fn, LogManager *log_manager = nullptr);
 
   ~ExtendibleHashTableIndex() override = default;
 
@@ -39,6 +40,11 @@ class ExtendibleHashTableIndex : public Index {
 
   void ScanKey(const Tuple &key, std::vector<RID> *result, Transaction *transaction) override;
 
+  /**
+   * Insert the entries of a whole table at once, see ExtendibleHashTable::BulkLoad.
+   */
+  void BulkInsertEntries(const std::vector<std::pair<Tuple, RID>> &entries, Transaction *transaction);
+
  protected:
   // comparator for key
   KeyComparator comparator_;
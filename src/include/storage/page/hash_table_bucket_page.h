@@ -16,6 +16,7 @@
 #include <vector>
 
 #include "common/config.h"
+#include "recovery/log_record.h"
 #include "storage/index/int_comparator.h"
 #include "storage/page/hash_table_page_defs.h"
 
@@ -28,14 +29,17 @@ namespace bustub {
  * non-unique keys.
  *
  * Bucket page format (keys are stored in order):
- *  ----------------------------------------------------------------
- * | KEY(1) + VALUE(1) | KEY(2) + VALUE(2) | ... | KEY(n) + VALUE(n)
- *  ----------------------------------------------------------------
+ *  ----------------------------------------------------------------------------------------
+ * | PageId(4) | LSN(4) | KEY(1) + VALUE(1) | KEY(2) + VALUE(2) | ... | KEY(n) + VALUE(n)
+ *  ----------------------------------------------------------------------------------------
  *
  *  Here '+' means concatenation.
- *  The above format omits the space required for the occupied_ and
- *  readable_ arrays. More information is in storage/page/hash_table_page_defs.h.
+ *  The above format omits the space required for the occupied_, readable_
+ *  and tags_ arrays. More information is in storage/page/hash_table_page_defs.h.
  *
+ *  Every slot also keeps a one byte tag of its key's hash. The lookups compare
+ *  the tags many slots at a time and only call the comparator on the slots whose
+ *  tag matches, which is about one in 256 of the slots that hold other keys.
  */
 template <typename KeyType, typename ValueType, typename KeyComparator>
 class HashTableBucketPage {
@@ -46,8 +50,14 @@ class HashTableBucketPage {
   /**
    * Scan the bucket and collect values that have the matching key
    *
+   * @param tag the tag of the key, see TagOf
    * @return true if at least one key matched
    */
+  auto GetValue(KeyType key, uint8_t tag, KeyComparator cmp, std::vector<ValueType> *result) -> bool;
+
+  /**
+   * Like GetValue, for a key tagged by the default hash function of its type.
+   */
   auto GetValue(KeyType key, KeyComparator cmp, std::vector<ValueType> *result) -> bool;
 
   /**
@@ -60,15 +70,44 @@ class HashTableBucketPage {
    */
   auto Insert(KeyType key, ValueType value, KeyComparator cmp) -> bool;
 
+  /**
+   * Like Insert, but tells a duplicate apart from a full bucket.
+   *
+   * @param tag the tag of the key, see TagOf
+   * @param slot if not null, set to the slot the pair was written to on success
+   * @return CODE_OK, CODE_FULL or CODE_DUP
+   */
+  auto Insert2(KeyType key, ValueType value, uint8_t tag, KeyComparator cmp, uint32_t *slot = nullptr) -> uint8_t;
+
+  /**
+   * Like Insert2, for a key tagged by the default hash function of its type.
+   */
   auto Insert2(KeyType key, ValueType value, KeyComparator cmp) -> uint8_t;
 
   /**
    * Removes a key and value.
    *
+   * @param tag the tag of the key, see TagOf
+   * @param slot if not null, set to the slot the pair was removed from on success
    * @return true if removed, false if not found
    */
+  auto Remove(KeyType key, ValueType value, uint8_t tag, KeyComparator cmp, uint32_t *slot = nullptr) -> bool;
+
+  /**
+   * Like Remove, for a key tagged by the default hash function of its type.
+   */
   auto Remove(KeyType key, ValueType value, KeyComparator cmp) -> bool;
 
+  /**
+   * The tag of a key is the top byte of its 64 bit hash, which the directory never indexes by. A table tags its keys
+   * by its own hash function; the methods without a tag use the default one, so a page is used through one kind or
+   * the other.
+   *
+   * @param hash the hash of the key
+   * @return the tag of the key
+   */
+  static auto TagOf(uint64_t hash) -> uint8_t { return static_cast<uint8_t>(hash >> 56); }
+
   /**
    * Gets the key at an index in the bucket.
    *
@@ -142,11 +181,48 @@ class HashTableBucketPage {
    */
   void PrintBucket();
 
+  /**
+   * @return the LSN of the last change logged against this bucket
+   */
+  auto GetLSN() const -> lsn_t;
+
+  /**
+   * Sets the LSN of this bucket
+   *
+   * @param lsn LSN to set
+   */
+  void SetLSN(lsn_t lsn);
+
+  /**
+   * @return the byte layout of this bucket page, as logged in slot images
+   */
+  auto GetLayout() const -> HashBucketLayout;
+
+  /**
+   * @param bucket_idx the index in the bucket
+   * @return the pair at bucket_idx as a slot image for the log
+   */
+  auto SlotImageAt(uint32_t bucket_idx) const -> HashSlotImage;
+
  private:
+  /** @return the number of occupied slots, which always come first */
+  auto OccupiedEnd() const -> uint32_t;
+
+  /**
+   * Call f on the slots below end whose tag is the given one, in order, until it returns false.
+   */
+  template <typename F>
+  void ForEachTagMatch(uint8_t tag, uint32_t end, F &&f) const;
+
+  // Page header, the LSN sits at the same offset as on every other page
+  page_id_t page_id_;
+  lsn_t lsn_;
   //  For more on BUCKET_ARRAY_SIZE see storage/page/hash_table_page_defs.h
   uint8_t occupied_[(BUCKET_ARRAY_SIZE - 1) / 8 + 1];
   // 0 if tombstone/brand new (never occupied), 1 otherwise.
   uint8_t readable_[(BUCKET_ARRAY_SIZE - 1) / 8 + 1];
+  // The tag of the key in each occupied slot, see TagOf.
+  uint8_t tags_[BUCKET_ARRAY_SIZE];
   // Flexible array member for page data.
   MappingType array_[BUCKET_ARRAY_SIZE];
 };
@@ -27,9 +27,15 @@ namespace bustub {
  * Directory Page for extendible hash table.
  *
  * Directory format (size in byte):
- * --------------------------------------------------------------------------------------------
- * | LSN (4) | PageId(4) | GlobalDepth(4) | LocalDepths(512) | BucketPageIds(2048) | Free(1524)
- * --------------------------------------------------------------------------------------------
+ * ------------------------------------------------------------------------------------------------------------------
+ * | LSN (4) | PageId(4) | GlobalDepth(4) | LocalDepths(512) | BucketPageIds(2048) | SegmentCount(4) | SegmentPageIds
+ * ------------------------------------------------------------------------------------------------------------------
+ * | (1024) | Free(496)
+ * ------------------------------------------------------------------------------------------------------------------
+ *
+ * A directory of more than DIRECTORY_ARRAY_SIZE entries spans several pages, see DIRECTORY_SEGMENT_COUNT. The first
+ * page keeps the global depth and the page ids of the other segments; each segment page has the same format, of which
+ * it only uses the slots. The methods of this class only ever touch the slots of their own page.
  */
 class HashTableDirectoryPage {
  public:
@@ -123,6 +129,13 @@ class HashTableDirectoryPage {
    */
   void DecrGlobalDepth();
 
+  /**
+   * Set the global depth of the directory without touching any slot, used by recovery
+   *
+   * @param global_depth the global depth to set
+   */
+  void SetGlobalDepth(uint32_t global_depth);
+
   /**
    * @return true if the directory can be shrunk
    */
@@ -171,6 +184,25 @@ class HashTableDirectoryPage {
    */
   auto GetLocalHighBit(uint32_t bucket_idx) -> uint32_t;
 
+  /**
+   * @param segment the segment of the directory, at least 1
+   * @return the page id of the segment
+   */
+  auto GetSegmentPageId(uint32_t segment) -> page_id_t;
+
+  /**
+   * Record the page of a segment, counting it as allocated.
+   *
+   * @param segment the segment of the directory, at least 1
+   * @param segment_page_id the page holding its slots
+   */
+  void SetSegmentPageId(uint32_t segment, page_id_t segment_page_id);
+
+  /**
+   * @return the number of segments allocated so far, including this page; a directory that shrank keeps its segments
+   */
+  auto GetSegmentCount() -> uint32_t;
+
   /**
    * VerifyIntegrity
    *
@@ -192,6 +224,9 @@ class HashTableDirectoryPage {
   uint32_t global_depth_{0};
   uint8_t local_depths_[DIRECTORY_ARRAY_SIZE];
   page_id_t bucket_page_ids_[DIRECTORY_ARRAY_SIZE];
+  // the segments past this page, 0 for a directory of one page
+  uint32_t segment_count_{0};
+  page_id_t segment_page_ids_[DIRECTORY_SEGMENT_COUNT];
 };
 
 }  // namespace bustub
@@ -34,11 +34,18 @@
 #define HASH_TABLE_BUCKET_TYPE HashTableBucketPage<KeyType, ValueType, KeyComparator>
 #define DIRECTORY_ARRAY_SIZE 512
 
+/**
+ * DIRECTORY_SEGMENT_COUNT is the number of pages a directory may span: past DIRECTORY_ARRAY_SIZE entries, entry i is
+ * kept in segment page i / DIRECTORY_ARRAY_SIZE, the first segment being the directory page itself.
+ */
+#define DIRECTORY_SEGMENT_COUNT 256
+
 /**
  * BUCKET_ARRAY_SIZE is the number of (key, value) pairs that can be stored in an extendible hashing bucket page.
  * It is an approximate calculation based on the size of MappingType (which is a std::pair of KeyType and ValueType).
- * For each key/value pair, we need two additional bits for occupied_ and readable_. 4 * (PAGE_SIZE - 4) / (4 * sizeof
- * (MappingType) + 1) = (PAGE_SIZE - 4)/(sizeof (MappingType) + 0.25) because 0.25 bytes = 2 bits is the space required
- * to maintain the occupied and readable flags for a key value pair.
+ * For each key/value pair, we need two additional bits for occupied_ and readable_ and a byte for its tag.
+ * 4 * (PAGE_SIZE - 8) / (4 * sizeof (MappingType) + 5) = (PAGE_SIZE - 8)/(sizeof (MappingType) + 1.25) because 0.25
+ * bytes = 2 bits is the space required to maintain the occupied and readable flags for a key value pair, 1 byte its
+ * tag, and 8 bytes are taken by the page id and the LSN.
  */
-#define BUCKET_ARRAY_SIZE (4 * PAGE_SIZE / (4 * sizeof(MappingType) + 1))
+#define BUCKET_ARRAY_SIZE (4 * (PAGE_SIZE - 8) / (4 * sizeof(MappingType) + 5))
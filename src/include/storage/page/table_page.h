@@ -107,6 +107,35 @@ class TablePage : public Page {
   auto UpdateTuple(const Tuple &new_tuple, Tuple *old_tuple, const RID &rid, Transaction *txn,
                    LockManager *lock_manager, LogManager *log_manager) -> bool;
 
+  /**
+   * Patch a tuple in place with the byte ranges of a DELTAUPDATE log record, used by recovery.
+   * @param rid rid of the tuple
+   * @param delta the changed byte ranges of the tuple
+   * @param undo true to restore the old bytes, false to install the new bytes
+   */
+  void ApplyTupleDelta(const RID &rid, const TupleDelta &delta, bool undo);
+
+  /**
+   * Add integers to columns of a tuple in place, under an increment lock, or take such an increment back.
+   * @param rid rid of the tuple
+   * @param increment the integers to add
+   * @param undo true to subtract the integers again, on abort
+   * @param txn transaction performing the increment
+   * @param lock_manager the lock manager
+   * @param log_manager the log manager
+   * @return true if incrementing the tuple succeeded, false if it is gone or a value would overflow
+   */
+  auto IncrementTuple(const RID &rid, const TupleIncrement &increment, bool undo, Transaction *txn,
+                      LockManager *lock_manager, LogManager *log_manager) -> bool;
+
+  /**
+   * Add the integers of an INCREMENT log record to a tuple in place, or subtract them, used by recovery.
+   * @param rid rid of the tuple
+   * @param increment the integers added to the tuple
+   * @param undo true to subtract the integers
+   */
+  void ApplyTupleIncrement(const RID &rid, const TupleIncrement &increment, bool undo);
+
   /** To be called on commit or abort. Actually perform the delete or rollback an insert. */
   void ApplyDelete(const RID &rid, Transaction *txn, LogManager *log_manager);
 
@@ -123,6 +152,18 @@ class TablePage : public Page {
    */
   auto GetTuple(const RID &rid, Tuple *tuple, Transaction *txn, LockManager *lock_manager) -> bool;
 
+  /**
+   * Copy the current image of a tuple, without locking it. Used by snapshot reads, which find the version they may
+   * see from the current one, so a missing tuple is no reason to abort.
+   * @param rid rid of the tuple to read
+   * @param[out] tuple the tuple that was read
+   * @return false if the slot holds no tuple or a deleted one
+   */
+  auto CopyTuple(const RID &rid, Tuple *tuple) -> bool;
+
+  /** @return the number of slots in this page, including those of deleted tuples */
+  auto GetSlotCount() -> uint32_t { return GetTupleCount(); }
+
   /** @return the rid of the first tuple in this page */
 
   /**
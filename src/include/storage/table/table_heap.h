@@ -12,6 +12,13 @@
 
 #pragma once
 
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <optional>
+#include <unordered_map>
+
 #include "buffer/buffer_pool_manager.h"
 #include "recovery/log_manager.h"
 #include "storage/page/table_page.h"
@@ -23,6 +30,11 @@ namespace bustub {
 /**
  * TableHeap represents a physical table on disk.
  * This is just a doubly-linked list of pages.
+ *
+ * The pages hold the latest image of every tuple. For snapshot isolation, every change also leaves an in-memory undo
+ * record in the version chain of its tuple, stamped through the commit timestamp of its transaction. A snapshot read
+ * starts from the page image and undoes the changes its snapshot must not see. Chains are pruned when a transaction
+ * writing them commits, down to what the oldest running snapshot still needs.
  */
 class TableHeap {
   friend class TableIterator;
@@ -76,6 +88,24 @@ class TableHeap {
    */
   auto UpdateTuple(const Tuple &tuple, const RID &rid, Transaction *txn) -> bool;
 
+  /**
+   * Add integers to columns of a tuple in place. Under increment locks, the increments of several transactions may be
+   * applied to the tuple at once.
+   * @param increment the integers to add
+   * @param rid rid of the tuple
+   * @param txn transaction performing the increment
+   * @return true if the increment is successful, false if the tuple is gone or a value would overflow
+   */
+  auto IncrementTuple(const TupleIncrement &increment, const RID &rid, Transaction *txn) -> bool;
+
+  /**
+   * Called on abort to take back an increment, along with its undo record.
+   * @param increment the integers added
+   * @param rid rid of the tuple
+   * @param txn transaction performing the rollback
+   */
+  void RollbackIncrement(const TupleIncrement &increment, const RID &rid, Transaction *txn);
+
   /**
    * Called on Commit/Abort to actually delete a tuple or rollback an insert.
    * @param rid rid of the tuple to delete
@@ -99,6 +129,24 @@ class TableHeap {
    */
   auto GetTuple(const RID &rid, Tuple *tuple, Transaction *txn) -> bool;
 
+  /**
+   * Called on abort once a change to the tuple is rolled back, to drop the undo record of the change, i.e. the latest
+   * one of the transaction.
+   * @param rid rid of the tuple
+   * @param txn transaction performing the rollback
+   */
+  void RollbackVersion(const RID &rid, Transaction *txn);
+
+  /**
+   * Drop the undo records of the tuple that no snapshot needs any more.
+   * @param rid rid of the tuple
+   * @param watermark the read timestamp of the oldest running snapshot
+   */
+  void PruneVersions(const RID &rid, timestamp_t watermark);
+
+  /** @return true if the tuple was changed by another transaction that the snapshot of txn does not see */
+  auto IsChangedSince(const RID &rid, Transaction *txn) -> bool;
+
   /** @return the begin iterator of this table */
   auto Begin(Transaction *txn) -> TableIterator;
 
@@ -113,6 +161,40 @@ class TableHeap {
   LockManager *lock_manager_;
   LogManager *log_manager_;
   page_id_t first_page_id_{};
+
+  /** The state of a tuple before one change, or, for an increment, the integers added by it. */
+  struct TupleUndo {
+    txn_id_t txn_id_;
+    std::shared_ptr<const std::atomic<timestamp_t>> commit_ts_;
+    /** false if the change created the tuple */
+    bool present_;
+    Tuple tuple_;
+    std::optional<TupleIncrement> increment_;
+  };
+
+  /** @return true if the change undone by the record is visible to the snapshot of txn */
+  static auto IsVisible(const TupleUndo &undo, Transaction *txn) -> bool;
+
+  /** Record the state of the tuple before a change of txn. The caller holds the page latch. */
+  void PushVersion(const RID &rid, Transaction *txn, bool present, const Tuple &tuple);
+
+  /** Record the integers added to the tuple by txn. The caller holds the page latch. */
+  void PushIncrement(const RID &rid, Transaction *txn, const TupleIncrement &increment);
+
+  /**
+   * Turn the page image of a tuple into the version visible to the snapshot of txn. The caller holds the page latch.
+   * @param present whether the page holds the tuple, in which case it was read into tuple
+   * @return whether the version exists
+   */
+  auto ReadVersion(const RID &rid, Transaction *txn, Tuple *tuple, bool present) -> bool;
+
+  std::mutex version_latch_;
+  /**
+   * The version chains, newest change first. A tuple nobody changed since the oldest snapshot has none. Increments
+   * commute, so they are neither ordered by commit among themselves nor stop a read: it takes out every increment it
+   * does not see, wherever it is in the chain.
+   */
+  std::unordered_map<RID, std::deque<TupleUndo>> versions_;
 };
 
 }  // namespace bustub
@@ -24,6 +24,9 @@ class TableHeap;
 
 /**
  * TableIterator enables the sequential scan of a TableHeap.
+ *
+ * For snapshot reads the iterator visits every slot, since a slot deleted on the page may still hold a version
+ * in the snapshot, and skips the slots without a visible version.
  */
 class TableIterator {
   friend class Cursor;
@@ -59,6 +62,14 @@ class TableIterator {
 
  private:
   TableHeap *table_heap_;
+  /** @return true if the iterator reads a snapshot */
+  inline auto IsSnapshotScan() const -> bool {
+    return txn_ != nullptr && txn_->IsSnapshotRead();
+  }
+
+  /** Move to the next slot after the current one that has a version visible to the snapshot. */
+  void NextVisibleSlot();
+
   Tuple *tuple_;
   Transaction *txn_;
 };
@@ -12,6 +12,8 @@
 
 #include "recovery/log_manager.h"
 
+#include <cstring>
+
 namespace bustub {
 /*
  * set enable_logging = true
@@ -22,33 +24,203 @@ namespace bustub {
  *
  * This thread runs forever until system shutdown/StopFlushThread
  */
-void LogManager::RunFlushThread() {}
+void LogManager::RunFlushThread() {
+  std::lock_guard lk(latch_);
+  if (flush_thread_ != nullptr) {
+    return;
+  }
+  stop_flush_ = false;
+  enable_logging = true;
+  flush_thread_ = new std::thread([this] {
+    std::unique_lock lk(latch_);
+    while (!stop_flush_) {
+      flush_cv_.wait_for(lk, log_timeout, [this] { return stop_flush_ || flush_requested_; });
+      FlushBuffer(&lk);
+    }
+    // drain whatever was appended before shutdown
+    FlushBuffer(&lk);
+  });
+}
 
 /*
  * Stop and join the flush thread, set enable_logging = false
  */
-void LogManager::StopFlushThread() {}
+void LogManager::StopFlushThread() {
+  {
+    std::lock_guard lk(latch_);
+    if (flush_thread_ == nullptr) {
+      return;
+    }
+    stop_flush_ = true;
+  }
+  flush_cv_.notify_one();
+  flush_thread_->join();
+  delete flush_thread_;
+  flush_thread_ = nullptr;
+  enable_logging = false;
+}
+
+void LogManager::FlushBuffer(std::unique_lock<std::mutex> *lk) {
+  // flush_buffer_ is in use until the previous write returns
+  cv_.wait(*lk, [this] { return !flushing_; });
+  flush_requested_ = false;
+  if (log_buffer_offset_ == 0) {
+    cv_.notify_all();
+    return;
+  }
+  flushing_ = true;
+  std::swap(log_buffer_, flush_buffer_);
+  int size = log_buffer_offset_;
+  lsn_t last_lsn = next_lsn_ - 1;
+  log_buffer_offset_ = 0;
+  // appenders may fill the other buffer while this one is written out
+  lk->unlock();
+  disk_manager_->WriteLog(flush_buffer_, size);
+  lk->lock();
+  persistent_lsn_ = last_lsn;
+  flushing_ = false;
+  cv_.notify_all();
+}
+
+void LogManager::Flush() {
+  std::unique_lock lk(latch_);
+  if (flush_thread_ == nullptr) {
+    return;
+  }
+  lsn_t target = next_lsn_ - 1;
+  if (persistent_lsn_ >= target) {
+    return;
+  }
+  flush_requested_ = true;
+  flush_cv_.notify_one();
+  cv_.wait(lk, [&] { return persistent_lsn_ >= target; });
+}
+
+/*
+ * The first committer to find no leader becomes the leader. It gives others up to group_commit_max_wait to join, or
+ * until group_commit_max_batch of them wait, then writes the log once on behalf of all of them. Commits that arrive
+ * during the write wait for it and then elect the next leader among themselves, so under load every write covers a
+ * whole group even when group_commit_max_wait is zero.
+ */
+void LogManager::GroupCommit(lsn_t commit_lsn) {
+  std::unique_lock lk(latch_);
+  if (flush_thread_ == nullptr) {
+    return;
+  }
+  commit_queue_.push_back(commit_lsn);
+  commit_cv_.notify_one();
+  while (persistent_lsn_ < commit_lsn) {
+    if (commit_leader_) {
+      cv_.wait(lk, [&] { return persistent_lsn_ >= commit_lsn || !commit_leader_; });
+      continue;
+    }
+    commit_leader_ = true;
+    if (group_commit_max_wait.count() > 0) {
+      commit_cv_.wait_for(lk, group_commit_max_wait, [this] {
+        return static_cast<int>(commit_queue_.size()) >= group_commit_max_batch;
+      });
+    }
+    FlushBuffer(&lk);
+    lsn_t persistent_lsn = persistent_lsn_;
+    commit_queue_.erase(std::remove_if(commit_queue_.begin(), commit_queue_.end(),
+                                       [&](lsn_t lsn) { return lsn <= persistent_lsn; }),
+                        commit_queue_.end());
+    commit_leader_ = false;
+    cv_.notify_all();
+  }
+}
 
 /*
  * append a log record into log buffer
  * you MUST set the log record's lsn within this method
  * @return: lsn that is assigned to this log record
  *
- *
- * example below
- * // First, serialize the must have fields(20 bytes in total)
- * log_record.lsn_ = next_lsn_++;
- * memcpy(log_buffer_ + offset_, &log_record, 20);
- * int pos = offset_ + 20;
- *
- * if (log_record.log_record_type_ == LogRecordType::INSERT) {
- *    memcpy(log_buffer_ + pos, &log_record.insert_rid_, sizeof(RID));
- *    pos += sizeof(RID);
- *    // we have provided serialize function for tuple class
- *    log_record.insert_tuple_.SerializeTo(log_buffer_ + pos);
- *  }
- *
+ * The header is serialized field by field (20 bytes in total), followed by the
+ * payload of the record type, see log_record.h for the layouts.
  */
-auto LogManager::AppendLogRecord(LogRecord *log_record) -> lsn_t { return INVALID_LSN; }
+auto LogManager::AppendLogRecord(LogRecord *log_record) -> lsn_t {
+  std::unique_lock lk(latch_);
+  BUSTUB_ASSERT(log_record->size_ <= LOG_BUFFER_SIZE, "log record larger than the log buffer");
+  if (log_buffer_offset_ + log_record->size_ > LOG_BUFFER_SIZE) {
+    flush_requested_ = true;
+    flush_cv_.notify_one();
+    cv_.wait(lk, [&] { return log_buffer_offset_ + log_record->size_ <= LOG_BUFFER_SIZE; });
+  }
+  log_record->lsn_ = next_lsn_++;
+
+  char *pos = log_buffer_ + log_buffer_offset_;
+  memcpy(pos, &log_record->size_, sizeof(int32_t));
+  memcpy(pos + 4, &log_record->lsn_, sizeof(lsn_t));
+  memcpy(pos + 8, &log_record->txn_id_, sizeof(txn_id_t));
+  memcpy(pos + 12, &log_record->prev_lsn_, sizeof(lsn_t));
+  memcpy(pos + 16, &log_record->log_record_type_, sizeof(LogRecordType));
+  pos += LogRecord::HEADER_SIZE;
+
+  switch (log_record->log_record_type_) {
+    case LogRecordType::INSERT:
+      memcpy(pos, &log_record->insert_rid_, sizeof(RID));
+      log_record->insert_tuple_.SerializeTo(pos + sizeof(RID));
+      break;
+    case LogRecordType::MARKDELETE:
+    case LogRecordType::APPLYDELETE:
+    case LogRecordType::ROLLBACKDELETE:
+      memcpy(pos, &log_record->delete_rid_, sizeof(RID));
+      log_record->delete_tuple_.SerializeTo(pos + sizeof(RID));
+      break;
+    case LogRecordType::UPDATE:
+      memcpy(pos, &log_record->update_rid_, sizeof(RID));
+      pos += sizeof(RID);
+      log_record->old_tuple_.SerializeTo(pos);
+      pos += sizeof(int32_t) + log_record->old_tuple_.GetLength();
+      log_record->new_tuple_.SerializeTo(pos);
+      break;
+    case LogRecordType::DELTAUPDATE:
+      memcpy(pos, &log_record->update_rid_, sizeof(RID));
+      log_record->delta_.SerializeTo(pos + sizeof(RID));
+      break;
+    case LogRecordType::INCREMENT:
+      memcpy(pos, &log_record->update_rid_, sizeof(RID));
+      log_record->increment_.SerializeTo(pos + sizeof(RID));
+      break;
+    case LogRecordType::NEWPAGE:
+      memcpy(pos, &log_record->prev_page_id_, sizeof(page_id_t));
+      memcpy(pos + sizeof(page_id_t), &log_record->page_id_, sizeof(page_id_t));
+      break;
+    case LogRecordType::HASHBUCKETINSERT:
+    case LogRecordType::HASHBUCKETREMOVE:
+      memcpy(pos, &log_record->directory_page_id_, sizeof(page_id_t));
+      memcpy(pos + sizeof(page_id_t), &log_record->bucket_page_id_, sizeof(page_id_t));
+      log_record->slot_image_.SerializeTo(pos + 2 * sizeof(page_id_t));
+      break;
+    case LogRecordType::HASHBUCKETSPLIT: {
+      auto count = static_cast<uint32_t>(log_record->moves_.size());
+      memcpy(pos, &log_record->bucket_page_id_, sizeof(page_id_t));
+      memcpy(pos + sizeof(page_id_t), &log_record->image_page_id_, sizeof(page_id_t));
+      memcpy(pos + 2 * sizeof(page_id_t), &count, sizeof(uint32_t));
+      pos += 2 * sizeof(page_id_t) + sizeof(uint32_t);
+      for (const auto &[old_slot, slot_image] : log_record->moves_) {
+        memcpy(pos, &old_slot, sizeof(uint32_t));
+        slot_image.SerializeTo(pos + sizeof(uint32_t));
+        pos += sizeof(uint32_t) + slot_image.GetSerializedSize();
+      }
+      break;
+    }
+    case LogRecordType::HASHDIRECTORY: {
+      auto count = static_cast<uint32_t>(log_record->entries_.size());
+      memcpy(pos, &log_record->directory_page_id_, sizeof(page_id_t));
+      memcpy(pos + sizeof(page_id_t), &log_record->global_depth_, sizeof(uint32_t));
+      memcpy(pos + sizeof(page_id_t) + sizeof(uint32_t), &count, sizeof(uint32_t));
+      if (count > 0) {
+        memcpy(pos + sizeof(page_id_t) + 2 * sizeof(uint32_t), log_record->entries_.data(),
+               count * sizeof(HashDirectoryEntry));
+      }
+      break;
+    }
+    default:
+      break;
+  }
+  log_buffer_offset_ += log_record->size_;
+  return log_record->lsn_;
+}
 
 }  // namespace bustub
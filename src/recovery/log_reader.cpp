@@ -0,0 +1,211 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// log_reader.cpp
+//
+// Identification: src/recovery/log_reader.cpp
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include "recovery/log_reader.h"
+
+#include <cstring>
+#include <utility>
+
+namespace bustub {
+
+LogReader::LogReader(DiskManager *disk_manager, int block_size, int offset)
+    : disk_manager_(disk_manager), block_size_(block_size) {
+  for (auto &buffer : buffers_) {
+    buffer.data_ = std::make_unique<char[]>(LOG_BUFFER_SIZE + block_size_);
+  }
+  read_ahead_thread_ = std::thread(&LogReader::RunReadAhead, this, offset);
+}
+
+LogReader::~LogReader() {
+  {
+    std::scoped_lock lk(latch_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  read_ahead_thread_.join();
+}
+
+/*
+ * Fill the two buffers in turn with consecutive blocks of the log, each as soon as the decoder hands it back. An empty
+ * block marks the end of the log and ends the thread.
+ */
+void LogReader::RunReadAhead(int offset) {
+  for (int index = 0;; index ^= 1) {
+    std::unique_lock lk(latch_);
+    cv_.wait(lk, [&] { return stop_ || !buffers_[index].ready_; });
+    if (stop_) {
+      return;
+    }
+    // the decoder never touches a buffer that is not ready, read without holding the latch
+    lk.unlock();
+    int length = disk_manager_->ReadLogBlock(BlockOf(index), block_size_, offset);
+    lk.lock();
+    buffers_[index].offset_ = offset;
+    buffers_[index].length_ = length;
+    buffers_[index].ready_ = true;
+    cv_.notify_all();
+    if (length == 0) {
+      return;
+    }
+    offset += length;
+  }
+}
+
+void LogReader::WaitReady(int index) {
+  std::unique_lock lk(latch_);
+  cv_.wait(lk, [&] { return buffers_[index].ready_; });
+}
+
+void LogReader::Release(int index) {
+  {
+    std::scoped_lock lk(latch_);
+    buffers_[index].ready_ = false;
+  }
+  cv_.notify_all();
+}
+
+auto LogReader::Next(LogRecord *log_record) -> bool {
+  if (end_of_log_) {
+    return false;
+  }
+  if (current_ == -1) {
+    WaitReady(0);
+    current_ = 0;
+    pos_ = BlockOf(0);
+    end_ = pos_ + buffers_[0].length_;
+  }
+  while (true) {
+    auto remaining = static_cast<int32_t>(end_ - pos_);
+    int32_t size = 0;
+    if (remaining >= static_cast<int32_t>(sizeof(int32_t))) {
+      memcpy(&size, pos_, sizeof(int32_t));
+      // the zeroed (or torn) tail of the log
+      if (size < LogRecord::HEADER_SIZE || size > LOG_BUFFER_SIZE) {
+        end_of_log_ = true;
+        return false;
+      }
+      if (size <= remaining) {
+        break;
+      }
+    }
+    // the record straddles the end of the block, complete it in front of the next one
+    int next = current_ ^ 1;
+    WaitReady(next);
+    char *block = BlockOf(next);
+    int length = buffers_[next].length_;
+    if (length == 0) {
+      end_of_log_ = true;
+      return false;
+    }
+    memcpy(block - remaining, pos_, remaining);
+    Release(current_);
+    current_ = next;
+    pos_ = block - remaining;
+    end_ = block + length;
+  }
+  record_offset_ = buffers_[current_].offset_ - static_cast<int>(BlockOf(current_) - pos_);
+  if (!Deserialize(pos_, log_record)) {
+    end_of_log_ = true;
+    return false;
+  }
+  pos_ += log_record->GetSize();
+  return true;
+}
+
+/*
+ * deserialize a log record from a contiguous image of it
+ * @return: true means deserialize succeed, otherwise the image is not a valid
+ * log record, e.g. the zeroed tail of the log
+ */
+auto LogReader::Deserialize(const char *data, LogRecord *log_record) -> bool {
+  memcpy(&log_record->size_, data, sizeof(int32_t));
+  memcpy(&log_record->lsn_, data + 4, sizeof(lsn_t));
+  memcpy(&log_record->txn_id_, data + 8, sizeof(txn_id_t));
+  memcpy(&log_record->prev_lsn_, data + 12, sizeof(lsn_t));
+  memcpy(&log_record->log_record_type_, data + 16, sizeof(LogRecordType));
+  if (log_record->size_ < LogRecord::HEADER_SIZE || log_record->log_record_type_ == LogRecordType::INVALID ||
+      log_record->log_record_type_ > LogRecordType::INCREMENT) {
+    return false;
+  }
+  const char *pos = data + LogRecord::HEADER_SIZE;
+  switch (log_record->log_record_type_) {
+    case LogRecordType::INSERT:
+      memcpy(&log_record->insert_rid_, pos, sizeof(RID));
+      log_record->insert_tuple_.DeserializeFrom(pos + sizeof(RID));
+      break;
+    case LogRecordType::MARKDELETE:
+    case LogRecordType::APPLYDELETE:
+    case LogRecordType::ROLLBACKDELETE:
+      memcpy(&log_record->delete_rid_, pos, sizeof(RID));
+      log_record->delete_tuple_.DeserializeFrom(pos + sizeof(RID));
+      break;
+    case LogRecordType::UPDATE:
+      memcpy(&log_record->update_rid_, pos, sizeof(RID));
+      pos += sizeof(RID);
+      log_record->old_tuple_.DeserializeFrom(pos);
+      pos += sizeof(int32_t) + log_record->old_tuple_.GetLength();
+      log_record->new_tuple_.DeserializeFrom(pos);
+      break;
+    case LogRecordType::DELTAUPDATE:
+      memcpy(&log_record->update_rid_, pos, sizeof(RID));
+      log_record->delta_.DeserializeFrom(pos + sizeof(RID));
+      break;
+    case LogRecordType::INCREMENT:
+      memcpy(&log_record->update_rid_, pos, sizeof(RID));
+      log_record->increment_.DeserializeFrom(pos + sizeof(RID));
+      break;
+    case LogRecordType::NEWPAGE:
+      memcpy(&log_record->prev_page_id_, pos, sizeof(page_id_t));
+      memcpy(&log_record->page_id_, pos + sizeof(page_id_t), sizeof(page_id_t));
+      break;
+    case LogRecordType::HASHBUCKETINSERT:
+    case LogRecordType::HASHBUCKETREMOVE:
+      memcpy(&log_record->directory_page_id_, pos, sizeof(page_id_t));
+      memcpy(&log_record->bucket_page_id_, pos + sizeof(page_id_t), sizeof(page_id_t));
+      log_record->slot_image_.DeserializeFrom(pos + 2 * sizeof(page_id_t));
+      break;
+    case LogRecordType::HASHBUCKETSPLIT: {
+      uint32_t count;
+      memcpy(&log_record->bucket_page_id_, pos, sizeof(page_id_t));
+      memcpy(&log_record->image_page_id_, pos + sizeof(page_id_t), sizeof(page_id_t));
+      memcpy(&count, pos + 2 * sizeof(page_id_t), sizeof(uint32_t));
+      pos += 2 * sizeof(page_id_t) + sizeof(uint32_t);
+      log_record->moves_.clear();
+      for (uint32_t i = 0; i < count; ++i) {
+        uint32_t old_slot;
+        HashSlotImage slot_image;
+        memcpy(&old_slot, pos, sizeof(uint32_t));
+        slot_image.DeserializeFrom(pos + sizeof(uint32_t));
+        pos += sizeof(uint32_t) + slot_image.GetSerializedSize();
+        log_record->moves_.emplace_back(old_slot, std::move(slot_image));
+      }
+      break;
+    }
+    case LogRecordType::HASHDIRECTORY: {
+      uint32_t count;
+      memcpy(&log_record->directory_page_id_, pos, sizeof(page_id_t));
+      memcpy(&log_record->global_depth_, pos + sizeof(page_id_t), sizeof(uint32_t));
+      memcpy(&count, pos + sizeof(page_id_t) + sizeof(uint32_t), sizeof(uint32_t));
+      log_record->entries_.resize(count);
+      if (count > 0) {
+        memcpy(log_record->entries_.data(), pos + sizeof(page_id_t) + 2 * sizeof(uint32_t),
+               count * sizeof(HashDirectoryEntry));
+      }
+      break;
+    }
+    default:
+      break;
+  }
+  return true;
+}
+
+}  // namespace bustub
@@ -0,0 +1,202 @@
+//===----------------------------------------------------------------------===//
+//
+//                         BusTub
+//
+// log_record.cpp
+//
+// Identification: src/recovery/log_record.cpp
+//
+// Copyright (c) 2015-2019, Carnegie Mellon University Database Group
+//
+//===----------------------------------------------------------------------===//
+
+#include "recovery/log_record.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "type/limits.h"
+
+namespace bustub {
+
+/*
+ * Collect the differing byte runs of two equally sized tuples. Two runs separated by a gap no wider than a range
+ * header are merged, because logging the unchanged gap twice is cheaper than starting a new range.
+ */
+TupleDelta::TupleDelta(const Tuple &old_tuple, const Tuple &new_tuple) : tuple_size_(old_tuple.GetLength()) {
+  assert(old_tuple.GetLength() == new_tuple.GetLength());
+  const char *old_data = old_tuple.GetData();
+  const char *new_data = new_tuple.GetData();
+  uint32_t i = 0;
+  while (i < tuple_size_) {
+    if (old_data[i] == new_data[i]) {
+      ++i;
+      continue;
+    }
+    uint32_t begin = i;
+    uint32_t end = i + 1;
+    for (uint32_t j = end; j < tuple_size_ && j - end <= sizeof(uint32_t); ++j) {
+      if (old_data[j] != new_data[j]) {
+        end = j + 1;
+      }
+    }
+    uint32_t length = end - begin;
+    size_t pos = ranges_.size();
+    ranges_.resize(pos + 2 * sizeof(uint32_t) + 2 * length);
+    memcpy(ranges_.data() + pos, &begin, sizeof(uint32_t));
+    memcpy(ranges_.data() + pos + sizeof(uint32_t), &length, sizeof(uint32_t));
+    memcpy(ranges_.data() + pos + 2 * sizeof(uint32_t), old_data + begin, length);
+    memcpy(ranges_.data() + pos + 2 * sizeof(uint32_t) + length, new_data + begin, length);
+    ++range_count_;
+    i = end;
+  }
+}
+
+void TupleDelta::SerializeTo(char *storage) const {
+  memcpy(storage, &tuple_size_, sizeof(uint32_t));
+  memcpy(storage + sizeof(uint32_t), &range_count_, sizeof(uint32_t));
+  if (!ranges_.empty()) {
+    memcpy(storage + 2 * sizeof(uint32_t), ranges_.data(), ranges_.size());
+  }
+}
+
+void TupleDelta::DeserializeFrom(const char *storage) {
+  memcpy(&tuple_size_, storage, sizeof(uint32_t));
+  memcpy(&range_count_, storage + sizeof(uint32_t), sizeof(uint32_t));
+  const char *begin = storage + 2 * sizeof(uint32_t);
+  const char *pos = begin;
+  for (uint32_t i = 0; i < range_count_; ++i) {
+    uint32_t length;
+    memcpy(&length, pos + sizeof(uint32_t), sizeof(uint32_t));
+    pos += 2 * sizeof(uint32_t) + 2 * length;
+  }
+  ranges_.assign(begin, pos);
+}
+
+void TupleDelta::ApplyTo(char *tuple_data, bool undo) const {
+  const char *pos = ranges_.data();
+  for (uint32_t i = 0; i < range_count_; ++i) {
+    uint32_t offset;
+    uint32_t length;
+    memcpy(&offset, pos, sizeof(uint32_t));
+    memcpy(&length, pos + sizeof(uint32_t), sizeof(uint32_t));
+    assert(offset + length <= tuple_size_);
+    const char *image = pos + 2 * sizeof(uint32_t) + (undo ? 0 : length);
+    memcpy(tuple_data + offset, image, length);
+    pos += 2 * sizeof(uint32_t) + 2 * length;
+  }
+}
+
+void TupleIncrement::SerializeTo(char *storage) const {
+  uint32_t count = deltas_.size();
+  memcpy(storage, &count, sizeof(uint32_t));
+  char *pos = storage + sizeof(uint32_t);
+  for (const auto &[offset, delta] : deltas_) {
+    memcpy(pos, &offset, sizeof(uint32_t));
+    memcpy(pos + sizeof(uint32_t), &delta, sizeof(int32_t));
+    pos += sizeof(uint32_t) + sizeof(int32_t);
+  }
+}
+
+void TupleIncrement::DeserializeFrom(const char *storage) {
+  uint32_t count;
+  memcpy(&count, storage, sizeof(uint32_t));
+  deltas_.resize(count);
+  const char *pos = storage + sizeof(uint32_t);
+  for (auto &[offset, delta] : deltas_) {
+    memcpy(&offset, pos, sizeof(uint32_t));
+    memcpy(&delta, pos + sizeof(uint32_t), sizeof(int32_t));
+    pos += sizeof(uint32_t) + sizeof(int32_t);
+  }
+}
+
+auto TupleIncrement::Inverse() const -> TupleIncrement {
+  TupleIncrement inverse;
+  for (const auto &[offset, delta] : deltas_) {
+    inverse.Add(offset, static_cast<int32_t>(0U - static_cast<uint32_t>(delta)));
+  }
+  return inverse;
+}
+
+auto TupleIncrement::Fits(const char *tuple_data) const -> bool {
+  return std::all_of(deltas_.begin(), deltas_.end(), [tuple_data](const auto &entry) {
+    int32_t value;
+    memcpy(&value, tuple_data + entry.first, sizeof(int32_t));
+    int64_t sum = static_cast<int64_t>(value) + entry.second;
+    return value == BUSTUB_INT32_NULL || (sum >= BUSTUB_INT32_MIN && sum <= BUSTUB_INT32_MAX);
+  });
+}
+
+void TupleIncrement::ApplyTo(char *tuple_data, bool undo) const {
+  for (const auto &[offset, delta] : deltas_) {
+    int32_t value;
+    memcpy(&value, tuple_data + offset, sizeof(int32_t));
+    if (value == BUSTUB_INT32_NULL) {
+      continue;
+    }
+    auto bits = static_cast<uint32_t>(value);
+    value = static_cast<int32_t>(undo ? bits - static_cast<uint32_t>(delta) : bits + static_cast<uint32_t>(delta));
+    memcpy(tuple_data + offset, &value, sizeof(int32_t));
+  }
+}
+
+void HashSlotImage::SerializeTo(char *storage) const {
+  memcpy(storage, &layout_, sizeof(HashBucketLayout));
+  memcpy(storage + sizeof(HashBucketLayout), &slot_, sizeof(uint32_t));
+  memcpy(storage + sizeof(HashBucketLayout) + sizeof(uint32_t), &tag_, sizeof(uint8_t));
+  memcpy(storage + sizeof(HashBucketLayout) + sizeof(uint32_t) + sizeof(uint8_t), pair_.data(), layout_.pair_size_);
+}
+
+void HashSlotImage::DeserializeFrom(const char *storage) {
+  memcpy(&layout_, storage, sizeof(HashBucketLayout));
+  memcpy(&slot_, storage + sizeof(HashBucketLayout), sizeof(uint32_t));
+  memcpy(&tag_, storage + sizeof(HashBucketLayout) + sizeof(uint32_t), sizeof(uint8_t));
+  const char *pair = storage + sizeof(HashBucketLayout) + sizeof(uint32_t) + sizeof(uint8_t);
+  pair_.assign(pair, pair + layout_.pair_size_);
+}
+
+/*
+ * The bitmaps are addressed exactly like HashTableBucketPage does: one bit per slot, most significant bit first.
+ */
+static auto SlotMask(uint32_t slot) -> uint8_t { return static_cast<uint8_t>(128 >> (slot % 8)); }
+
+void HashSlotImage::InstallAt(char *bucket_data, uint32_t slot) const {
+  assert(slot < layout_.array_size_);
+  bucket_data[layout_.occupied_offset_ + slot / 8] |= SlotMask(slot);
+  bucket_data[layout_.readable_offset_ + slot / 8] |= SlotMask(slot);
+  bucket_data[layout_.tags_offset_ + slot] = static_cast<char>(tag_);
+  memcpy(bucket_data + layout_.array_offset_ + slot * layout_.pair_size_, pair_.data(), layout_.pair_size_);
+}
+
+void HashSlotImage::EraseAt(char *bucket_data, uint32_t slot) const {
+  assert(slot < layout_.array_size_);
+  bucket_data[layout_.readable_offset_ + slot / 8] &= static_cast<char>(~SlotMask(slot));
+}
+
+auto HashSlotImage::IsReadableIn(const char *bucket_data, uint32_t slot) const -> bool {
+  return (static_cast<uint8_t>(bucket_data[layout_.readable_offset_ + slot / 8]) & SlotMask(slot)) != 0;
+}
+
+auto HashSlotImage::FindIn(const char *bucket_data) const -> uint32_t {
+  for (uint32_t i = 0; i != layout_.array_size_; ++i) {
+    if ((static_cast<uint8_t>(bucket_data[layout_.occupied_offset_ + i / 8]) & SlotMask(i)) == 0) {
+      break;
+    }
+    if (IsReadableIn(bucket_data, i) &&
+        memcmp(bucket_data + layout_.array_offset_ + i * layout_.pair_size_, pair_.data(), layout_.pair_size_) == 0) {
+      return i;
+    }
+  }
+  return layout_.array_size_;
+}
+
+auto HashSlotImage::FreeSlotIn(const char *bucket_data) const -> uint32_t {
+  for (uint32_t i = 0; i != layout_.array_size_; ++i) {
+    if (!IsReadableIn(bucket_data, i)) {
+      return i;
+    }
+  }
+  return layout_.array_size_;
+}
+
+}  // namespace bustub
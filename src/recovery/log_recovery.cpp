@@ -12,6 +12,14 @@
 
 #include "recovery/log_recovery.h"
 
+#include <cstring>
+#include <queue>
+#include <utility>
+
+#include "container/hash/hash_function.h"
+#include "container/hash/hash_table_directory.h"
+#include "recovery/log_reader.h"
+#include "storage/page/hash_table_directory_page.h"
 #include "storage/page/table_page.h"
 
 namespace bustub {
@@ -20,21 +28,286 @@ namespace bustub {
  * @return: true means deserialize succeed, otherwise can't deserialize cause
  * incomplete log record
  */
-auto LogRecovery::DeserializeLogRecord(const char *data, LogRecord *log_record) -> bool { return false; }
+auto LogRecovery::DeserializeLogRecord(const char *data, LogRecord *log_record) -> bool {
+  return LogReader::Deserialize(data, log_record);
+}
 
 /*
  *redo phase on TABLE PAGE level(table/table_page.h)
- *read log file from the beginning to end (you must prefetch log records into
- *log buffer to reduce unnecessary I/O operations), remember to compare page's
+ *read log file from the beginning to end (a LogReader prefetches it in large
+ *sequential blocks ahead of the decoding), remember to compare page's
  *LSN with log_record's sequence number, and also build active_txn_ table &
  *lsn_mapping_ table
  */
-void LogRecovery::Redo() {}
+void LogRecovery::Redo() {
+  LogReader reader(disk_manager_);
+  for (auto it = reader.Begin(); it != reader.End(); ++it) {
+    LogRecord &log_record = *it;
+    lsn_mapping_[log_record.lsn_] = reader.GetOffset();
+    if (log_record.log_record_type_ == LogRecordType::COMMIT || log_record.log_record_type_ == LogRecordType::ABORT) {
+      active_txn_.erase(log_record.txn_id_);
+    } else if (log_record.txn_id_ != INVALID_TXN_ID) {
+      active_txn_[log_record.txn_id_] = log_record.lsn_;
+    }
+    RedoLogRecord(&log_record);
+  }
+}
 
 /*
  *undo phase on TABLE PAGE level(table/table_page.h)
  *iterate through active txn map and undo each operation
  */
-void LogRecovery::Undo() {}
+void LogRecovery::Undo() {
+  // undo the losers' records in descending LSN order across all of them
+  std::priority_queue<lsn_t> to_undo;
+  for (const auto &[txn_id, lsn] : active_txn_) {
+    to_undo.push(lsn);
+  }
+  while (!to_undo.empty()) {
+    lsn_t lsn = to_undo.top();
+    to_undo.pop();
+    disk_manager_->ReadLog(log_buffer_, LOG_BUFFER_SIZE, lsn_mapping_[lsn]);
+    LogRecord log_record;
+    bool ok = DeserializeLogRecord(log_buffer_, &log_record);
+    BUSTUB_ASSERT(ok && log_record.lsn_ == lsn, "lsn mapping points to a different record");
+    UndoLogRecord(&log_record);
+    if (log_record.prev_lsn_ != INVALID_LSN) {
+      to_undo.push(log_record.prev_lsn_);
+    }
+  }
+  active_txn_.clear();
+  lsn_mapping_.clear();
+}
+
+void LogRecovery::RedoLogRecord(LogRecord *log_record) {
+  page_id_t page_id;
+  switch (log_record->log_record_type_) {
+    case LogRecordType::INSERT:
+      page_id = log_record->insert_rid_.GetPageId();
+      break;
+    case LogRecordType::MARKDELETE:
+    case LogRecordType::APPLYDELETE:
+    case LogRecordType::ROLLBACKDELETE:
+      page_id = log_record->delete_rid_.GetPageId();
+      break;
+    case LogRecordType::UPDATE:
+    case LogRecordType::DELTAUPDATE:
+    case LogRecordType::INCREMENT:
+      page_id = log_record->update_rid_.GetPageId();
+      break;
+    case LogRecordType::NEWPAGE:
+      page_id = log_record->page_id_;
+      break;
+    case LogRecordType::HASHBUCKETINSERT:
+    case LogRecordType::HASHBUCKETREMOVE:
+    case LogRecordType::HASHBUCKETSPLIT:
+    case LogRecordType::HASHDIRECTORY:
+      RedoHashIndexLogRecord(log_record);
+      return;
+    default:
+      return;
+  }
+
+  auto *page = static_cast<TablePage *>(buffer_pool_manager_->FetchPage(page_id));
+  BUSTUB_ASSERT(page != nullptr, "Couldn't fetch the page to redo.");
+  if (page->GetLSN() >= log_record->lsn_) {
+    buffer_pool_manager_->UnpinPage(page_id, false);
+    return;
+  }
+  switch (log_record->log_record_type_) {
+    case LogRecordType::INSERT: {
+      RID rid;
+      page->InsertTuple(log_record->insert_tuple_, &rid, nullptr, nullptr, nullptr);
+      BUSTUB_ASSERT(rid == log_record->insert_rid_, "Redo of an insert must land on the logged slot.");
+      break;
+    }
+    case LogRecordType::MARKDELETE:
+      page->MarkDelete(log_record->delete_rid_, nullptr, nullptr, nullptr);
+      break;
+    case LogRecordType::APPLYDELETE:
+      page->ApplyDelete(log_record->delete_rid_, nullptr, nullptr);
+      break;
+    case LogRecordType::ROLLBACKDELETE:
+      page->RollbackDelete(log_record->delete_rid_, nullptr, nullptr);
+      break;
+    case LogRecordType::UPDATE: {
+      Tuple old_tuple;
+      page->UpdateTuple(log_record->new_tuple_, &old_tuple, log_record->update_rid_, nullptr, nullptr, nullptr);
+      break;
+    }
+    case LogRecordType::DELTAUPDATE:
+      page->ApplyTupleDelta(log_record->update_rid_, log_record->delta_, false);
+      break;
+    case LogRecordType::INCREMENT:
+      page->ApplyTupleIncrement(log_record->update_rid_, log_record->increment_, false);
+      break;
+    case LogRecordType::NEWPAGE: {
+      page_id_t prev_page_id = log_record->prev_page_id_;
+      page->Init(page_id, PAGE_SIZE, prev_page_id, nullptr, nullptr);
+      if (prev_page_id != INVALID_PAGE_ID) {
+        auto *prev_page = static_cast<TablePage *>(buffer_pool_manager_->FetchPage(prev_page_id));
+        BUSTUB_ASSERT(prev_page != nullptr, "Couldn't fetch the previous page.");
+        bool relink = prev_page->GetNextPageId() != page_id;
+        if (relink) {
+          prev_page->SetNextPageId(page_id);
+        }
+        buffer_pool_manager_->UnpinPage(prev_page_id, relink);
+      }
+      break;
+    }
+    default:
+      break;
+  }
+  page->SetLSN(log_record->lsn_);
+  buffer_pool_manager_->UnpinPage(page_id, true);
+}
+
+void LogRecovery::UndoLogRecord(LogRecord *log_record) {
+  switch (log_record->log_record_type_) {
+    case LogRecordType::INSERT: {
+      RID &rid = log_record->insert_rid_;
+      auto *page = static_cast<TablePage *>(buffer_pool_manager_->FetchPage(rid.GetPageId()));
+      page->ApplyDelete(rid, nullptr, nullptr);
+      buffer_pool_manager_->UnpinPage(rid.GetPageId(), true);
+      break;
+    }
+    case LogRecordType::MARKDELETE:
+    case LogRecordType::APPLYDELETE:
+    case LogRecordType::ROLLBACKDELETE: {
+      RID &rid = log_record->delete_rid_;
+      auto *page = static_cast<TablePage *>(buffer_pool_manager_->FetchPage(rid.GetPageId()));
+      if (log_record->log_record_type_ == LogRecordType::MARKDELETE) {
+        page->RollbackDelete(rid, nullptr, nullptr);
+      } else if (log_record->log_record_type_ == LogRecordType::ROLLBACKDELETE) {
+        page->MarkDelete(rid, nullptr, nullptr, nullptr);
+      } else {
+        RID new_rid;
+        page->InsertTuple(log_record->delete_tuple_, &new_rid, nullptr, nullptr, nullptr);
+      }
+      buffer_pool_manager_->UnpinPage(rid.GetPageId(), true);
+      break;
+    }
+    case LogRecordType::UPDATE:
+    case LogRecordType::DELTAUPDATE:
+    case LogRecordType::INCREMENT: {
+      RID &rid = log_record->update_rid_;
+      auto *page = static_cast<TablePage *>(buffer_pool_manager_->FetchPage(rid.GetPageId()));
+      if (log_record->log_record_type_ == LogRecordType::UPDATE) {
+        Tuple new_tuple;
+        page->UpdateTuple(log_record->old_tuple_, &new_tuple, rid, nullptr, nullptr, nullptr);
+      } else if (log_record->log_record_type_ == LogRecordType::DELTAUPDATE) {
+        page->ApplyTupleDelta(rid, log_record->delta_, true);
+      } else {
+        // the increments of other transactions may have been applied after this one, only this one is taken back
+        page->ApplyTupleIncrement(rid, log_record->increment_, true);
+      }
+      buffer_pool_manager_->UnpinPage(rid.GetPageId(), true);
+      break;
+    }
+    case LogRecordType::HASHBUCKETINSERT:
+    case LogRecordType::HASHBUCKETREMOVE:
+      UndoHashIndexLogRecord(log_record);
+      break;
+    default:
+      break;
+  }
+}
+
+/*
+ * Bucket and directory changes are redone physically, slot by slot. A split touches two buckets, each of them is
+ * checked against its own LSN.
+ */
+void LogRecovery::RedoHashIndexLogRecord(LogRecord *log_record) {
+  auto redo = [&](page_id_t page_id, auto &&apply) {
+    Page *page = buffer_pool_manager_->FetchPage(page_id);
+    BUSTUB_ASSERT(page != nullptr, "Couldn't fetch the page to redo.");
+    if (page->GetLSN() >= log_record->lsn_) {
+      buffer_pool_manager_->UnpinPage(page_id, false);
+      return;
+    }
+    apply(page->GetData());
+    page->SetLSN(log_record->lsn_);
+    buffer_pool_manager_->UnpinPage(page_id, true);
+  };
+  const HashSlotImage &slot_image = log_record->slot_image_;
+  switch (log_record->log_record_type_) {
+    case LogRecordType::HASHBUCKETINSERT:
+      redo(log_record->bucket_page_id_, [&](char *data) { slot_image.InstallAt(data, slot_image.GetSlot()); });
+      break;
+    case LogRecordType::HASHBUCKETREMOVE:
+      redo(log_record->bucket_page_id_, [&](char *data) { slot_image.EraseAt(data, slot_image.GetSlot()); });
+      break;
+    case LogRecordType::HASHBUCKETSPLIT:
+      redo(log_record->bucket_page_id_, [&](char *data) {
+        for (const auto &[old_slot, moved] : log_record->moves_) {
+          moved.EraseAt(data, old_slot);
+        }
+      });
+      redo(log_record->image_page_id_, [&](char *data) {
+        for (const auto &[old_slot, moved] : log_record->moves_) {
+          moved.InstallAt(data, moved.GetSlot());
+        }
+      });
+      break;
+    case LogRecordType::HASHDIRECTORY:
+      redo(log_record->directory_page_id_, [&](char *data) {
+        auto *dir_page = reinterpret_cast<HashTableDirectoryPage *>(data);
+        dir_page->SetPageId(log_record->directory_page_id_);
+        dir_page->SetGlobalDepth(log_record->global_depth_);
+        for (const auto &entry : log_record->entries_) {
+          if (entry.bucket_idx_ >= DIRECTORY_ARRAY_SIZE) {
+            dir_page->SetSegmentPageId(entry.bucket_idx_ - DIRECTORY_ARRAY_SIZE, entry.bucket_page_id_);
+            continue;
+          }
+          dir_page->SetBucketPageId(entry.bucket_idx_, entry.bucket_page_id_);
+          dir_page->SetLocalDepth(entry.bucket_idx_, entry.local_depth_);
+        }
+      });
+      break;
+    default:
+      break;
+  }
+}
+
+/*
+ * Splits are never undone, so the pair of a loser may have moved to another bucket since it was logged. Undo is
+ * therefore logical: the key is hashed the way HashFunction does and looked up in the recovered directory.
+ */
+void LogRecovery::UndoHashIndexLogRecord(LogRecord *log_record) {
+  const HashSlotImage &slot_image = log_record->slot_image_;
+  page_id_t bucket_page_id = LocateHashBucket(log_record->directory_page_id_, slot_image);
+  Page *page = buffer_pool_manager_->FetchPage(bucket_page_id);
+  BUSTUB_ASSERT(page != nullptr, "Couldn't fetch the bucket to undo.");
+  char *data = page->GetData();
+  uint32_t array_size = slot_image.GetLayout().array_size_;
+  bool dirty = false;
+  if (log_record->log_record_type_ == LogRecordType::HASHBUCKETINSERT) {
+    uint32_t slot = slot_image.FindIn(data);
+    if (slot != array_size) {
+      slot_image.EraseAt(data, slot);
+      dirty = true;
+    }
+  } else if (slot_image.FindIn(data) == array_size) {
+    uint32_t slot = slot_image.FreeSlotIn(data);
+    if (slot == array_size) {
+      LOG_WARN("bucket %d is full, cannot undo the remove of LSN %d", bucket_page_id, log_record->lsn_);
+    } else {
+      slot_image.InstallAt(data, slot);
+      dirty = true;
+    }
+  }
+  buffer_pool_manager_->UnpinPage(bucket_page_id, dirty);
+}
+
+auto LogRecovery::LocateHashBucket(page_id_t directory_page_id, const HashSlotImage &slot_image) -> page_id_t {
+  // the default HashFunction of the key type, the one the hash indexes are built with
+  uint64_t hash = HashBytes(slot_image.GetKeyData(), slot_image.GetLayout().key_size_);
+  Page *page = buffer_pool_manager_->FetchPage(directory_page_id);
+  BUSTUB_ASSERT(page != nullptr, "Couldn't fetch the hash directory.");
+  auto *dir_page = reinterpret_cast<HashTableDirectoryPage *>(page->GetData());
+  page_id_t bucket_page_id = HashTableDirectory::LookUp(buffer_pool_manager_, dir_page, static_cast<uint32_t>(hash));
+  buffer_pool_manager_->UnpinPage(directory_page_id, false);
+  return bucket_page_id;
+}
 
 }  // namespace bustub
@@ -185,6 +185,21 @@ auto DiskManager::ReadLog(char *log_data, int size, int offset) -> bool {
   return true;
 }
 
+auto DiskManager::ReadLogBlock(char *log_data, int size, int offset) -> int {
+  log_io_.seekg(offset);
+  log_io_.read(log_data, size);
+  if (log_io_.bad()) {
+    LOG_DEBUG("I/O error while reading log");
+    log_io_.clear();
+    return 0;
+  }
+  int read_count = log_io_.gcount();
+  if (read_count < size) {
+    log_io_.clear();
+  }
+  return read_count;
+}
+
 /**
  * Returns number of flushes made so far
  */
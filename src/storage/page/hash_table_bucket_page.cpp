@@ -11,7 +11,15 @@
 //===----------------------------------------------------------------------===//
 
 #include "storage/page/hash_table_bucket_page.h"
+
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+
+#include <algorithm>
+
 #include "common/logger.h"
+#include "container/hash/hash_function.h"
 #include "common/util/hash_util.h"
 #include "storage/index/generic_key.h"
 #include "storage/index/hash_comparator.h"
@@ -20,71 +28,95 @@
 namespace bustub {
 
 template <typename KeyType, typename ValueType, typename KeyComparator>
-auto HASH_TABLE_BUCKET_TYPE::GetValue(KeyType key, KeyComparator cmp, std::vector<ValueType> *result) -> bool {
+auto HASH_TABLE_BUCKET_TYPE::GetValue(KeyType key, uint8_t tag, KeyComparator cmp, std::vector<ValueType> *result)
+    -> bool {
   bool found = false;
-  for (size_t i = 0; i != BUCKET_ARRAY_SIZE; ++i) {
-    if (!IsOccupied(i)) {
-      break;
-    }
+  ForEachTagMatch(tag, OccupiedEnd(), [&](uint32_t i) {
     if (IsReadable(i) && cmp(array_[i].first, key) == 0) {
       result->push_back(array_[i].second);
       found = true;
     }
-  }
+    return true;
+  });
   return found;
 }
 
+template <typename KeyType, typename ValueType, typename KeyComparator>
+auto HASH_TABLE_BUCKET_TYPE::GetValue(KeyType key, KeyComparator cmp, std::vector<ValueType> *result) -> bool {
+  return GetValue(key, TagOf(HashFunction<KeyType>().GetHash(key)), cmp, result);
+}
+
 template <typename KeyType, typename ValueType, typename KeyComparator>
 auto HASH_TABLE_BUCKET_TYPE::Insert(KeyType key, ValueType value, KeyComparator cmp) -> bool {
   return Insert2(key, value, cmp) == CODE_OK;
 }
 
+/*
+ * The pair goes to the first tombstone, or else to the first slot never used, the slot recovery would pick as well.
+ */
 template <typename KeyType, typename ValueType, typename KeyComparator>
-auto HASH_TABLE_BUCKET_TYPE::Insert2(KeyType key, ValueType value, KeyComparator cmp) -> uint8_t {
-  uint32_t tombstone = BUCKET_ARRAY_SIZE;
-  for (uint32_t i = 0; i != BUCKET_ARRAY_SIZE; ++i) {
-    if (!IsOccupied(i)) {
-      if (tombstone == BUCKET_ARRAY_SIZE) {
-        SetOccupied(i);
-        tombstone = i;
-      }
-      break;
-    }
-    if (!IsReadable(i)) {
-      tombstone = i;
-      continue;
-    }
-    // key-value already exist
-    if (cmp(array_[i].first, key) == 0 && array_[i].second == value) {
-      LOG_ERROR("HASH_TABLE_BUCKET_TYPE::Insert duplicated key-value");
-      return CODE_DUP;
-    }
+auto HASH_TABLE_BUCKET_TYPE::Insert2(KeyType key, ValueType value, uint8_t tag, KeyComparator cmp, uint32_t *slot)
+    -> uint8_t {
+  uint32_t end = OccupiedEnd();
+  bool duplicate = false;
+  ForEachTagMatch(tag, end, [&](uint32_t i) {
+    duplicate = IsReadable(i) && cmp(array_[i].first, key) == 0 && array_[i].second == value;
+    return !duplicate;
+  });
+  // key-value already exist
+  if (duplicate) {
+    LOG_ERROR("HASH_TABLE_BUCKET_TYPE::Insert duplicated key-value");
+    return CODE_DUP;
+  }
+  uint32_t free = 0;
+  while (free < end && readable_[free / 8] == 0xff) {
+    free += 8;
+  }
+  while (free < end && IsReadable(free)) {
+    ++free;
   }
+  free = std::min(free, end);
   // bucket is full
-  if (tombstone == BUCKET_ARRAY_SIZE) {
-    // LOG_DEBUG("HASH_TABLE_BUCKET_TYPE::Insert bucket is full");
+  if (free == BUCKET_ARRAY_SIZE) {
     return CODE_FULL;
   }
-  array_[tombstone] = MappingType(key, value);
-  SetReadable(tombstone);
+  if (free == end) {
+    SetOccupied(free);
+  }
+  array_[free] = MappingType(key, value);
+  tags_[free] = tag;
+  SetReadable(free);
+  if (slot != nullptr) {
+    *slot = free;
+  }
   return CODE_OK;
 }
 
 template <typename KeyType, typename ValueType, typename KeyComparator>
-auto HASH_TABLE_BUCKET_TYPE::Remove(KeyType key, ValueType value, KeyComparator cmp) -> bool {
-  for (uint32_t i = 0; i != BUCKET_ARRAY_SIZE; ++i) {
-    if (!IsOccupied(i)) {
-      break;
-    }
-    if (!IsReadable(i)) {
-      continue;
-    }
-    if (cmp(array_[i].first, key) == 0 && array_[i].second == value) {
+auto HASH_TABLE_BUCKET_TYPE::Insert2(KeyType key, ValueType value, KeyComparator cmp) -> uint8_t {
+  return Insert2(key, value, TagOf(HashFunction<KeyType>().GetHash(key)), cmp);
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+auto HASH_TABLE_BUCKET_TYPE::Remove(KeyType key, ValueType value, uint8_t tag, KeyComparator cmp, uint32_t *slot)
+    -> bool {
+  bool removed = false;
+  ForEachTagMatch(tag, OccupiedEnd(), [&](uint32_t i) {
+    if (IsReadable(i) && cmp(array_[i].first, key) == 0 && array_[i].second == value) {
       RemoveAt(i);
-      return true;
+      if (slot != nullptr) {
+        *slot = i;
+      }
+      removed = true;
     }
-  }
-  return false;
+    return !removed;
+  });
+  return removed;
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+auto HASH_TABLE_BUCKET_TYPE::Remove(KeyType key, ValueType value, KeyComparator cmp) -> bool {
+  return Remove(key, value, TagOf(HashFunction<KeyType>().GetHash(key)), cmp);
 }
 
 template <typename KeyType, typename ValueType, typename KeyComparator>
@@ -176,6 +208,89 @@ void HASH_TABLE_BUCKET_TYPE::PrintBucket() {
   LOG_INFO("Bucket Capacity: %lu, Size: %u, Taken: %u, Free: %u", BUCKET_ARRAY_SIZE, size, taken, free);
 }
 
+template <typename KeyType, typename ValueType, typename KeyComparator>
+auto HASH_TABLE_BUCKET_TYPE::GetLSN() const -> lsn_t {
+  return lsn_;
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+void HASH_TABLE_BUCKET_TYPE::SetLSN(lsn_t lsn) {
+  lsn_ = lsn;
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+auto HASH_TABLE_BUCKET_TYPE::GetLayout() const -> HashBucketLayout {
+  static_assert(sizeof(HASH_TABLE_BUCKET_TYPE) <= PAGE_SIZE, "bucket page does not fit into a page");
+  const auto *base = reinterpret_cast<const char *>(this);
+  HashBucketLayout layout;
+  layout.array_size_ = BUCKET_ARRAY_SIZE;
+  layout.occupied_offset_ = reinterpret_cast<const char *>(occupied_) - base;
+  layout.readable_offset_ = reinterpret_cast<const char *>(readable_) - base;
+  layout.tags_offset_ = reinterpret_cast<const char *>(tags_) - base;
+  layout.array_offset_ = reinterpret_cast<const char *>(array_) - base;
+  layout.pair_size_ = sizeof(MappingType);
+  layout.key_size_ = sizeof(KeyType);
+  return layout;
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+auto HASH_TABLE_BUCKET_TYPE::SlotImageAt(uint32_t bucket_idx) const -> HashSlotImage {
+  return HashSlotImage(GetLayout(), bucket_idx, reinterpret_cast<const char *>(&array_[bucket_idx]),
+                       tags_[bucket_idx]);
+}
+
+template <typename KeyType, typename ValueType, typename KeyComparator>
+auto HASH_TABLE_BUCKET_TYPE::OccupiedEnd() const -> uint32_t {
+  uint32_t byte = 0;
+  while (byte != sizeof(occupied_) && occupied_[byte] == 0xff) {
+    ++byte;
+  }
+  uint32_t end = byte * 8;
+  if (byte != sizeof(occupied_)) {
+    // the leading ones of the last byte
+    end += __builtin_clz(static_cast<uint32_t>(static_cast<uint8_t>(~occupied_[byte]))) - 24;
+  }
+  return std::min<uint32_t>(end, BUCKET_ARRAY_SIZE);
+}
+
+/*
+ * 32 tags at a time with AVX2 and 16 with SSE2, whichever the build targets, and the rest one by one.
+ */
+template <typename KeyType, typename ValueType, typename KeyComparator>
+template <typename F>
+void HASH_TABLE_BUCKET_TYPE::ForEachTagMatch(uint8_t tag, uint32_t end, F &&f) const {
+  uint32_t i = 0;
+#ifdef __AVX2__
+  const __m256i wide_needle = _mm256_set1_epi8(static_cast<char>(tag));
+  for (; i + 32 <= end; i += 32) {
+    __m256i tags = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(tags_ + i));
+    auto matches = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(tags, wide_needle)));
+    for (; matches != 0; matches &= matches - 1) {
+      if (!f(i + __builtin_ctz(matches))) {
+        return;
+      }
+    }
+  }
+#endif
+#ifdef __SSE2__
+  const __m128i needle = _mm_set1_epi8(static_cast<char>(tag));
+  for (; i + 16 <= end; i += 16) {
+    __m128i tags = _mm_loadu_si128(reinterpret_cast<const __m128i *>(tags_ + i));
+    auto matches = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(tags, needle)));
+    for (; matches != 0; matches &= matches - 1) {
+      if (!f(i + __builtin_ctz(matches))) {
+        return;
+      }
+    }
+  }
+#endif
+  for (; i < end; ++i) {
+    if (tags_[i] == tag && !f(i)) {
+      return;
+    }
+  }
+}
+
 // DO NOT REMOVE ANYTHING BELOW THIS LINE
 template class HashTableBucketPage<int, int, IntComparator>;
 
@@ -57,6 +57,8 @@ void HashTableDirectoryPage::DecrGlobalDepth() {
   global_depth_ >>= 1;
 }
 
+void HashTableDirectoryPage::SetGlobalDepth(uint32_t global_depth) { global_depth_ = (1U << global_depth) - 1; }
+
 auto HashTableDirectoryPage::GetBucketPageId(uint32_t bucket_idx) -> page_id_t { return bucket_page_ids_[bucket_idx]; }
 
 void HashTableDirectoryPage::SetBucketPageId(uint32_t bucket_idx, page_id_t bucket_page_id) {
@@ -88,6 +90,19 @@ void HashTableDirectoryPage::IncrLocalDepth(uint32_t bucket_idx) { local_depths_
 
 void HashTableDirectoryPage::DecrLocalDepth(uint32_t bucket_idx) { local_depths_[bucket_idx] -= 1; }
 
+auto HashTableDirectoryPage::GetSegmentPageId(uint32_t segment) -> page_id_t {
+  assert(segment > 0 && segment < DIRECTORY_SEGMENT_COUNT);
+  return segment_page_ids_[segment];
+}
+
+void HashTableDirectoryPage::SetSegmentPageId(uint32_t segment, page_id_t segment_page_id) {
+  assert(segment > 0 && segment < DIRECTORY_SEGMENT_COUNT);
+  segment_page_ids_[segment] = segment_page_id;
+  segment_count_ = std::max(segment_count_, segment);
+}
+
+auto HashTableDirectoryPage::GetSegmentCount() -> uint32_t { return segment_count_ + 1; }
+
 auto HashTableDirectoryPage::GetLocalHighBit(uint32_t bucket_idx) -> uint32_t { return 0; }
 
 /**
@@ -145,7 +160,7 @@ void HashTableDirectoryPage::VerifyIntegrity() {
 void HashTableDirectoryPage::PrintDirectory() {
   LOG_DEBUG("======== DIRECTORY (global_depth_: %u) ========", GetGlobalDepth());
   LOG_DEBUG("| bucket_idx | page_id | local_depth |");
-  for (uint32_t idx = 0; idx < static_cast<uint32_t>(0x1 << GetGlobalDepth()); idx++) {
+  for (uint32_t idx = 0; idx < std::min<uint32_t>(Size(), DIRECTORY_ARRAY_SIZE); idx++) {
     LOG_DEBUG("|      %u     |     %u     |     %u     |", idx, bucket_page_ids_[idx], local_depths_[idx]);
   }
   LOG_DEBUG("================ END DIRECTORY ================");
@@ -13,6 +13,7 @@
 #include "storage/page/table_page.h"
 
 #include <cassert>
+#include <utility>
 
 namespace bustub {
 
@@ -172,8 +173,21 @@ auto TablePage::UpdateTuple(const Tuple &new_tuple, Tuple *old_tuple, const RID
     } else if (!txn->IsExclusiveLocked(rid) && !lock_manager->LockExclusive(txn, rid)) {
       return false;
     }
-    LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(), LogRecordType::UPDATE, rid, *old_tuple, new_tuple);
-    lsn_t lsn = log_manager->AppendLogRecord(&log_record);
+    lsn_t lsn;
+    // A same-size update is logged as the changed byte ranges only, unless the delta is no smaller.
+    TupleDelta delta;
+    if (new_tuple.size_ == tuple_size) {
+      delta = TupleDelta(*old_tuple, new_tuple);
+    }
+    if (new_tuple.size_ == tuple_size && delta.GetSerializedSize() < 2 * sizeof(int32_t) + 2 * tuple_size) {
+      LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(), LogRecordType::DELTAUPDATE, rid,
+                           std::move(delta));
+      lsn = log_manager->AppendLogRecord(&log_record);
+    } else {
+      LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(), LogRecordType::UPDATE, rid, *old_tuple,
+                           new_tuple);
+      lsn = log_manager->AppendLogRecord(&log_record);
+    }
     SetLSN(lsn);
     txn->SetPrevLSN(lsn);
   }
@@ -198,6 +212,53 @@ auto TablePage::UpdateTuple(const Tuple &new_tuple, Tuple *old_tuple, const RID
   return true;
 }
 
+void TablePage::ApplyTupleDelta(const RID &rid, const TupleDelta &delta, bool undo) {
+  uint32_t slot_num = rid.GetSlotNum();
+  BUSTUB_ASSERT(slot_num < GetTupleCount(), "Cannot have more slots than tuples.");
+  BUSTUB_ASSERT(UnsetDeletedFlag(GetTupleSize(slot_num)) == delta.GetTupleSize(), "Delta does not fit the tuple.");
+  delta.ApplyTo(GetData() + GetTupleOffsetAtSlot(slot_num), undo);
+}
+
+auto TablePage::IncrementTuple(const RID &rid, const TupleIncrement &increment, bool undo, Transaction *txn,
+                               LockManager *lock_manager, LogManager *log_manager) -> bool {
+  uint32_t slot_num = rid.GetSlotNum();
+  // If the slot number is invalid or the tuple is deleted, abort the transaction.
+  if (slot_num >= GetTupleCount() || IsDeleted(GetTupleSize(slot_num))) {
+    BUSTUB_ASSERT(!undo, "Cannot take back an increment of a tuple that is gone.");
+    if (enable_logging) {
+      txn->SetState(TransactionState::ABORTED);
+    }
+    return false;
+  }
+  // An increment lock is enough, a shared lock held is upgraded to exclusive.
+  if (enable_logging && !txn->IsIncrementLocked(rid) && !txn->IsExclusiveLocked(rid) &&
+      !lock_manager->LockIncrement(txn, rid)) {
+    return false;
+  }
+  char *tuple_data = GetData() + GetTupleOffsetAtSlot(slot_num);
+  if (!undo && !increment.Fits(tuple_data)) {
+    return false;
+  }
+
+  if (enable_logging) {
+    // the undo is logged as the inverse increment, redone like any other
+    LogRecord log_record(txn->GetTransactionId(), txn->GetPrevLSN(), LogRecordType::INCREMENT, rid,
+                         undo ? increment.Inverse() : increment);
+    lsn_t lsn = log_manager->AppendLogRecord(&log_record);
+    SetLSN(lsn);
+    txn->SetPrevLSN(lsn);
+  }
+
+  increment.ApplyTo(tuple_data, undo);
+  return true;
+}
+
+void TablePage::ApplyTupleIncrement(const RID &rid, const TupleIncrement &increment, bool undo) {
+  uint32_t slot_num = rid.GetSlotNum();
+  BUSTUB_ASSERT(slot_num < GetTupleCount(), "Cannot have more slots than tuples.");
+  increment.ApplyTo(GetData() + GetTupleOffsetAtSlot(slot_num), undo);
+}
+
 void TablePage::ApplyDelete(const RID &rid, Transaction *txn, LogManager *log_manager) {
   uint32_t slot_num = rid.GetSlotNum();
   BUSTUB_ASSERT(slot_num < GetTupleCount(), "Cannot have more slots than tuples.");
@@ -306,6 +367,24 @@ auto TablePage::GetTuple(const RID &rid, Tuple *tuple, Transaction *txn, LockMan
   return true;
 }
 
+auto TablePage::CopyTuple(const RID &rid, Tuple *tuple) -> bool {
+  uint32_t slot_num = rid.GetSlotNum();
+  if (slot_num >= GetTupleCount() || IsDeleted(GetTupleSize(slot_num))) {
+    return false;
+  }
+  uint32_t tuple_size = GetTupleSize(slot_num);
+  uint32_t tuple_offset = GetTupleOffsetAtSlot(slot_num);
+  tuple->size_ = tuple_size;
+  if (tuple->allocated_) {
+    delete[] tuple->data_;
+  }
+  tuple->data_ = new char[tuple->size_];
+  memcpy(tuple->data_, GetData() + tuple_offset, tuple->size_);
+  tuple->rid_ = rid;
+  tuple->allocated_ = true;
+  return true;
+}
+
 auto TablePage::GetFirstTupleRid(RID *first_rid) -> bool {
   // Find and return the first valid tuple.
   for (uint32_t i = 0; i < GetTupleCount(); ++i) {
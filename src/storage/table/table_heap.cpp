@@ -10,6 +10,7 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include <algorithm>
 #include <cassert>
 
 #include "common/logger.h"
@@ -36,7 +37,16 @@ TableHeap::TableHeap(BufferPoolManager *buffer_pool_manager, LockManager *lock_m
   buffer_pool_manager_->UnpinPage(first_page_id_, true);
 }
 
+/** A read-only transaction has no write set, it is aborted before it writes. */
+static void AbortIfReadOnly(Transaction *txn) {
+  if (txn->IsReadOnly()) {
+    txn->SetState(TransactionState::ABORTED);
+    throw TransactionAbortException(txn->GetTransactionId(), AbortReason::WRITE_ON_READ_ONLY);
+  }
+}
+
 auto TableHeap::InsertTuple(const Tuple &tuple, RID *rid, Transaction *txn) -> bool {
+  AbortIfReadOnly(txn);
   if (tuple.size_ + 32 > PAGE_SIZE) {  // larger than one page size
     txn->SetState(TransactionState::ABORTED);
     return false;
@@ -81,6 +91,7 @@ auto TableHeap::InsertTuple(const Tuple &tuple, RID *rid, Transaction *txn) -> b
       cur_page = new_page;
     }
   }
+  PushVersion(*rid, txn, false, Tuple{});
   // This line has caused most of us to double-take and "whoa double unlatch".
   // We are not, in fact, double unlatching. See the invariant above.
   cur_page->WUnlatch();
@@ -91,6 +102,7 @@ auto TableHeap::InsertTuple(const Tuple &tuple, RID *rid, Transaction *txn) -> b
 }
 
 auto TableHeap::MarkDelete(const RID &rid, Transaction *txn) -> bool {
+  AbortIfReadOnly(txn);
   // TODO(Amadou): remove empty page
   // Find the page which contains the tuple.
   auto page = reinterpret_cast<TablePage *>(buffer_pool_manager_->FetchPage(rid.GetPageId()));
@@ -101,7 +113,11 @@ auto TableHeap::MarkDelete(const RID &rid, Transaction *txn) -> bool {
   }
   // Otherwise, mark the tuple as deleted.
   page->WLatch();
-  page->MarkDelete(rid, txn, lock_manager_, log_manager_);
+  Tuple old_tuple;
+  bool present = page->CopyTuple(rid, &old_tuple);
+  if (page->MarkDelete(rid, txn, lock_manager_, log_manager_) && present) {
+    PushVersion(rid, txn, true, old_tuple);
+  }
   page->WUnlatch();
   buffer_pool_manager_->UnpinPage(page->GetTablePageId(), true);
   // Update the transaction's write set.
@@ -110,6 +126,7 @@ auto TableHeap::MarkDelete(const RID &rid, Transaction *txn) -> bool {
 }
 
 auto TableHeap::UpdateTuple(const Tuple &tuple, const RID &rid, Transaction *txn) -> bool {
+  AbortIfReadOnly(txn);
   // Find the page which contains the tuple.
   auto page = reinterpret_cast<TablePage *>(buffer_pool_manager_->FetchPage(rid.GetPageId()));
   // If the page could not be found, then abort the transaction.
@@ -121,6 +138,10 @@ auto TableHeap::UpdateTuple(const Tuple &tuple, const RID &rid, Transaction *txn
   Tuple old_tuple;
   page->WLatch();
   bool is_updated = page->UpdateTuple(tuple, &old_tuple, rid, txn, lock_manager_, log_manager_);
+  // a rollback restores the version before the change instead, see RollbackVersion
+  if (is_updated && txn->GetState() != TransactionState::ABORTED) {
+    PushVersion(rid, txn, true, old_tuple);
+  }
   page->WUnlatch();
   buffer_pool_manager_->UnpinPage(page->GetTablePageId(), is_updated);
   // Update the transaction's write set.
@@ -130,6 +151,41 @@ auto TableHeap::UpdateTuple(const Tuple &tuple, const RID &rid, Transaction *txn
   return is_updated;
 }
 
+auto TableHeap::IncrementTuple(const TupleIncrement &increment, const RID &rid, Transaction *txn) -> bool {
+  AbortIfReadOnly(txn);
+  auto page = reinterpret_cast<TablePage *>(buffer_pool_manager_->FetchPage(rid.GetPageId()));
+  if (page == nullptr) {
+    txn->SetState(TransactionState::ABORTED);
+    return false;
+  }
+  page->WLatch();
+  bool is_incremented = page->IncrementTuple(rid, increment, false, txn, lock_manager_, log_manager_);
+  if (is_incremented) {
+    PushIncrement(rid, txn, increment);
+  }
+  page->WUnlatch();
+  buffer_pool_manager_->UnpinPage(page->GetTablePageId(), is_incremented);
+  // Update the transaction's write set.
+  if (is_incremented) {
+    txn->GetWriteSet()->emplace_back(rid, increment, this);
+  }
+  return is_incremented;
+}
+
+/*
+ * The undo record goes under the page latch, along with the increment: a snapshot read in between would take the
+ * increment out twice.
+ */
+void TableHeap::RollbackIncrement(const TupleIncrement &increment, const RID &rid, Transaction *txn) {
+  auto page = reinterpret_cast<TablePage *>(buffer_pool_manager_->FetchPage(rid.GetPageId()));
+  BUSTUB_ASSERT(page != nullptr, "Couldn't find a page containing that RID.");
+  page->WLatch();
+  page->IncrementTuple(rid, increment, true, txn, lock_manager_, log_manager_);
+  RollbackVersion(rid, txn);
+  page->WUnlatch();
+  buffer_pool_manager_->UnpinPage(page->GetTablePageId(), true);
+}
+
 void TableHeap::ApplyDelete(const RID &rid, Transaction *txn) {
   // Find the page which contains the tuple.
   auto page = reinterpret_cast<TablePage *>(buffer_pool_manager_->FetchPage(rid.GetPageId()));
@@ -163,7 +219,18 @@ auto TableHeap::GetTuple(const RID &rid, Tuple *tuple, Transaction *txn) -> bool
   }
   // Read the tuple from the page.
   page->RLatch();
-  bool res = page->GetTuple(rid, tuple, txn, lock_manager_);
+  bool res;
+  if (txn->IsSnapshotRead()) {
+    // rid may alias tuple->rid_, which reading a version overwrites
+    RID tuple_rid = rid;
+    res = ReadVersion(tuple_rid, txn, tuple, page->CopyTuple(tuple_rid, tuple));
+    if (txn->GetIsolationLevel() == IsolationLevel::OPTIMISTIC && !txn->IsReadOnly()) {
+      // an empty slot is recorded too, an insert into it is a change
+      txn->GetReadSet()->emplace_back(tuple_rid, this);
+    }
+  } else {
+    res = page->GetTuple(rid, tuple, txn, lock_manager_);
+  }
   page->RUnlatch();
   buffer_pool_manager_->UnpinPage(rid.GetPageId(), false);
   return res;
@@ -186,9 +253,105 @@ auto TableHeap::Begin(Transaction *txn) -> TableIterator {
     }
     page_id = page->GetNextPageId();
   }
+  if (txn->IsSnapshotRead()) {
+    // deleted tuples may still be visible to the snapshot, the iterator walks every slot
+    return {this, RID(first_page_id_, 0), txn};
+  }
   return {this, rid, txn};
 }
 
 auto TableHeap::End() -> TableIterator { return {this, RID(INVALID_PAGE_ID, 0), nullptr}; }
 
+void TableHeap::RollbackVersion(const RID &rid, Transaction *txn) {
+  std::lock_guard lk(version_latch_);
+  auto chain = versions_.find(rid);
+  if (chain == versions_.end()) {
+    return;
+  }
+  // an increment of another transaction may have been applied since
+  auto own = std::find_if(chain->second.begin(), chain->second.end(),
+                          [&](const TupleUndo &undo) { return undo.txn_id_ == txn->GetTransactionId(); });
+  if (own != chain->second.end()) {
+    chain->second.erase(own);
+  }
+  if (chain->second.empty()) {
+    versions_.erase(chain);
+  }
+}
+
+/*
+ * A snapshot read stops at the first change it sees, so that change and all older ones are not needed by any snapshot
+ * that sees it, i.e. by any snapshot at or after the watermark. An increment that every snapshot sees is skipped by
+ * all of them.
+ */
+void TableHeap::PruneVersions(const RID &rid, timestamp_t watermark) {
+  std::lock_guard lk(version_latch_);
+  auto chain = versions_.find(rid);
+  if (chain == versions_.end()) {
+    return;
+  }
+  auto &undos = chain->second;
+  auto seen_by_all = [watermark](const TupleUndo &undo) {
+    timestamp_t commit_ts = undo.commit_ts_->load();
+    return commit_ts != INVALID_TIMESTAMP && commit_ts <= watermark;
+  };
+  auto seen = std::find_if(undos.begin(), undos.end(),
+                           [&](const TupleUndo &undo) { return !undo.increment_.has_value() && seen_by_all(undo); });
+  undos.erase(seen, undos.end());
+  undos.erase(std::remove_if(undos.begin(), undos.end(), seen_by_all), undos.end());
+  if (undos.empty()) {
+    versions_.erase(chain);
+  }
+}
+
+auto TableHeap::IsChangedSince(const RID &rid, Transaction *txn) -> bool {
+  std::lock_guard lk(version_latch_);
+  auto chain = versions_.find(rid);
+  return chain != versions_.end() && std::any_of(chain->second.begin(), chain->second.end(),
+                                                 [txn](const TupleUndo &undo) { return !IsVisible(undo, txn); });
+}
+
+auto TableHeap::IsVisible(const TupleUndo &undo, Transaction *txn) -> bool {
+  if (undo.txn_id_ == txn->GetTransactionId()) {
+    return true;
+  }
+  timestamp_t commit_ts = undo.commit_ts_->load();
+  return commit_ts != INVALID_TIMESTAMP && commit_ts <= txn->GetReadTimestamp();
+}
+
+void TableHeap::PushVersion(const RID &rid, Transaction *txn, bool present, const Tuple &tuple) {
+  std::lock_guard lk(version_latch_);
+  versions_[rid].push_front({txn->GetTransactionId(), txn->GetCommitTimestamp(), present, tuple, std::nullopt});
+}
+
+void TableHeap::PushIncrement(const RID &rid, Transaction *txn, const TupleIncrement &increment) {
+  std::lock_guard lk(version_latch_);
+  versions_[rid].push_front({txn->GetTransactionId(), txn->GetCommitTimestamp(), true, Tuple{}, increment});
+}
+
+auto TableHeap::ReadVersion(const RID &rid, Transaction *txn, Tuple *tuple, bool present) -> bool {
+  std::lock_guard lk(version_latch_);
+  auto chain = versions_.find(rid);
+  if (chain == versions_.end()) {
+    return present;
+  }
+  for (const TupleUndo &undo : chain->second) {
+    if (undo.increment_.has_value()) {
+      if (present && !IsVisible(undo, txn)) {
+        undo.increment_->ApplyTo(tuple->data_, true);
+      }
+      continue;
+    }
+    if (IsVisible(undo, txn)) {
+      break;
+    }
+    present = undo.present_;
+    if (present) {
+      *tuple = undo.tuple_;
+      tuple->rid_ = rid;
+    }
+  }
+  return present;
+}
+
 }  // namespace bustub
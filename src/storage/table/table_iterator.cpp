@@ -19,7 +19,9 @@ namespace bustub {
 TableIterator::TableIterator(TableHeap *table_heap, RID rid, Transaction *txn)
     : table_heap_(table_heap), tuple_(new Tuple(rid)), txn_(txn) {
   if (rid.GetPageId() != INVALID_PAGE_ID) {
-    table_heap_->GetTuple(tuple_->rid_, tuple_, txn_);
+    if (!table_heap_->GetTuple(tuple_->rid_, tuple_, txn_) && IsSnapshotScan()) {
+      NextVisibleSlot();
+    }
   }
 }
 
@@ -34,6 +36,10 @@ auto TableIterator::operator->() -> Tuple * {
 }
 
 auto TableIterator::operator++() -> TableIterator & {
+  if (IsSnapshotScan()) {
+    NextVisibleSlot();
+    return *this;
+  }
   BufferPoolManager *buffer_pool_manager = table_heap_->buffer_pool_manager_;
   auto cur_page = static_cast<TablePage *>(buffer_pool_manager->FetchPage(tuple_->rid_.GetPageId()));
   cur_page->RLatch();
@@ -64,6 +70,31 @@ auto TableIterator::operator++() -> TableIterator & {
   return *this;
 }
 
+void TableIterator::NextVisibleSlot() {
+  BufferPoolManager *buffer_pool_manager = table_heap_->buffer_pool_manager_;
+  page_id_t page_id = tuple_->rid_.GetPageId();
+  uint32_t slot = tuple_->rid_.GetSlotNum() + 1;
+  while (page_id != INVALID_PAGE_ID) {
+    auto page = static_cast<TablePage *>(buffer_pool_manager->FetchPage(page_id));
+    assert(page != nullptr);
+    page->RLatch();
+    // slots appended after this belong to inserts the snapshot does not see
+    uint32_t slot_count = page->GetSlotCount();
+    page_id_t next_page_id = page->GetNextPageId();
+    page->RUnlatch();
+    buffer_pool_manager->UnpinPage(page_id, false);
+    for (; slot < slot_count; ++slot) {
+      tuple_->rid_.Set(page_id, slot);
+      if (table_heap_->GetTuple(tuple_->rid_, tuple_, txn_)) {
+        return;
+      }
+    }
+    page_id = next_page_id;
+    slot = 0;
+  }
+  tuple_->rid_.Set(INVALID_PAGE_ID, 0);
+}
+
 auto TableIterator::operator++(int) -> TableIterator {
   TableIterator clone(*this);
   ++(*this);
@@ -2,6 +2,8 @@
  * lock_manager_test.cpp
  */
 
+#include <atomic>
+#include <memory>
 #include <random>
 #include <thread>  // NOLINT
 
@@ -326,6 +328,438 @@ void WoundWaitBasicTest() {
 }
 TEST(LockManagerTest, WoundWaitBasicTest) { WoundWaitBasicTest(); }
 
+// The wounded transaction is blocked on a record of another shard than the one its wounder locks.
+void WoundBlockedTest(size_t num_shards) {
+  LockManager lock_mgr{num_shards};
+  TransactionManager txn_mgr{&lock_mgr};
+  RID rid_wound{0, 0};
+  RID rid_block{7, 3};
+
+  Transaction txn_old(0);
+  Transaction txn_hold(1);
+  Transaction txn_die(2);
+  txn_mgr.Begin(&txn_old);
+  txn_mgr.Begin(&txn_die);
+  txn_mgr.Begin(&txn_hold);
+  EXPECT_TRUE(lock_mgr.LockExclusive(&txn_die, rid_wound));
+  EXPECT_TRUE(lock_mgr.LockExclusive(&txn_hold, rid_block));
+
+  std::thread die_thread{[&] {
+    // younger than the holder, so it waits
+    EXPECT_FALSE(lock_mgr.LockExclusive(&txn_die, rid_block));
+    CheckAborted(&txn_die);
+    txn_mgr.Abort(&txn_die);
+  }};
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  // wounds txn_die, which has to give up waiting for rid_block and release rid_wound
+  EXPECT_TRUE(lock_mgr.LockExclusive(&txn_old, rid_wound));
+  die_thread.join();
+
+  txn_mgr.Commit(&txn_old);
+  txn_mgr.Commit(&txn_hold);
+  CheckCommitted(&txn_old);
+  CheckCommitted(&txn_hold);
+}
+
+TEST(LockManagerTest, WoundBlockedTest) {
+  WoundBlockedTest(1);
+  WoundBlockedTest(LOCK_TABLE_SHARDS);
+}
+
+void TableLockTest() {
+  using LockMode = LockManager::LockMode;
+  LockManager lock_mgr{};
+  TransactionManager txn_mgr{&lock_mgr};
+  table_oid_t oid = 0;
+
+  Transaction txn0(0);
+  Transaction txn1(1);
+  Transaction txn2(2);
+  txn_mgr.Begin(&txn0);
+  txn_mgr.Begin(&txn1);
+  txn_mgr.Begin(&txn2);
+
+  // a scan and a point reader share the table
+  EXPECT_TRUE(lock_mgr.LockTable(&txn1, LockMode::SHARED, oid));
+  EXPECT_TRUE(lock_mgr.LockTable(&txn2, LockMode::INTENTION_SHARED, oid));
+  // a held lock covers weaker requests
+  EXPECT_TRUE(lock_mgr.LockTable(&txn1, LockMode::INTENTION_SHARED, oid));
+  EXPECT_EQ(LockManager::GetTableLockMode(&txn1, oid), LockMode::SHARED);
+
+  // S and IX make SIX, which is compatible with the reader's IS
+  EXPECT_TRUE(lock_mgr.LockTable(&txn1, LockMode::INTENTION_EXCLUSIVE, oid));
+  EXPECT_EQ(LockManager::GetTableLockMode(&txn1, oid), LockMode::SHARED_INTENTION_EXCLUSIVE);
+  EXPECT_EQ(txn1.GetSharedTableLockSet()->size(), 0);
+  EXPECT_EQ(txn1.GetSharedIntentionExclusiveTableLockSet()->size(), 1);
+  CheckGrowing(&txn2);
+
+  // the oldest transaction wounds both
+  EXPECT_TRUE(lock_mgr.LockTable(&txn0, LockMode::INTENTION_SHARED, oid));
+  std::thread exclusive{[&] { EXPECT_TRUE(lock_mgr.LockTable(&txn0, LockMode::EXCLUSIVE, oid)); }};
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  CheckAborted(&txn1);
+  CheckAborted(&txn2);
+  txn_mgr.Abort(&txn1);
+  txn_mgr.Abort(&txn2);
+  exclusive.join();
+  EXPECT_EQ(LockManager::GetTableLockMode(&txn0, oid), LockMode::EXCLUSIVE);
+  EXPECT_FALSE(LockManager::GetTableLockMode(&txn1, oid).has_value());
+
+  txn_mgr.Commit(&txn0);
+  CheckCommitted(&txn0);
+  EXPECT_FALSE(LockManager::GetTableLockMode(&txn0, oid).has_value());
+}
+TEST(LockManagerTest, TableLockTest) { TableLockTest(); }
+
+void EscalationTest() {
+  using LockMode = LockManager::LockMode;
+  LockManager lock_mgr{};
+  TransactionManager txn_mgr{&lock_mgr};
+  auto saved_threshold = lock_escalation_threshold;
+  lock_escalation_threshold = 4;
+  table_oid_t oid = 0;
+
+  Transaction txn_write(0);
+  txn_mgr.Begin(&txn_write);
+  EXPECT_TRUE(lock_mgr.LockTable(&txn_write, LockMode::INTENTION_EXCLUSIVE, oid));
+  for (uint32_t i = 0; i < 3; i++) {
+    EXPECT_TRUE(lock_mgr.LockExclusive(&txn_write, RID{0, i}, oid));
+  }
+  // a record locked without its table does not count
+  EXPECT_TRUE(lock_mgr.LockShared(&txn_write, RID{1, 0}));
+  CheckTxnLockSize(&txn_write, 1, 3);
+  EXPECT_EQ(LockManager::GetTableLockMode(&txn_write, oid), LockMode::INTENTION_EXCLUSIVE);
+
+  // the fourth record escalates IX to X and releases the records of the table
+  EXPECT_TRUE(lock_mgr.LockExclusive(&txn_write, RID{0, 3}, oid));
+  EXPECT_EQ(LockManager::GetTableLockMode(&txn_write, oid), LockMode::EXCLUSIVE);
+  CheckTxnLockSize(&txn_write, 1, 0);
+  CheckGrowing(&txn_write);
+  // further records of the table are covered
+  EXPECT_TRUE(lock_mgr.LockExclusive(&txn_write, RID{0, 4}, oid));
+  CheckTxnLockSize(&txn_write, 1, 0);
+
+  // shared records under IS escalate to S
+  Transaction txn_read(1);
+  txn_mgr.Begin(&txn_read);
+  table_oid_t other_oid = 1;
+  EXPECT_TRUE(lock_mgr.LockTable(&txn_read, LockMode::INTENTION_SHARED, other_oid));
+  for (uint32_t i = 0; i < 4; i++) {
+    EXPECT_TRUE(lock_mgr.LockShared(&txn_read, RID{2, i}, other_oid));
+  }
+  EXPECT_EQ(LockManager::GetTableLockMode(&txn_read, other_oid), LockMode::SHARED);
+  CheckTxnLockSize(&txn_read, 0, 0);
+
+  txn_mgr.Commit(&txn_write);
+  txn_mgr.Commit(&txn_read);
+  CheckTxnLockSize(&txn_write, 0, 0);
+  EXPECT_FALSE(LockManager::GetTableLockMode(&txn_write, oid).has_value());
+  lock_escalation_threshold = saved_threshold;
+}
+TEST(LockManagerTest, EscalationTest) { EscalationTest(); }
+
+TEST(LockManagerTest, TableLockCompatibilityTest) {
+  using LockMode = LockManager::LockMode;
+  const LockMode modes[] = {LockMode::INTENTION_SHARED, LockMode::INTENTION_EXCLUSIVE, LockMode::SHARED,
+                            LockMode::SHARED_INTENTION_EXCLUSIVE, LockMode::EXCLUSIVE};
+  const bool compatible[5][5] = {{true, true, true, true, false},
+                                 {true, true, false, false, false},
+                                 {true, false, true, false, false},
+                                 {true, false, false, false, false},
+                                 {false, false, false, false, false}};
+  for (int i = 0; i < 5; i++) {
+    for (int j = 0; j < 5; j++) {
+      EXPECT_EQ(LockManager::AreCompatible(modes[i], modes[j]), compatible[i][j]);
+    }
+  }
+  EXPECT_EQ(LockManager::Combine(LockMode::SHARED, LockMode::INTENTION_EXCLUSIVE),
+            LockMode::SHARED_INTENTION_EXCLUSIVE);
+  EXPECT_EQ(LockManager::Combine(LockMode::INTENTION_SHARED, LockMode::INTENTION_EXCLUSIVE),
+            LockMode::INTENTION_EXCLUSIVE);
+  EXPECT_EQ(LockManager::Combine(LockMode::SHARED_INTENTION_EXCLUSIVE, LockMode::SHARED),
+            LockMode::SHARED_INTENTION_EXCLUSIVE);
+  EXPECT_EQ(LockManager::Combine(LockMode::EXCLUSIVE, LockMode::INTENTION_SHARED), LockMode::EXCLUSIVE);
+}
+
+// Releasing an exclusive lock grants the shared requests behind it as a group, not the exclusive one behind them.
+void SharedGroupWakeTest() {
+  LockManager lock_mgr{};
+  TransactionManager txn_mgr{&lock_mgr};
+  RID rid{0, 0};
+  std::vector<std::unique_ptr<Transaction>> txns;
+  for (txn_id_t i = 0; i < 5; i++) {
+    txns.emplace_back(std::make_unique<Transaction>(i));
+    txn_mgr.Begin(txns.back().get());
+  }
+  EXPECT_TRUE(lock_mgr.LockExclusive(txns[0].get(), rid));
+
+  std::atomic<int> shared_granted{0};
+  std::atomic<bool> exclusive_granted{false};
+  std::vector<std::thread> threads;
+  for (int i = 1; i <= 3; i++) {
+    threads.emplace_back([&, i] {
+      EXPECT_TRUE(lock_mgr.LockShared(txns[i].get(), rid));
+      ++shared_granted;
+    });
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  threads.emplace_back([&] {
+    EXPECT_TRUE(lock_mgr.LockExclusive(txns[4].get(), rid));
+    exclusive_granted = true;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_EQ(shared_granted, 0);
+
+  txn_mgr.Commit(txns[0].get());
+  while (shared_granted != 3) {
+    std::this_thread::yield();
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_FALSE(exclusive_granted);
+
+  for (int i = 1; i <= 3; i++) {
+    txn_mgr.Commit(txns[i].get());
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_TRUE(exclusive_granted);
+  txn_mgr.Commit(txns[4].get());
+}
+TEST(LockManagerTest, SharedGroupWakeTest) { SharedGroupWakeTest(); }
+
+// Increment locks are granted to any number of transactions at once; a reader waits for all of them, and an
+// incrementer asking to read the record is upgraded to exclusive.
+void IncrementLockTest() {
+  LockManager lock_mgr{};
+  TransactionManager txn_mgr{&lock_mgr};
+  RID rid{0, 0};
+  std::vector<std::unique_ptr<Transaction>> txns;
+  for (txn_id_t i = 0; i < 4; i++) {
+    txns.emplace_back(std::make_unique<Transaction>(i));
+    txn_mgr.Begin(txns.back().get());
+  }
+  for (int i = 0; i < 3; i++) {
+    EXPECT_TRUE(lock_mgr.LockIncrement(txns[i].get(), rid));
+    EXPECT_TRUE(txns[i]->IsIncrementLocked(rid));
+  }
+
+  std::atomic<bool> shared_granted{false};
+  std::thread reader([&] {
+    EXPECT_TRUE(lock_mgr.LockShared(txns[3].get(), rid));
+    shared_granted = true;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_FALSE(shared_granted);
+
+  txn_mgr.Commit(txns[1].get());
+  txn_mgr.Abort(txns[2].get());
+  EXPECT_TRUE(lock_mgr.LockShared(txns[0].get(), rid));
+  EXPECT_TRUE(txns[0]->IsExclusiveLocked(rid));
+  EXPECT_FALSE(txns[0]->IsIncrementLocked(rid));
+  CheckTxnLockSize(txns[0].get(), 0, 1);
+  EXPECT_FALSE(shared_granted);
+
+  txn_mgr.Commit(txns[0].get());
+  reader.join();
+  EXPECT_TRUE(shared_granted);
+  txn_mgr.Commit(txns[3].get());
+}
+TEST(LockManagerTest, IncrementLockTest) { IncrementLockTest(); }
+
+// A release grants every waiting table lock compatible with the granted ones and with those waiting in front of it.
+void TableGrantOnReleaseTest() {
+  LockManager lock_mgr{};
+  TransactionManager txn_mgr{&lock_mgr};
+  table_oid_t oid = 0;
+  std::vector<std::unique_ptr<Transaction>> txns;
+  for (txn_id_t i = 0; i < 4; i++) {
+    txns.emplace_back(std::make_unique<Transaction>(i));
+    txn_mgr.Begin(txns.back().get());
+  }
+  EXPECT_TRUE(lock_mgr.LockTable(txns[0].get(), LockManager::LockMode::EXCLUSIVE, oid));
+
+  std::atomic<int> granted{0};
+  std::vector<std::thread> threads;
+  auto lock = [&](int i, LockManager::LockMode mode) {
+    threads.emplace_back([&, i, mode] {
+      EXPECT_TRUE(lock_mgr.LockTable(txns[i].get(), mode, oid));
+      granted |= 1 << i;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  };
+  lock(1, LockManager::LockMode::SHARED);
+  lock(2, LockManager::LockMode::INTENTION_EXCLUSIVE);
+  lock(3, LockManager::LockMode::INTENTION_SHARED);
+  EXPECT_EQ(granted, 0);
+
+  // IX waits for the S in front of it, the IS behind it does not
+  lock_mgr.UnlockTable(txns[0].get(), oid);
+  while (granted != 0b1010) {
+    std::this_thread::yield();
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_EQ(granted, 0b1010);
+
+  lock_mgr.UnlockTable(txns[1].get(), oid);
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(granted, 0b1110);
+  for (auto &txn : txns) {
+    txn_mgr.Commit(txn.get());
+  }
+}
+TEST(LockManagerTest, TableGrantOnReleaseTest) { TableGrantOnReleaseTest(); }
+
+// The queues of released locks are reclaimed, including those a wounded waiter leaves.
+TEST(LockManagerTest, QueueReclaimTest) {
+  LockManager lock_mgr{};
+  TransactionManager txn_mgr{&lock_mgr};
+  Transaction txn0(0);
+  Transaction txn1(1);
+  txn_mgr.Begin(&txn0);
+  txn_mgr.Begin(&txn1);
+  EXPECT_TRUE(lock_mgr.LockTable(&txn1, LockManager::LockMode::INTENTION_EXCLUSIVE, 0));
+  for (uint32_t i = 0; i < 100; i++) {
+    EXPECT_TRUE(lock_mgr.LockExclusive(&txn1, RID{0, i}));
+  }
+  EXPECT_EQ(lock_mgr.GetQueueCount(), 101);
+
+  EXPECT_TRUE(lock_mgr.LockExclusive(&txn0, RID{1, 0}));
+  std::thread wounded{[&] { EXPECT_FALSE(lock_mgr.LockShared(&txn1, RID{1, 0})); }};
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_TRUE(lock_mgr.LockExclusive(&txn0, RID{0, 0}));
+  wounded.join();
+  txn_mgr.Abort(&txn1);
+  txn_mgr.Commit(&txn0);
+  EXPECT_EQ(lock_mgr.GetQueueCount(), 0);
+}
+
+// UnlockAll releases the records and tables of every mode at once, grants the waiters and starts shrinking.
+TEST(LockManagerTest, UnlockAllTest) {
+  LockManager lock_mgr{};
+  TransactionManager txn_mgr{&lock_mgr};
+  Transaction txn0(0);
+  Transaction txn1(1);
+  txn_mgr.Begin(&txn0);
+  txn_mgr.Begin(&txn1);
+  EXPECT_TRUE(lock_mgr.LockTable(&txn0, LockManager::LockMode::INTENTION_EXCLUSIVE, 0));
+  EXPECT_TRUE(lock_mgr.LockTable(&txn0, LockManager::LockMode::SHARED, 1));
+  for (uint32_t i = 0; i < 100; i++) {
+    EXPECT_TRUE(lock_mgr.LockShared(&txn0, RID{0, i}));
+  }
+  for (uint32_t i = 100; i < 200; i++) {
+    EXPECT_TRUE(lock_mgr.LockExclusive(&txn0, RID{0, i}));
+  }
+  EXPECT_TRUE(lock_mgr.LockIncrement(&txn0, RID{0, 200}));
+  EXPECT_EQ(lock_mgr.GetQueueCount(), 203);
+
+  std::thread waiting{[&] {
+    EXPECT_TRUE(lock_mgr.LockExclusive(&txn1, RID{0, 150}));
+    EXPECT_TRUE(lock_mgr.LockTable(&txn1, LockManager::LockMode::EXCLUSIVE, 1));
+  }};
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  lock_mgr.UnlockAll(&txn0);
+  waiting.join();
+  EXPECT_EQ(txn0.GetState(), TransactionState::SHRINKING);
+  EXPECT_TRUE(txn0.GetSharedLockSet()->empty());
+  EXPECT_TRUE(txn0.GetExclusiveLockSet()->empty());
+  EXPECT_TRUE(txn0.GetIncrementLockSet()->empty());
+  EXPECT_EQ(LockManager::GetTableLockMode(&txn0, 0), std::nullopt);
+  EXPECT_EQ(LockManager::GetTableLockMode(&txn0, 1), std::nullopt);
+  EXPECT_EQ(lock_mgr.GetQueueCount(), 2);
+
+  txn_mgr.Commit(&txn0);
+  txn_mgr.Commit(&txn1);
+  EXPECT_EQ(lock_mgr.GetQueueCount(), 0);
+}
+
+// Only the requests that wait are counted, on the record they wait for.
+TEST(LockManagerTest, StatsTest) {
+  LockManager lock_mgr{};
+  TransactionManager txn_mgr{&lock_mgr};
+  RID hot{0, 0};
+  RID cold{0, 1};
+  Transaction txn0(0);
+  Transaction txn1(1);
+  Transaction txn2(2);
+  txn_mgr.Begin(&txn0);
+  txn_mgr.Begin(&txn1);
+  txn_mgr.Begin(&txn2);
+  EXPECT_TRUE(lock_mgr.LockExclusive(&txn0, hot));
+  EXPECT_TRUE(lock_mgr.LockShared(&txn2, cold));
+  std::thread waiter{[&] { EXPECT_TRUE(lock_mgr.LockShared(&txn1, hot)); }};
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  // wounds txn2
+  EXPECT_TRUE(lock_mgr.LockExclusive(&txn0, cold));
+  lock_mgr.Unlock(&txn0, hot);
+  waiter.join();
+  EXPECT_THROW(lock_mgr.LockShared(&txn0, RID{0, 2}), TransactionAbortException);
+
+  LockManager::Stats stats = lock_mgr.GetStats();
+  EXPECT_EQ(stats.waits_, 1);
+  EXPECT_GE(stats.max_wait_, std::chrono::milliseconds(40));
+  ASSERT_EQ(stats.hot_rows_.size(), 1);
+  EXPECT_EQ(stats.hot_rows_[0].first, hot);
+  EXPECT_EQ(stats.hot_rows_[0].second.count_, 1);
+  EXPECT_TRUE(stats.hot_tables_.empty());
+  EXPECT_EQ(stats.aborts_[AbortReason::DEADLOCK], 1);
+  EXPECT_EQ(stats.aborts_[AbortReason::LOCK_ON_SHRINKING], 1);
+  txn_mgr.Abort(&txn0);
+  txn_mgr.Commit(&txn1);
+  txn_mgr.Abort(&txn2);
+}
+
+TEST(LockManagerTest, GraphTest) {
+  LockManager lock_mgr{};
+  lock_mgr.AddEdge(0, 1);
+  lock_mgr.AddEdge(1, 2);
+  lock_mgr.AddEdge(3, 0);
+  txn_id_t victim = INVALID_TXN_ID;
+  EXPECT_FALSE(lock_mgr.HasCycle(&victim));
+  lock_mgr.AddEdge(2, 0);
+  EXPECT_TRUE(lock_mgr.HasCycle(&victim));
+  // 3 waits for the cycle but is not part of it
+  EXPECT_EQ(victim, 2);
+  EXPECT_EQ(lock_mgr.GetEdgeList().size(), 4);
+  lock_mgr.RemoveEdge(1, 2);
+  EXPECT_FALSE(lock_mgr.HasCycle(&victim));
+}
+
+// Under deadlock detection an older transaction waits instead of wounding, and a real deadlock aborts the youngest.
+void DeadlockDetectionTest() {
+  auto saved_interval = cycle_detection_interval;
+  cycle_detection_interval = std::chrono::milliseconds(5);
+  LockManager lock_mgr{LOCK_TABLE_SHARDS, LockManager::DeadlockPolicy::DETECTION};
+  TransactionManager txn_mgr{&lock_mgr};
+  RID rid0{0, 0};
+  RID rid1{3, 1};
+
+  Transaction txn0(0);
+  Transaction txn1(1);
+  txn_mgr.Begin(&txn0);
+  txn_mgr.Begin(&txn1);
+  EXPECT_TRUE(lock_mgr.LockExclusive(&txn0, rid0));
+  EXPECT_TRUE(lock_mgr.LockExclusive(&txn1, rid1));
+
+  std::thread old_thread{[&] { EXPECT_TRUE(lock_mgr.LockExclusive(&txn0, rid1)); }};
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  // no cycle yet, txn0 waits for the younger txn1
+  CheckGrowing(&txn1);
+
+  EXPECT_FALSE(lock_mgr.LockExclusive(&txn1, rid0));
+  CheckAborted(&txn1);
+  txn_mgr.Abort(&txn1);
+  old_thread.join();
+  CheckGrowing(&txn0);
+  txn_mgr.Commit(&txn0);
+  CheckCommitted(&txn0);
+  cycle_detection_interval = saved_interval;
+}
+TEST(LockManagerTest, DeadlockDetectionTest) { DeadlockDetectionTest(); }
+
 // --- Real tests ---
 
 // Two threads, check if one will abort.
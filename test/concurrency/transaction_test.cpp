@@ -10,6 +10,7 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include <algorithm>
 #include <atomic>
 #include <cstdio>
 #include <memory>
@@ -22,6 +23,7 @@
 #include "catalog/table_generator.h"
 #include "concurrency/transaction.h"
 #include "concurrency/transaction_manager.h"
+#include "concurrency/transaction_scheduler.h"
 #include "execution/execution_engine.h"
 #include "execution/executor_context.h"
 #include "execution/executors/insert_executor.h"
@@ -33,6 +35,7 @@
 #include "execution/plans/limit_plan.h"
 #include "execution/plans/nested_index_join_plan.h"
 #include "execution/plans/seq_scan_plan.h"
+#include "execution/plans/update_plan.h"
 #include "gtest/gtest.h"
 #include "test_util.h"  // NOLINT
 #include "type/value_factory.h"
@@ -242,6 +245,9 @@ TEST_F(TransactionTest, MyDeleteRollbackTest) {
   // check result
   std::vector<Tuple> result_set;
   GetExecutionEngine()->Execute(&scan_plan, &result_set, txn2, exec_ctx2.get());
+  // one table lock instead of a lock per record
+  CheckTxnLockSize(txn2, 0, 0);
+  EXPECT_EQ(txn2->GetSharedTableLockSet()->size(), 1);
   GetTxnManager()->Commit(txn2);
   delete txn2;
   // Second value
@@ -329,4 +335,517 @@ TEST_F(TransactionTest, DirtyReadsTest) {
   delete txn2;
 }
 
+// NOLINTNEXTLINE
+TEST_F(TransactionTest, SnapshotReadTest) {
+  // txn1: INSERT INTO empty_table2 VALUES (200, 20), (201, 21), (202, 22); commit
+  // snap: begins
+  // txn2: DELETE FROM empty_table2 WHERE colA = 200; commit
+  // txn3: INSERT INTO empty_table2 VALUES (203, 23)
+  // snap: SELECT * FROM empty_table2; still sees 200 and not 203, without locking
+  // snap: DELETE FROM empty_table2 WHERE colA = 200; aborts, txn2 deleted it first
+  auto txn1 = GetTxnManager()->Begin();
+  auto exec_ctx1 = std::make_unique<ExecutorContext>(txn1, GetCatalog(), GetBPM(), GetTxnManager(), GetLockManager());
+  std::vector<Value> val1{ValueFactory::GetIntegerValue(200), ValueFactory::GetIntegerValue(20)};
+  std::vector<Value> val2{ValueFactory::GetIntegerValue(201), ValueFactory::GetIntegerValue(21)};
+  std::vector<Value> val3{ValueFactory::GetIntegerValue(202), ValueFactory::GetIntegerValue(22)};
+  std::vector<std::vector<Value>> raw_vals{val1, val2, val3};
+  auto table_info = exec_ctx1->GetCatalog()->GetTable("empty_table2");
+  InsertPlanNode insert_plan{std::move(raw_vals), table_info->oid_};
+  GetExecutionEngine()->Execute(&insert_plan, nullptr, txn1, exec_ctx1.get());
+  GetTxnManager()->Commit(txn1);
+  delete txn1;
+
+  auto snap = GetTxnManager()->Begin(nullptr, IsolationLevel::SNAPSHOT_ISOLATION);
+  auto exec_ctx_snap =
+      std::make_unique<ExecutorContext>(snap, GetCatalog(), GetBPM(), GetTxnManager(), GetLockManager());
+
+  auto &schema = table_info->schema_;
+  auto col_a = MakeColumnValueExpression(schema, 0, "colA");
+  auto col_b = MakeColumnValueExpression(schema, 0, "colB");
+  auto out_schema = MakeOutputSchema({{"colA", col_a}, {"colB", col_b}});
+  auto const200 = MakeConstantValueExpression(ValueFactory::GetIntegerValue(200));
+  auto predicate = MakeComparisonExpression(col_a, const200, ComparisonType::Equal);
+  SeqScanPlanNode scan_200{out_schema, predicate, table_info->oid_};
+  DeletePlanNode del_plan(&scan_200, table_info->oid_);
+
+  auto txn2 = GetTxnManager()->Begin();
+  auto exec_ctx2 = std::make_unique<ExecutorContext>(txn2, GetCatalog(), GetBPM(), GetTxnManager(), GetLockManager());
+  EXPECT_TRUE(GetExecutionEngine()->Execute(&del_plan, nullptr, txn2, exec_ctx2.get()));
+  GetTxnManager()->Commit(txn2);
+  delete txn2;
+
+  auto txn3 = GetTxnManager()->Begin();
+  auto exec_ctx3 = std::make_unique<ExecutorContext>(txn3, GetCatalog(), GetBPM(), GetTxnManager(), GetLockManager());
+  std::vector<std::vector<Value>> raw_vals3{{ValueFactory::GetIntegerValue(203), ValueFactory::GetIntegerValue(23)}};
+  InsertPlanNode insert_plan3{std::move(raw_vals3), table_info->oid_};
+  GetExecutionEngine()->Execute(&insert_plan3, nullptr, txn3, exec_ctx3.get());
+
+  SeqScanPlanNode scan_plan{out_schema, nullptr, table_info->oid_};
+  std::vector<Tuple> result_set;
+  GetExecutionEngine()->Execute(&scan_plan, &result_set, snap, exec_ctx_snap.get());
+  CheckTxnLockSize(snap, 0, 0);
+  EXPECT_TRUE(snap->GetSharedTableLockSet()->empty());
+  EXPECT_TRUE(snap->GetIntentionSharedTableLockSet()->empty());
+  ASSERT_EQ(result_set.size(), 3);
+  for (int32_t i = 0; i < 3; i++) {
+    EXPECT_EQ(result_set[i].GetValue(out_schema, out_schema->GetColIdx("colA")).GetAs<int32_t>(), 200 + i);
+  }
+  GetTxnManager()->Commit(txn3);
+  delete txn3;
+
+  // txn2 committed a change the snapshot does not see
+  EXPECT_FALSE(GetExecutionEngine()->Execute(&del_plan, nullptr, snap, exec_ctx_snap.get()));
+  CheckAborted(snap);
+  GetTxnManager()->Abort(snap);
+  delete snap;
+
+  auto txn4 = GetTxnManager()->Begin(nullptr, IsolationLevel::SNAPSHOT_ISOLATION);
+  auto exec_ctx4 = std::make_unique<ExecutorContext>(txn4, GetCatalog(), GetBPM(), GetTxnManager(), GetLockManager());
+  result_set.clear();
+  GetExecutionEngine()->Execute(&scan_plan, &result_set, txn4, exec_ctx4.get());
+  GetTxnManager()->Commit(txn4);
+  delete txn4;
+  // 203 took over the slot of 200
+  std::vector<int32_t> col_a_values;
+  for (const auto &tuple : result_set) {
+    col_a_values.push_back(tuple.GetValue(out_schema, out_schema->GetColIdx("colA")).GetAs<int32_t>());
+  }
+  std::sort(col_a_values.begin(), col_a_values.end());
+  EXPECT_EQ(col_a_values, (std::vector<int32_t>{201, 202, 203}));
+}
+
+// NOLINTNEXTLINE
+TEST_F(TransactionTest, OptimisticValidationTest) {
+  // txn1: INSERT INTO empty_table2 VALUES (200, 20), (201, 21), (202, 22); commit
+  // occ1: SELECT * FROM empty_table2 WHERE colA = 200;
+  // txn2: DELETE FROM empty_table2 WHERE colA = 201; commit
+  // occ1: commit fails validation, it read the tuple txn2 deleted
+  // occ2: DELETE FROM empty_table2 WHERE colA = 202; commit
+  auto txn1 = GetTxnManager()->Begin();
+  auto exec_ctx1 = std::make_unique<ExecutorContext>(txn1, GetCatalog(), GetBPM(), GetTxnManager(), GetLockManager());
+  std::vector<Value> val1{ValueFactory::GetIntegerValue(200), ValueFactory::GetIntegerValue(20)};
+  std::vector<Value> val2{ValueFactory::GetIntegerValue(201), ValueFactory::GetIntegerValue(21)};
+  std::vector<Value> val3{ValueFactory::GetIntegerValue(202), ValueFactory::GetIntegerValue(22)};
+  std::vector<std::vector<Value>> raw_vals{val1, val2, val3};
+  auto table_info = exec_ctx1->GetCatalog()->GetTable("empty_table2");
+  InsertPlanNode insert_plan{std::move(raw_vals), table_info->oid_};
+  GetExecutionEngine()->Execute(&insert_plan, nullptr, txn1, exec_ctx1.get());
+  EXPECT_TRUE(GetTxnManager()->Commit(txn1));
+  delete txn1;
+
+  auto &schema = table_info->schema_;
+  auto col_a = MakeColumnValueExpression(schema, 0, "colA");
+  auto col_b = MakeColumnValueExpression(schema, 0, "colB");
+  auto out_schema = MakeOutputSchema({{"colA", col_a}, {"colB", col_b}});
+  auto make_scan = [&](int32_t col_a_value) {
+    auto constant = MakeConstantValueExpression(ValueFactory::GetIntegerValue(col_a_value));
+    auto predicate = MakeComparisonExpression(col_a, constant, ComparisonType::Equal);
+    return std::make_unique<SeqScanPlanNode>(out_schema, predicate, table_info->oid_);
+  };
+
+  auto occ1 = GetTxnManager()->Begin(nullptr, IsolationLevel::OPTIMISTIC);
+  auto exec_ctx_occ1 =
+      std::make_unique<ExecutorContext>(occ1, GetCatalog(), GetBPM(), GetTxnManager(), GetLockManager());
+  auto scan_200 = make_scan(200);
+  std::vector<Tuple> result_set;
+  GetExecutionEngine()->Execute(scan_200.get(), &result_set, occ1, exec_ctx_occ1.get());
+  ASSERT_EQ(result_set.size(), 1);
+  CheckTxnLockSize(occ1, 0, 0);
+  EXPECT_TRUE(occ1->GetSharedTableLockSet()->empty());
+
+  auto txn2 = GetTxnManager()->Begin();
+  auto exec_ctx2 = std::make_unique<ExecutorContext>(txn2, GetCatalog(), GetBPM(), GetTxnManager(), GetLockManager());
+  auto scan_201 = make_scan(201);
+  DeletePlanNode del_201(scan_201.get(), table_info->oid_);
+  EXPECT_TRUE(GetExecutionEngine()->Execute(&del_201, nullptr, txn2, exec_ctx2.get()));
+  EXPECT_TRUE(GetTxnManager()->Commit(txn2));
+  delete txn2;
+
+  // the scan read every tuple, including the one txn2 deleted
+  EXPECT_FALSE(GetTxnManager()->Commit(occ1));
+  CheckAborted(occ1);
+  delete occ1;
+
+  auto occ2 = GetTxnManager()->Begin(nullptr, IsolationLevel::OPTIMISTIC);
+  auto exec_ctx_occ2 =
+      std::make_unique<ExecutorContext>(occ2, GetCatalog(), GetBPM(), GetTxnManager(), GetLockManager());
+  auto scan_202 = make_scan(202);
+  DeletePlanNode del_202(scan_202.get(), table_info->oid_);
+  EXPECT_TRUE(GetExecutionEngine()->Execute(&del_202, nullptr, occ2, exec_ctx_occ2.get()));
+  EXPECT_TRUE(GetTxnManager()->Commit(occ2));
+  CheckCommitted(occ2);
+  delete occ2;
+
+  auto txn3 = GetTxnManager()->Begin();
+  auto exec_ctx3 = std::make_unique<ExecutorContext>(txn3, GetCatalog(), GetBPM(), GetTxnManager(), GetLockManager());
+  SeqScanPlanNode scan_plan{out_schema, nullptr, table_info->oid_};
+  result_set.clear();
+  GetExecutionEngine()->Execute(&scan_plan, &result_set, txn3, exec_ctx3.get());
+  GetTxnManager()->Commit(txn3);
+  delete txn3;
+  ASSERT_EQ(result_set.size(), 1);
+  EXPECT_EQ(result_set[0].GetValue(out_schema, out_schema->GetColIdx("colA")).GetAs<int32_t>(), 200);
+}
+
+TEST_F(TransactionTest, ReadOnlyTest) {
+  // txn1: INSERT INTO empty_table2 VALUES (200, 20), (201, 21); commit
+  // txn2: INSERT INTO empty_table2 VALUES (202, 22)
+  // ro: SELECT * FROM empty_table2; sees 200 and 201, without locking, while txn2 holds its locks
+  // ro: INSERT INTO empty_table2 VALUES (203, 23); aborts, it is read-only
+  auto txn1 = GetTxnManager()->Begin();
+  auto exec_ctx1 = std::make_unique<ExecutorContext>(txn1, GetCatalog(), GetBPM(), GetTxnManager(), GetLockManager());
+  auto table_info = exec_ctx1->GetCatalog()->GetTable("empty_table2");
+  std::vector<std::vector<Value>> raw_vals1{{ValueFactory::GetIntegerValue(200), ValueFactory::GetIntegerValue(20)},
+                                            {ValueFactory::GetIntegerValue(201), ValueFactory::GetIntegerValue(21)}};
+  InsertPlanNode insert_plan1{std::move(raw_vals1), table_info->oid_};
+  GetExecutionEngine()->Execute(&insert_plan1, nullptr, txn1, exec_ctx1.get());
+  GetTxnManager()->Commit(txn1);
+  delete txn1;
+
+  auto txn2 = GetTxnManager()->Begin();
+  auto exec_ctx2 = std::make_unique<ExecutorContext>(txn2, GetCatalog(), GetBPM(), GetTxnManager(), GetLockManager());
+  std::vector<std::vector<Value>> raw_vals2{{ValueFactory::GetIntegerValue(202), ValueFactory::GetIntegerValue(22)}};
+  InsertPlanNode insert_plan2{std::move(raw_vals2), table_info->oid_};
+  GetExecutionEngine()->Execute(&insert_plan2, nullptr, txn2, exec_ctx2.get());
+
+  auto ro = GetTxnManager()->BeginReadOnly();
+  EXPECT_TRUE(ro->IsReadOnly());
+  EXPECT_EQ(ro->GetWriteSet(), nullptr);
+  EXPECT_EQ(TransactionManager::txn_registry.Find(ro->GetTransactionId()), nullptr);
+  auto exec_ctx_ro = std::make_unique<ExecutorContext>(ro, GetCatalog(), GetBPM(), GetTxnManager(), GetLockManager());
+  auto &schema = table_info->schema_;
+  auto col_a = MakeColumnValueExpression(schema, 0, "colA");
+  auto out_schema = MakeOutputSchema({{"colA", col_a}});
+  SeqScanPlanNode scan_plan{out_schema, nullptr, table_info->oid_};
+  std::vector<Tuple> result_set;
+  GetExecutionEngine()->Execute(&scan_plan, &result_set, ro, exec_ctx_ro.get());
+  CheckTxnLockSize(ro, 0, 0);
+  EXPECT_TRUE(ro->GetSharedTableLockSet()->empty());
+  ASSERT_EQ(result_set.size(), 2);
+  GetTxnManager()->Commit(txn2);
+  delete txn2;
+
+  std::vector<std::vector<Value>> raw_vals3{{ValueFactory::GetIntegerValue(203), ValueFactory::GetIntegerValue(23)}};
+  InsertPlanNode insert_plan3{std::move(raw_vals3), table_info->oid_};
+  EXPECT_FALSE(GetExecutionEngine()->Execute(&insert_plan3, nullptr, ro, exec_ctx_ro.get()));
+  CheckAborted(ro);
+  GetTxnManager()->Abort(ro);
+  delete ro;
+
+  // the table heap turns away a read-only writer too, which has no write set to record the change in
+  auto ro2 = GetTxnManager()->BeginReadOnly();
+  RID rid = table_info->table_->Begin(ro2)->GetRid();
+  EXPECT_THROW(table_info->table_->MarkDelete(rid, ro2), TransactionAbortException);
+  CheckAborted(ro2);
+  GetTxnManager()->Abort(ro2);
+  delete ro2;
+}
+
+// NOLINTNEXTLINE
+TEST_F(TransactionTest, IncrementTest) {
+  // txn1: INSERT INTO empty_table2 VALUES (200, 0); commit
+  // snap: begins
+  // txn2: UPDATE empty_table2 SET colB = colB + 1
+  // txn3, txn4: add 10 and 100 to the same tuple, while txn2 has not committed
+  // txn3 aborts, which takes back its own increment only; txn2 and txn4 commit
+  // snap still reads 0, a new transaction reads 101
+  auto txn1 = GetTxnManager()->Begin();
+  auto exec_ctx1 = std::make_unique<ExecutorContext>(txn1, GetCatalog(), GetBPM(), GetTxnManager(), GetLockManager());
+  auto table_info = exec_ctx1->GetCatalog()->GetTable("empty_table2");
+  TableHeap *table = table_info->table_.get();
+  auto &schema = table_info->schema_;
+  std::vector<std::vector<Value>> raw_vals{{ValueFactory::GetIntegerValue(200), ValueFactory::GetIntegerValue(0)}};
+  InsertPlanNode insert_plan{std::move(raw_vals), table_info->oid_};
+  GetExecutionEngine()->Execute(&insert_plan, nullptr, txn1, exec_ctx1.get());
+  RID rid = table->Begin(txn1)->GetRid();
+  GetTxnManager()->Commit(txn1);
+  delete txn1;
+
+  auto snap = GetTxnManager()->Begin(nullptr, IsolationLevel::SNAPSHOT_ISOLATION);
+
+  auto txn2 = GetTxnManager()->Begin(nullptr, IsolationLevel::READ_COMMITTED);
+  auto exec_ctx2 = std::make_unique<ExecutorContext>(txn2, GetCatalog(), GetBPM(), GetTxnManager(), GetLockManager());
+  auto col_a = MakeColumnValueExpression(schema, 0, "colA");
+  auto col_b = MakeColumnValueExpression(schema, 0, "colB");
+  auto out_schema = MakeOutputSchema({{"colA", col_a}, {"colB", col_b}});
+  SeqScanPlanNode scan_plan{out_schema, nullptr, table_info->oid_};
+  std::unordered_map<uint32_t, UpdateInfo> update_attrs;
+  update_attrs.emplace(schema.GetColIdx("colB"), UpdateInfo(UpdateType::Add, 1));
+  UpdatePlanNode update_plan{&scan_plan, table_info->oid_, update_attrs};
+  EXPECT_TRUE(GetExecutionEngine()->Execute(&update_plan, nullptr, txn2, exec_ctx2.get()));
+  EXPECT_TRUE(txn2->IsIncrementLocked(rid));
+  EXPECT_FALSE(txn2->IsExclusiveLocked(rid));
+
+  auto txn3 = GetTxnManager()->Begin(nullptr, IsolationLevel::READ_COMMITTED);
+  auto txn4 = GetTxnManager()->Begin(nullptr, IsolationLevel::READ_COMMITTED);
+  TupleIncrement add10;
+  add10.Add(schema.GetColumn(schema.GetColIdx("colB")).GetOffset(), 10);
+  TupleIncrement add100;
+  add100.Add(schema.GetColumn(schema.GetColIdx("colB")).GetOffset(), 100);
+  EXPECT_TRUE(GetLockManager()->LockIncrement(txn3, rid));
+  EXPECT_TRUE(table->IncrementTuple(add10, rid, txn3));
+  EXPECT_TRUE(GetLockManager()->LockIncrement(txn4, rid));
+  EXPECT_TRUE(table->IncrementTuple(add100, rid, txn4));
+
+  GetTxnManager()->Abort(txn3);
+  GetTxnManager()->Commit(txn2);
+  GetTxnManager()->Commit(txn4);
+  delete txn2;
+  delete txn3;
+  delete txn4;
+
+  Tuple tuple;
+  EXPECT_TRUE(table->GetTuple(rid, &tuple, snap));
+  EXPECT_EQ(tuple.GetValue(&schema, schema.GetColIdx("colB")).GetAs<int32_t>(), 0);
+  GetTxnManager()->Commit(snap);
+  delete snap;
+
+  auto txn5 = GetTxnManager()->Begin();
+  EXPECT_TRUE(table->GetTuple(rid, &tuple, txn5));
+  EXPECT_EQ(tuple.GetValue(&schema, schema.GetColIdx("colB")).GetAs<int32_t>(), 101);
+  GetTxnManager()->Commit(txn5);
+  delete txn5;
+}
+
+// NOLINTNEXTLINE
+TEST_F(TransactionTest, ConcurrentIncrementTest) {
+  // txn1: INSERT INTO empty_table2 VALUES (200, 0); commit
+  // txn2 (REPEATABLE_READ): UPDATE empty_table2 SET colB = colB + 1
+  // txn3 (READ_COMMITTED): UPDATE empty_table2 SET colB = colB + 10, while txn2 has not committed
+  // neither waits for the other; both commit and a new transaction reads 11
+  auto txn1 = GetTxnManager()->Begin();
+  auto exec_ctx1 = std::make_unique<ExecutorContext>(txn1, GetCatalog(), GetBPM(), GetTxnManager(), GetLockManager());
+  auto table_info = exec_ctx1->GetCatalog()->GetTable("empty_table2");
+  TableHeap *table = table_info->table_.get();
+  auto &schema = table_info->schema_;
+  std::vector<std::vector<Value>> raw_vals{{ValueFactory::GetIntegerValue(200), ValueFactory::GetIntegerValue(0)}};
+  InsertPlanNode insert_plan{std::move(raw_vals), table_info->oid_};
+  GetExecutionEngine()->Execute(&insert_plan, nullptr, txn1, exec_ctx1.get());
+  RID rid = table->Begin(txn1)->GetRid();
+  GetTxnManager()->Commit(txn1);
+  delete txn1;
+
+  auto col_a = MakeColumnValueExpression(schema, 0, "colA");
+  auto col_b = MakeColumnValueExpression(schema, 0, "colB");
+  auto out_schema = MakeOutputSchema({{"colA", col_a}, {"colB", col_b}});
+  SeqScanPlanNode scan_plan{out_schema, nullptr, table_info->oid_};
+  std::unordered_map<uint32_t, UpdateInfo> add1;
+  add1.emplace(schema.GetColIdx("colB"), UpdateInfo(UpdateType::Add, 1));
+  std::unordered_map<uint32_t, UpdateInfo> add10;
+  add10.emplace(schema.GetColIdx("colB"), UpdateInfo(UpdateType::Add, 10));
+  UpdatePlanNode update1{&scan_plan, table_info->oid_, add1};
+  UpdatePlanNode update10{&scan_plan, table_info->oid_, add10};
+
+  auto txn2 = GetTxnManager()->Begin();
+  auto exec_ctx2 = std::make_unique<ExecutorContext>(txn2, GetCatalog(), GetBPM(), GetTxnManager(), GetLockManager());
+  auto txn3 = GetTxnManager()->Begin(nullptr, IsolationLevel::READ_COMMITTED);
+  auto exec_ctx3 = std::make_unique<ExecutorContext>(txn3, GetCatalog(), GetBPM(), GetTxnManager(), GetLockManager());
+  EXPECT_TRUE(GetExecutionEngine()->Execute(&update1, nullptr, txn2, exec_ctx2.get()));
+  std::thread incrementing(
+      [&] { EXPECT_TRUE(GetExecutionEngine()->Execute(&update10, nullptr, txn3, exec_ctx3.get())); });
+  // txn3 must not wait for txn2 to commit
+  incrementing.join();
+  EXPECT_TRUE(txn2->IsIncrementLocked(rid));
+  EXPECT_TRUE(txn3->IsIncrementLocked(rid));
+  EXPECT_EQ(txn2->GetIntentionExclusiveTableLockSet()->count(table_info->oid_), 1);
+  EXPECT_EQ(txn3->GetIntentionExclusiveTableLockSet()->count(table_info->oid_), 1);
+  GetTxnManager()->Commit(txn3);
+  GetTxnManager()->Commit(txn2);
+  CheckCommitted(txn2);
+  CheckCommitted(txn3);
+  delete txn2;
+  delete txn3;
+
+  auto txn4 = GetTxnManager()->Begin();
+  Tuple tuple;
+  EXPECT_TRUE(table->GetTuple(rid, &tuple, txn4));
+  EXPECT_EQ(tuple.GetValue(&schema, schema.GetColIdx("colB")).GetAs<int32_t>(), 11);
+  GetTxnManager()->Commit(txn4);
+  delete txn4;
+}
+
+// NOLINTNEXTLINE
+TEST_F(TransactionTest, ConcurrentUpdateTest) {
+  // txn1: INSERT INTO empty_table2 VALUES (200, 20), (201, 21); commit
+  // txn2: UPDATE empty_table2 SET colB = 31 WHERE colA = 201
+  // txn3: UPDATE empty_table2 SET colB = 30 WHERE colA = 200, while txn2 has not committed
+  // both hold IX on the table, not SIX; txn3 only waits for txn2's lock on the record 200
+  auto txn1 = GetTxnManager()->Begin();
+  auto exec_ctx1 = std::make_unique<ExecutorContext>(txn1, GetCatalog(), GetBPM(), GetTxnManager(), GetLockManager());
+  auto table_info = exec_ctx1->GetCatalog()->GetTable("empty_table2");
+  auto &schema = table_info->schema_;
+  std::vector<std::vector<Value>> raw_vals{{ValueFactory::GetIntegerValue(200), ValueFactory::GetIntegerValue(20)},
+                                           {ValueFactory::GetIntegerValue(201), ValueFactory::GetIntegerValue(21)}};
+  InsertPlanNode insert_plan{std::move(raw_vals), table_info->oid_};
+  GetExecutionEngine()->Execute(&insert_plan, nullptr, txn1, exec_ctx1.get());
+  GetTxnManager()->Commit(txn1);
+  delete txn1;
+
+  auto col_a = MakeColumnValueExpression(schema, 0, "colA");
+  auto col_b = MakeColumnValueExpression(schema, 0, "colB");
+  auto out_schema = MakeOutputSchema({{"colA", col_a}, {"colB", col_b}});
+  auto const200 = MakeConstantValueExpression(ValueFactory::GetIntegerValue(200));
+  auto const201 = MakeConstantValueExpression(ValueFactory::GetIntegerValue(201));
+  SeqScanPlanNode scan200{out_schema, MakeComparisonExpression(col_a, const200, ComparisonType::Equal),
+                          table_info->oid_};
+  SeqScanPlanNode scan201{out_schema, MakeComparisonExpression(col_a, const201, ComparisonType::Equal),
+                          table_info->oid_};
+  std::unordered_map<uint32_t, UpdateInfo> set30;
+  set30.emplace(schema.GetColIdx("colB"), UpdateInfo(UpdateType::Set, 30));
+  std::unordered_map<uint32_t, UpdateInfo> set31;
+  set31.emplace(schema.GetColIdx("colB"), UpdateInfo(UpdateType::Set, 31));
+  UpdatePlanNode update200{&scan200, table_info->oid_, set30};
+  UpdatePlanNode update201{&scan201, table_info->oid_, set31};
+
+  auto txn2 = GetTxnManager()->Begin();
+  auto exec_ctx2 = std::make_unique<ExecutorContext>(txn2, GetCatalog(), GetBPM(), GetTxnManager(), GetLockManager());
+  EXPECT_TRUE(GetExecutionEngine()->Execute(&update201, nullptr, txn2, exec_ctx2.get()));
+  EXPECT_EQ(txn2->GetIntentionExclusiveTableLockSet()->count(table_info->oid_), 1);
+  EXPECT_TRUE(txn2->GetSharedIntentionExclusiveTableLockSet()->empty());
+  EXPECT_TRUE(txn2->GetSharedTableLockSet()->empty());
+
+  auto txn3 = GetTxnManager()->Begin();
+  auto exec_ctx3 = std::make_unique<ExecutorContext>(txn3, GetCatalog(), GetBPM(), GetTxnManager(), GetLockManager());
+  std::thread updating([&] { EXPECT_TRUE(GetExecutionEngine()->Execute(&update200, nullptr, txn3, exec_ctx3.get())); });
+  // the table lock is granted next to txn2's, txn3 waits on the record
+  for (int i = 0; i < 100 && txn3->GetIntentionExclusiveTableLockSet()->count(table_info->oid_) == 0; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  EXPECT_EQ(txn3->GetIntentionExclusiveTableLockSet()->count(table_info->oid_), 1);
+  GetTxnManager()->Commit(txn2);
+  updating.join();
+  EXPECT_TRUE(txn3->GetSharedIntentionExclusiveTableLockSet()->empty());
+  GetTxnManager()->Commit(txn3);
+  CheckCommitted(txn2);
+  CheckCommitted(txn3);
+  delete txn2;
+  delete txn3;
+
+  auto txn4 = GetTxnManager()->Begin();
+  auto exec_ctx4 = std::make_unique<ExecutorContext>(txn4, GetCatalog(), GetBPM(), GetTxnManager(), GetLockManager());
+  SeqScanPlanNode scan_plan{out_schema, nullptr, table_info->oid_};
+  std::vector<Tuple> result_set;
+  GetExecutionEngine()->Execute(&scan_plan, &result_set, txn4, exec_ctx4.get());
+  GetTxnManager()->Commit(txn4);
+  delete txn4;
+  ASSERT_EQ(result_set.size(), 2);
+  EXPECT_EQ(result_set[0].GetValue(out_schema, out_schema->GetColIdx("colB")).GetAs<int32_t>(), 30);
+  EXPECT_EQ(result_set[1].GetValue(out_schema, out_schema->GetColIdx("colB")).GetAs<int32_t>(), 31);
+}
+
+// Transactions leave the registry when they finish, including one that had to share its slot.
+TEST(TransactionRegistryTest, BeginFinishTest) {
+  LockManager lock_mgr{};
+  TransactionManager txn_mgr{&lock_mgr};
+  auto slot_count = static_cast<txn_id_t>(TransactionRegistry::SLOT_COUNT);
+  Transaction old_txn(1000);
+  Transaction young_txn(1000 + slot_count);
+  txn_mgr.Begin(&old_txn);
+  txn_mgr.Begin(&young_txn);
+  EXPECT_EQ(TransactionManager::GetTransaction(1000), &old_txn);
+  EXPECT_EQ(TransactionManager::GetTransaction(1000 + slot_count), &young_txn);
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; i++) {
+    threads.emplace_back([&] {
+      for (int j = 0; j < 1000; j++) {
+        Transaction *txn = txn_mgr.Begin();
+        EXPECT_EQ(TransactionManager::GetTransaction(txn->GetTransactionId()), txn);
+        txn_mgr.Commit(txn);
+        EXPECT_EQ(TransactionManager::txn_registry.Find(txn->GetTransactionId()), nullptr);
+        delete txn;
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  txn_mgr.Commit(&old_txn);
+  EXPECT_EQ(TransactionManager::txn_registry.Find(1000), nullptr);
+  EXPECT_EQ(TransactionManager::GetTransaction(1000 + slot_count), &young_txn);
+  txn_mgr.Abort(&young_txn);
+  EXPECT_EQ(TransactionManager::txn_registry.Find(1000 + slot_count), nullptr);
+}
+
+// Transactions run through the scheduler commit in the end, however often they are wounded, and never more than
+// max_in_flight of them run at once.
+TEST(TransactionSchedulerTest, RetryTest) {
+  LockManager lock_mgr{};
+  TransactionManager txn_mgr{&lock_mgr};
+  TransactionScheduler scheduler{&txn_mgr, &lock_mgr, 2, 1000};
+  std::atomic<int> in_flight{0};
+  std::atomic<int> max_in_flight{0};
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 8; i++) {
+    threads.emplace_back([&, i] {
+      std::mt19937 gen(i);
+      for (int j = 0; j < 50; j++) {
+        RID first(0, gen() % 4);
+        RID second(0, gen() % 4);
+        bool committed = scheduler.Run([&](Transaction *txn) {
+          int running = ++in_flight;
+          max_in_flight = std::max(max_in_flight.load(), running);
+          bool locked = lock_mgr.LockExclusive(txn, first) && (first == second || lock_mgr.LockExclusive(txn, second));
+          --in_flight;
+          return locked;
+        });
+        EXPECT_TRUE(committed);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_LE(max_in_flight, 2);
+  TransactionScheduler::Stats stats = scheduler.GetStats();
+  EXPECT_EQ(stats.commits_, 400);
+  EXPECT_EQ(stats.failures_, 0);
+}
+
+// The transactions naming a record the lock manager saw waits on run one after the other.
+TEST(TransactionSchedulerTest, HotKeyTest) {
+  LockManager lock_mgr{};
+  TransactionManager txn_mgr{&lock_mgr};
+  RID hot(0, 0);
+  Transaction *holder = txn_mgr.Begin();
+  Transaction *waiter = txn_mgr.Begin();
+  EXPECT_TRUE(lock_mgr.LockExclusive(holder, hot));
+  std::thread waiting([&] { EXPECT_TRUE(lock_mgr.LockExclusive(waiter, hot)); });
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  txn_mgr.Commit(holder);
+  waiting.join();
+  txn_mgr.Commit(waiter);
+  delete holder;
+  delete waiter;
+
+  TransactionScheduler scheduler{&txn_mgr, &lock_mgr, 4, 16, 1};
+  scheduler.RefreshHotKeys();
+  EXPECT_EQ(scheduler.GetHotKeys(), std::vector<RID>{hot});
+
+  // the bodies take no locks, only their turns keep them apart
+  std::atomic<int> on_hot{0};
+  std::atomic<int> max_on_hot{0};
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; i++) {
+    threads.emplace_back([&] {
+      for (int j = 0; j < 10; j++) {
+        EXPECT_TRUE(scheduler.Run(
+            [&](Transaction *txn) {
+              int running = ++on_hot;
+              max_on_hot = std::max(max_on_hot.load(), running);
+              std::this_thread::sleep_for(std::chrono::microseconds(200));
+              --on_hot;
+              return true;
+            },
+            {RID(0, 1), hot}));
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(max_on_hot, 1);
+}
+
 }  // namespace bustub
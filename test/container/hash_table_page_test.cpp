@@ -15,6 +15,7 @@
 
 #include "buffer/buffer_pool_manager_instance.h"
 #include "common/logger.h"
+#include "container/hash/hash_function.h"
 #include "gtest/gtest.h"
 #include "storage/disk/disk_manager.h"
 #include "storage/page/hash_table_bucket_page.h"
@@ -114,4 +115,65 @@ TEST(HashTablePageTest, BucketPageSampleTest) {
   delete bpm;
 }
 
+// NOLINTNEXTLINE
+TEST(HashTablePageTest, BucketPageTagTest) {
+  auto *disk_manager = new DiskManager("test.db");
+  auto *bpm = new BufferPoolManagerInstance(5, disk_manager);
+
+  page_id_t bucket_page_id = INVALID_PAGE_ID;
+  auto bucket_page = reinterpret_cast<HashTableBucketPage<int, int, IntComparator> *>(
+      bpm->NewPage(&bucket_page_id, nullptr)->GetData());
+  using KeyType = int;
+  using ValueType = int;
+  const size_t capacity = BUCKET_ARRAY_SIZE;
+
+  // half of the keys share the tag of key 0, so they all reach the comparator
+  HashFunction<int> hash_fn;
+  auto tag_of = [&](int key) { return HashTableBucketPage<int, int, IntComparator>::TagOf(hash_fn.GetHash(key)); };
+  std::vector<int> keys;
+  std::vector<int> others;
+  for (int key = 0; keys.size() < capacity / 2 || others.size() < capacity / 2; key++) {
+    auto &group = tag_of(key) == tag_of(0) ? keys : others;
+    if (group.size() < capacity / 2) {
+      group.push_back(key);
+    }
+  }
+  keys.insert(keys.end(), others.begin(), others.end());
+  for (int key : keys) {
+    EXPECT_EQ(CODE_OK, bucket_page->Insert2(key, key, tag_of(key), IntComparator()));
+  }
+  // key 0 takes whatever odd slot is left, under another value
+  std::vector<int> values{keys[0]};
+  while (!bucket_page->IsFull()) {
+    EXPECT_EQ(CODE_OK, bucket_page->Insert2(keys[0], -1, tag_of(keys[0]), IntComparator()));
+    values.push_back(-1);
+  }
+  EXPECT_EQ(CODE_FULL, bucket_page->Insert2(-1, -1, tag_of(-1), IntComparator()));
+  EXPECT_EQ(CODE_DUP, bucket_page->Insert2(keys[1], keys[1], tag_of(keys[1]), IntComparator()));
+
+  for (size_t i = 1; i < capacity / 2; i++) {
+    std::vector<int> result;
+    EXPECT_TRUE(bucket_page->GetValue(keys[i], tag_of(keys[i]), IntComparator(), &result));
+    EXPECT_EQ(std::vector<int>{keys[i]}, result);
+  }
+  std::vector<int> result;
+  EXPECT_TRUE(bucket_page->GetValue(keys[0], tag_of(keys[0]), IntComparator(), &result));
+  EXPECT_EQ(values, result);
+
+  // a removed pair leaves a tombstone, which the next insert takes
+  uint32_t slot = capacity;
+  EXPECT_TRUE(bucket_page->Remove(keys[7], keys[7], tag_of(keys[7]), IntComparator(), &slot));
+  EXPECT_EQ(7, slot);
+  result.clear();
+  EXPECT_FALSE(bucket_page->GetValue(keys[7], tag_of(keys[7]), IntComparator(), &result));
+  EXPECT_EQ(CODE_OK, bucket_page->Insert2(-1, -1, tag_of(-1), IntComparator(), &slot));
+  EXPECT_EQ(7, slot);
+
+  bpm->UnpinPage(bucket_page_id, true, nullptr);
+  disk_manager->ShutDown();
+  remove("test.db");
+  delete disk_manager;
+  delete bpm;
+}
+
 }  // namespace bustub
@@ -10,6 +10,8 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include <atomic>
+#include <random>
 #include <thread>  // NOLINT
 #include <vector>
 
@@ -27,44 +29,44 @@ namespace bustub {
 TEST(HashTableTest, SampleTest) {
   auto *disk_manager = new DiskManager("test.db");
   auto *bpm = new BufferPoolManagerInstance(50, disk_manager);
-  ExtendibleHashTable<int, int, IntComparator> ht("blah", bpm, IntComparator(), HashFunction<int>());
+  auto *ht = new ExtendibleHashTable<int, int, IntComparator>("blah", bpm, IntComparator(), HashFunction<int>());
 
   // insert a few values
   for (int i = 0; i < 5; i++) {
-    if (!ht.Insert(nullptr, i, i)) {
+    if (!ht->Insert(nullptr, i, i)) {
       LOG_ERROR("Insert failed");
     }
     std::vector<int> res;
-    if (!ht.GetValue(nullptr, i, &res)) {
+    if (!ht->GetValue(nullptr, i, &res)) {
       LOG_ERROR("GetValue failed");
     }
     EXPECT_EQ(1, res.size()) << "Failed to insert " << i << std::endl;
     EXPECT_EQ(i, res[0]);
   }
 
-  ht.VerifyIntegrity();
+  ht->VerifyIntegrity();
 
   // check if the inserted values are all there
   for (int i = 0; i < 5; i++) {
     std::vector<int> res;
-    ht.GetValue(nullptr, i, &res);
+    ht->GetValue(nullptr, i, &res);
     EXPECT_EQ(1, res.size()) << "Failed to keep " << i << std::endl;
     EXPECT_EQ(i, res[0]);
   }
 
-  ht.VerifyIntegrity();
+  ht->VerifyIntegrity();
 
   // insert one more value for each key
   for (int i = 0; i < 5; i++) {
     if (i == 0) {
       // duplicate values for the same key are not allowed
-      EXPECT_FALSE(ht.Insert(nullptr, i, 2 * i));
+      EXPECT_FALSE(ht->Insert(nullptr, i, 2 * i));
     } else {
-      EXPECT_TRUE(ht.Insert(nullptr, i, 2 * i));
+      EXPECT_TRUE(ht->Insert(nullptr, i, 2 * i));
     }
-    ht.Insert(nullptr, i, 2 * i);
+    ht->Insert(nullptr, i, 2 * i);
     std::vector<int> res;
-    ht.GetValue(nullptr, i, &res);
+    ht->GetValue(nullptr, i, &res);
     if (i == 0) {
       // duplicate values for the same key are not allowed
       EXPECT_EQ(1, res.size());
@@ -80,18 +82,18 @@ TEST(HashTableTest, SampleTest) {
     }
   }
 
-  ht.VerifyIntegrity();
+  ht->VerifyIntegrity();
 
   // look for a key that does not exist
   std::vector<int> res;
-  ht.GetValue(nullptr, 20, &res);
+  ht->GetValue(nullptr, 20, &res);
   EXPECT_EQ(0, res.size());
 
   // delete some values
   for (int i = 0; i < 5; i++) {
-    EXPECT_TRUE(ht.Remove(nullptr, i, i));
+    EXPECT_TRUE(ht->Remove(nullptr, i, i));
     std::vector<int> res;
-    ht.GetValue(nullptr, i, &res);
+    ht->GetValue(nullptr, i, &res);
     if (i == 0) {
       // (0, 0) is the only pair with key 0
       EXPECT_EQ(0, res.size());
@@ -101,20 +103,21 @@ TEST(HashTableTest, SampleTest) {
     }
   }
 
-  ht.VerifyIntegrity();
+  ht->VerifyIntegrity();
 
   // delete all values
   for (int i = 0; i < 5; i++) {
     if (i == 0) {
       // (0, 0) has been deleted
-      EXPECT_FALSE(ht.Remove(nullptr, i, 2 * i));
+      EXPECT_FALSE(ht->Remove(nullptr, i, 2 * i));
     } else {
-      EXPECT_TRUE(ht.Remove(nullptr, i, 2 * i));
+      EXPECT_TRUE(ht->Remove(nullptr, i, 2 * i));
     }
   }
 
-  ht.VerifyIntegrity();
+  ht->VerifyIntegrity();
 
+  delete ht;
   disk_manager->ShutDown();
   remove("test.db");
   delete disk_manager;
@@ -124,32 +127,296 @@ TEST(HashTableTest, SampleTest) {
 TEST(HashTableTest, ScaleTest) {
   auto *disk_manager = new DiskManager("test.db");
   auto *bpm = new BufferPoolManagerInstance(50, disk_manager);
-  ExtendibleHashTable<int, int, IntComparator> ht("blah", bpm, IntComparator(), HashFunction<int>());
+  auto *ht = new ExtendibleHashTable<int, int, IntComparator>("blah", bpm, IntComparator(), HashFunction<int>());
 
-  for (int i = 0; i < 496; i++) {
-    EXPECT_TRUE(ht.Insert(nullptr, i, i));
+  // fill the first bucket, which holds 441 <int, int> pairs after its header and their tags
+  for (int i = 0; i < 441; i++) {
+    EXPECT_TRUE(ht->Insert(nullptr, i, i));
     std::vector<int> res;
-    ht.GetValue(nullptr, i, &res);
+    ht->GetValue(nullptr, i, &res);
     EXPECT_EQ(1, res.size()) << "Failed to insert " << i << std::endl;
     EXPECT_EQ(i, res[0]);
   }
-  EXPECT_EQ(0, ht.GetGlobalDepth());
-  ht.VerifyIntegrity();
-  EXPECT_FALSE(ht.Insert(nullptr, 0, 0));
-  EXPECT_EQ(0, ht.GetGlobalDepth());
-  ht.VerifyIntegrity();
-  EXPECT_TRUE(ht.Insert(nullptr, 1, 100));
-  EXPECT_FALSE(ht.Remove(nullptr, 1, 2));
-  EXPECT_EQ(1, ht.GetGlobalDepth());
-  ht.VerifyIntegrity();
-  for (int i = 0; i < 496; i++) {
-    EXPECT_TRUE(ht.Remove(nullptr, i, i));
-    ht.VerifyIntegrity();
-  }
-  EXPECT_TRUE(ht.Remove(nullptr, 1, 100));
-  EXPECT_EQ(0, ht.GetGlobalDepth());
-  ht.VerifyIntegrity();
+  EXPECT_EQ(0, ht->GetGlobalDepth());
+  ht->VerifyIntegrity();
+  EXPECT_FALSE(ht->Insert(nullptr, 0, 0));
+  EXPECT_EQ(0, ht->GetGlobalDepth());
+  ht->VerifyIntegrity();
+  EXPECT_TRUE(ht->Insert(nullptr, 1, 100));
+  EXPECT_FALSE(ht->Remove(nullptr, 1, 2));
+  EXPECT_EQ(1, ht->GetGlobalDepth());
+  ht->VerifyIntegrity();
+  for (int i = 0; i < 441; i++) {
+    EXPECT_TRUE(ht->Remove(nullptr, i, i));
+    ht->VerifyIntegrity();
+  }
+  EXPECT_TRUE(ht->Remove(nullptr, 1, 100));
+  EXPECT_EQ(0, ht->GetGlobalDepth());
+  ht->VerifyIntegrity();
+
+  delete ht;
+  disk_manager->ShutDown();
+  remove("test.db");
+  delete disk_manager;
+  delete bpm;
+}
+
+// Lookups of keys already inserted always succeed while other threads split and merge buckets.
+TEST(HashTableTest, ConcurrentSplitTest) {
+  auto *disk_manager = new DiskManager("test.db");
+  auto *bpm = new BufferPoolManagerInstance(100, disk_manager);
+  auto *ht = new ExtendibleHashTable<int, int, IntComparator>("blah", bpm, IntComparator(), HashFunction<int>());
+  const int num_writers = 4;
+  const int per_writer = 5000;
+  std::atomic<int> inserted[num_writers] = {};
+  std::atomic<bool> done{false};
+
+  std::vector<std::thread> threads;
+  for (int w = 0; w < num_writers; w++) {
+    threads.emplace_back([&, w] {
+      for (int i = 0; i < per_writer; i++) {
+        EXPECT_TRUE(ht->Insert(nullptr, w * per_writer + i, i));
+        inserted[w] = i + 1;
+      }
+      // the first half is removed again, which merges buckets
+      for (int i = 0; i < per_writer / 2; i++) {
+        EXPECT_TRUE(ht->Remove(nullptr, w * per_writer + i, i));
+      }
+    });
+  }
+  std::thread reader([&] {
+    std::mt19937 gen(0);
+    while (!done) {
+      int w = gen() % num_writers;
+      int count = inserted[w];
+      // the upper half is never removed
+      if (count <= per_writer / 2) {
+        continue;
+      }
+      int i = per_writer / 2 + gen() % (count - per_writer / 2);
+      std::vector<int> res;
+      EXPECT_TRUE(ht->GetValue(nullptr, w * per_writer + i, &res));
+      EXPECT_EQ(res, std::vector<int>{i});
+    }
+  });
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  done = true;
+  reader.join();
+
+  ht->VerifyIntegrity();
+  for (int w = 0; w < num_writers; w++) {
+    for (int i = 0; i < per_writer; i++) {
+      std::vector<int> res;
+      EXPECT_EQ(ht->GetValue(nullptr, w * per_writer + i, &res), i >= per_writer / 2);
+    }
+  }
+
+  delete ht;
+  disk_manager->ShutDown();
+  remove("test.db");
+  delete disk_manager;
+  delete bpm;
+}
+
+// The directory outgrows its page: the entries past DIRECTORY_ARRAY_SIZE are kept in segment pages.
+TEST(HashTableTest, MultiPageDirectoryTest) {
+  auto *disk_manager = new DiskManager("test.db");
+  auto *bpm = new BufferPoolManagerInstance(64, disk_manager);
+  auto *ht = new ExtendibleHashTable<int, int, IntComparator>("blah", bpm, IntComparator(), HashFunction<int>());
+  const int num_keys = 300000;
+  for (int i = 0; i < num_keys; i++) {
+    ASSERT_TRUE(ht->Insert(nullptr, i, i));
+  }
+  EXPECT_GT(ht->GetGlobalDepth(), 9);
+  ht->VerifyIntegrity();
+  // opened again, the table mirrors the segments from their pages
+  page_id_t directory_page_id = ht->GetDirectoryPageId();
+  delete ht;
+  ht = new ExtendibleHashTable<int, int, IntComparator>("blah", bpm, IntComparator(), HashFunction<int>(),
+                                                         directory_page_id);
+  ht->VerifyIntegrity();
+  for (int i = 0; i < num_keys; i++) {
+    std::vector<int> res;
+    ht->GetValue(nullptr, i, &res);
+    ASSERT_EQ(res, std::vector<int>{i});
+  }
+  for (int i = 0; i < num_keys; i++) {
+    ASSERT_TRUE(ht->Remove(nullptr, i, i));
+  }
+  ht->VerifyIntegrity();
+  std::vector<int> res;
+  EXPECT_FALSE(ht->GetValue(nullptr, 0, &res));
+
+  delete ht;
+  disk_manager->ShutDown();
+  remove("test.db");
+  delete disk_manager;
+  delete bpm;
+}
+
+// Keys whose hashes share their low 13 bits split one bucket until the directory spans 32 pages, which a pool of 16
+// frames holds as long as the directory keeps only the segment pages it copies or writes pinned.
+TEST(HashTableTest, SmallPoolDirectoryTest) {
+  auto *disk_manager = new DiskManager("test.db");
+  auto *bpm = new BufferPoolManagerInstance(16, disk_manager);
+  auto *ht = new ExtendibleHashTable<int, int, IntComparator>("blah", bpm, IntComparator(), HashFunction<int>());
+  HashFunction<int> hash_fn;
+  std::vector<int> keys;
+  for (int i = 0; keys.size() != 600; i++) {
+    if ((hash_fn.GetHash(i) & 0x1FFF) == 0) {
+      keys.push_back(i);
+    }
+  }
+  for (int key : keys) {
+    ASSERT_TRUE(ht->Insert(nullptr, key, key));
+  }
+  EXPECT_GT(ht->GetGlobalDepth(), 13);
+  ht->VerifyIntegrity();
+  // opened again, the table mirrors the segments through the same pool, one of them at a time
+  page_id_t directory_page_id = ht->GetDirectoryPageId();
+  delete ht;
+  ht = new ExtendibleHashTable<int, int, IntComparator>("blah", bpm, IntComparator(), HashFunction<int>(),
+                                                         directory_page_id);
+  for (int key : keys) {
+    std::vector<int> res;
+    ht->GetValue(nullptr, key, &res);
+    ASSERT_EQ(res, std::vector<int>{key});
+  }
+  for (int key : keys) {
+    ASSERT_TRUE(ht->Remove(nullptr, key, key));
+  }
+  ht->VerifyIntegrity();
+  std::vector<int> res;
+  EXPECT_FALSE(ht->GetValue(nullptr, keys[0], &res));
+
+  delete ht;
+  disk_manager->ShutDown();
+  remove("test.db");
+  delete disk_manager;
+  delete bpm;
+}
+
+// An empty table is sized for the pairs up front; a table that is not empty takes them one by one.
+TEST(HashTableTest, BulkLoadTest) {
+  auto *disk_manager = new DiskManager("test.db");
+  auto *bpm = new BufferPoolManagerInstance(50, disk_manager);
+  auto *ht = new ExtendibleHashTable<int, int, IntComparator>("blah", bpm, IntComparator(), HashFunction<int>());
+  const int num_keys = 100000;
+  std::vector<std::pair<int, int>> pairs;
+  for (int i = 0; i < num_keys; i++) {
+    pairs.emplace_back(i, i);
+  }
+  EXPECT_TRUE(ht->BulkLoad(nullptr, pairs));
+  EXPECT_GT(ht->GetGlobalDepth(), 7);
+  ht->VerifyIntegrity();
+  for (int i = 0; i < num_keys; i++) {
+    std::vector<int> res;
+    ht->GetValue(nullptr, i, &res);
+    ASSERT_EQ(res, std::vector<int>{i});
+  }
+
+  pairs.clear();
+  for (int i = 0; i < num_keys; i++) {
+    pairs.emplace_back(i, -i - 1);
+  }
+  // a duplicate
+  pairs.emplace_back(0, 0);
+  EXPECT_FALSE(ht->BulkLoad(nullptr, pairs));
+  ht->VerifyIntegrity();
+  for (int i = 0; i < num_keys; i++) {
+    std::vector<int> res;
+    ht->GetValue(nullptr, i, &res);
+    ASSERT_EQ(2, res.size());
+  }
+
+  delete ht;
+  disk_manager->ShutDown();
+  remove("test.db");
+  delete disk_manager;
+  delete bpm;
+}
+
+// Inserts made while an empty table is bulk loaded are found afterwards, whichever of the two goes first.
+TEST(HashTableTest, ConcurrentBulkLoadTest) {
+  auto *disk_manager = new DiskManager("test.db");
+  auto *bpm = new BufferPoolManagerInstance(50, disk_manager);
+  auto *ht = new ExtendibleHashTable<int, int, IntComparator>("blah", bpm, IntComparator(), HashFunction<int>());
+  const int num_keys = 50000;
+  const int num_writers = 2;
+  const int per_writer = 2000;
+  std::vector<std::pair<int, int>> pairs;
+  for (int i = 0; i < num_keys; i++) {
+    pairs.emplace_back(i, i);
+  }
+  std::vector<std::thread> threads;
+  threads.emplace_back([&] { EXPECT_TRUE(ht->BulkLoad(nullptr, pairs)); });
+  for (int w = 0; w < num_writers; w++) {
+    threads.emplace_back([&, w] {
+      for (int i = 0; i < per_writer; i++) {
+        EXPECT_TRUE(ht->Insert(nullptr, num_keys + w * per_writer + i, i));
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  ht->VerifyIntegrity();
+  for (int i = 0; i < num_keys; i++) {
+    std::vector<int> res;
+    ht->GetValue(nullptr, i, &res);
+    ASSERT_EQ(res, std::vector<int>{i});
+  }
+  for (int w = 0; w < num_writers; w++) {
+    for (int i = 0; i < per_writer; i++) {
+      std::vector<int> res;
+      ht->GetValue(nullptr, num_keys + w * per_writer + i, &res);
+      ASSERT_EQ(res, std::vector<int>{i});
+    }
+  }
+
+  delete ht;
+  disk_manager->ShutDown();
+  remove("test.db");
+  delete disk_manager;
+  delete bpm;
+}
+
+/** Counts the pages fetched through it. */
+class CountingBufferPoolManager : public BufferPoolManagerInstance {
+ public:
+  using BufferPoolManagerInstance::BufferPoolManagerInstance;
+
+  std::atomic<size_t> fetches_{0};
+
+ protected:
+  auto FetchPgImp(page_id_t page_id) -> Page * override {
+    fetches_++;
+    return BufferPoolManagerInstance::FetchPgImp(page_id);
+  }
+};
+
+// The directory stays pinned and mirrored: a lookup fetches its bucket page only.
+TEST(HashTableTest, LookupFetchTest) {
+  auto *disk_manager = new DiskManager("test.db");
+  auto *bpm = new CountingBufferPoolManager(50, disk_manager);
+  auto *ht = new ExtendibleHashTable<int, int, IntComparator>("blah", bpm, IntComparator(), HashFunction<int>());
+  const int num_keys = 20000;
+  for (int i = 0; i < num_keys; i++) {
+    ASSERT_TRUE(ht->Insert(nullptr, i, i));
+  }
+  EXPECT_GT(ht->GetGlobalDepth(), 4);
+  for (int i = 0; i < num_keys; i++) {
+    std::vector<int> res;
+    size_t fetches = bpm->fetches_;
+    ht->GetValue(nullptr, i, &res);
+    ASSERT_EQ(1, bpm->fetches_ - fetches);
+    ASSERT_EQ(res, std::vector<int>{i});
+  }
 
+  delete ht;
   disk_manager->ShutDown();
   remove("test.db");
   delete disk_manager;
@@ -11,18 +11,22 @@
 //===----------------------------------------------------------------------===//
 
 #include <string>
+#include <thread>  // NOLINT
 #include <vector>
 
 #include "common/bustub_instance.h"
 #include "common/config.h"
 #include "concurrency/lock_manager.h"
 #include "concurrency/transaction_manager.h"
+#include "container/hash/extendible_hash_table.h"
 #include "gtest/gtest.h"
 #include "logging/common.h"
+#include "recovery/log_reader.h"
 #include "recovery/log_recovery.h"
 #include "storage/table/table_heap.h"
 #include "storage/table/table_iterator.h"
 #include "storage/table/tuple.h"
+#include "type/value_factory.h"
 
 namespace bustub {
 
@@ -314,4 +318,283 @@ TEST_F(RecoveryTest, DISABLED_CheckpointTest) {
   LOG_INFO("Shutdown System");
   delete bustub_instance;
 }
+
+// NOLINTNEXTLINE
+TEST_F(RecoveryTest, DeltaUpdateTest) {
+  auto *bustub_instance = new BustubInstance("test.db");
+  bustub_instance->log_manager_->RunFlushThread();
+  ASSERT_TRUE(enable_logging);
+
+  Column col1{"a", TypeId::VARCHAR, 20};
+  Column col2{"b", TypeId::INTEGER};
+  std::vector<Column> cols{col1, col2};
+  Schema schema{cols};
+  auto make_tuple = [&](int32_t b) {
+    return Tuple({ValueFactory::GetVarcharValue("a wide column we never touch"), ValueFactory::GetIntegerValue(b)},
+                 &schema);
+  };
+
+  // changing one integer column should log far fewer bytes than both tuple images
+  TupleDelta delta(make_tuple(1), make_tuple(2));
+  EXPECT_EQ(1, delta.GetRangeCount());
+  LogRecord delta_record(0, INVALID_LSN, LogRecordType::DELTAUPDATE, RID{}, delta);
+  LogRecord full_record(0, INVALID_LSN, LogRecordType::UPDATE, RID{}, make_tuple(1), make_tuple(2));
+  EXPECT_LT(delta_record.GetSize() * 2, full_record.GetSize());
+
+  Transaction *txn = bustub_instance->transaction_manager_->Begin();
+  auto *test_table = new TableHeap(bustub_instance->buffer_pool_manager_, bustub_instance->lock_manager_,
+                                   bustub_instance->log_manager_, txn);
+  page_id_t first_page_id = test_table->GetFirstPageId();
+  RID rid;
+  ASSERT_TRUE(test_table->InsertTuple(make_tuple(1), &rid, txn));
+  bustub_instance->transaction_manager_->Commit(txn);
+  delete txn;
+
+  // committed delta update, must be redone
+  txn = bustub_instance->transaction_manager_->Begin();
+  ASSERT_TRUE(test_table->UpdateTuple(make_tuple(2), rid, txn));
+  bustub_instance->transaction_manager_->Commit(txn);
+  delete txn;
+
+  // uncommitted delta update reaching disk, must be undone
+  txn = bustub_instance->transaction_manager_->Begin();
+  ASSERT_TRUE(test_table->UpdateTuple(make_tuple(3), rid, txn));
+  bustub_instance->buffer_pool_manager_->FlushPage(first_page_id);
+  delete txn;
+  delete test_table;
+
+  LOG_INFO("System crash before commit");
+  delete bustub_instance;
+  bustub_instance = new BustubInstance("test.db");
+
+  auto *log_recovery = new LogRecovery(bustub_instance->disk_manager_, bustub_instance->buffer_pool_manager_);
+  log_recovery->Redo();
+  log_recovery->Undo();
+
+  txn = bustub_instance->transaction_manager_->Begin();
+  test_table = new TableHeap(bustub_instance->buffer_pool_manager_, bustub_instance->lock_manager_,
+                             bustub_instance->log_manager_, first_page_id);
+  Tuple tuple;
+  ASSERT_TRUE(test_table->GetTuple(rid, &tuple, txn));
+  EXPECT_EQ(tuple.GetValue(&schema, 1).CompareEquals(ValueFactory::GetIntegerValue(2)), CmpBool::CmpTrue);
+  bustub_instance->transaction_manager_->Commit(txn);
+
+  delete txn;
+  delete test_table;
+  delete log_recovery;
+  delete bustub_instance;
+}
+
+TEST_F(RecoveryTest, HashIndexTest) {
+  auto *bustub_instance = new BustubInstance("test.db");
+  bustub_instance->log_manager_->RunFlushThread();
+  ASSERT_TRUE(enable_logging);
+
+  // committed inserts, enough to split buckets and grow the directory
+  Transaction *txn = bustub_instance->transaction_manager_->Begin();
+  auto *ht = new ExtendibleHashTable<int, int, IntComparator>("index", bustub_instance->buffer_pool_manager_,
+                                                               IntComparator(), HashFunction<int>(),
+                                                               bustub_instance->log_manager_);
+  page_id_t directory_page_id = ht->GetDirectoryPageId();
+  for (int i = 0; i < 1500; i++) {
+    ASSERT_TRUE(ht->Insert(txn, i, i));
+  }
+  ASSERT_GT(ht->GetGlobalDepth(), 1);
+  bustub_instance->transaction_manager_->Commit(txn);
+  delete txn;
+
+  // uncommitted inserts (which split again) and removes, all in the log
+  txn = bustub_instance->transaction_manager_->Begin();
+  for (int i = 1500; i < 2500; i++) {
+    ASSERT_TRUE(ht->Insert(txn, i, i));
+  }
+  for (int i = 0; i < 100; i++) {
+    ASSERT_TRUE(ht->Remove(txn, i, i));
+  }
+  bustub_instance->log_manager_->Flush();
+  delete txn;
+  delete ht;
+
+  LOG_INFO("System crash before commit");
+  delete bustub_instance;
+  bustub_instance = new BustubInstance("test.db");
+
+  auto *log_recovery = new LogRecovery(bustub_instance->disk_manager_, bustub_instance->buffer_pool_manager_);
+  log_recovery->Redo();
+  log_recovery->Undo();
+
+  ht = new ExtendibleHashTable<int, int, IntComparator>("index", bustub_instance->buffer_pool_manager_,
+                                                         IntComparator(), HashFunction<int>(), directory_page_id);
+  ht->VerifyIntegrity();
+  for (int i = 0; i < 2500; i++) {
+    std::vector<int> result;
+    ht->GetValue(nullptr, i, &result);
+    if (i < 1500) {
+      ASSERT_EQ(1, result.size()) << "key " << i;
+      EXPECT_EQ(i, result[0]);
+    } else {
+      EXPECT_TRUE(result.empty()) << "key " << i;
+    }
+  }
+
+  delete ht;
+  delete log_recovery;
+  delete bustub_instance;
+}
+
+// The segment pages of a directory that outgrew its page are recovered with it.
+TEST_F(RecoveryTest, HashIndexSegmentTest) {
+  auto *bustub_instance = new BustubInstance("test.db");
+  bustub_instance->log_manager_->RunFlushThread();
+  ASSERT_TRUE(enable_logging);
+
+  auto *ht = new ExtendibleHashTable<int, int, IntComparator>("index", bustub_instance->buffer_pool_manager_,
+                                                               IntComparator(), HashFunction<int>(),
+                                                               bustub_instance->log_manager_);
+  page_id_t directory_page_id = ht->GetDirectoryPageId();
+  const int num_keys = 300000;
+  for (int i = 0; i < num_keys; i++) {
+    ASSERT_TRUE(ht->Insert(nullptr, i, i));
+  }
+  ASSERT_GT(ht->GetGlobalDepth(), 9);
+  bustub_instance->log_manager_->Flush();
+  delete ht;
+
+  LOG_INFO("System crash");
+  delete bustub_instance;
+  bustub_instance = new BustubInstance("test.db");
+
+  auto *log_recovery = new LogRecovery(bustub_instance->disk_manager_, bustub_instance->buffer_pool_manager_);
+  log_recovery->Redo();
+  log_recovery->Undo();
+
+  ht = new ExtendibleHashTable<int, int, IntComparator>("index", bustub_instance->buffer_pool_manager_,
+                                                         IntComparator(), HashFunction<int>(), directory_page_id);
+  ht->VerifyIntegrity();
+  for (int i = 0; i < num_keys; i++) {
+    std::vector<int> result;
+    ht->GetValue(nullptr, i, &result);
+    ASSERT_EQ(result, std::vector<int>{i}) << "key " << i;
+  }
+
+  delete ht;
+  delete log_recovery;
+  delete bustub_instance;
+}
+
+TEST_F(RecoveryTest, LogReaderTest) {
+  auto *disk_manager = new DiskManager("test.db");
+  auto *log_manager = new LogManager(disk_manager);
+  log_manager->RunFlushThread();
+
+  // tuples of growing size, so records straddle the small blocks at every possible cut
+  Column col{"a", TypeId::VARCHAR, 200};
+  Schema schema{std::vector<Column>{col}};
+  std::vector<lsn_t> lsns;
+  std::vector<uint32_t> lengths;
+  for (int i = 0; i < 200; i++) {
+    Tuple tuple({ValueFactory::GetVarcharValue(std::string(i, 'x'))}, &schema);
+    LogRecord log_record(i, INVALID_LSN, LogRecordType::INSERT, RID(0, i), tuple);
+    lsns.push_back(log_manager->AppendLogRecord(&log_record));
+    lengths.push_back(tuple.GetLength());
+  }
+  log_manager->Flush();
+
+  for (int block_size : {64, 1000, LOG_BUFFER_SIZE}) {
+    LogReader reader(disk_manager, block_size);
+    size_t i = 0;
+    int offset = 0;
+    for (auto it = reader.Begin(); it != reader.End(); ++it, ++i) {
+      ASSERT_LT(i, lsns.size());
+      EXPECT_EQ(lsns[i], it->GetLSN());
+      EXPECT_EQ(LogRecordType::INSERT, it->GetLogRecordType());
+      EXPECT_EQ(RID(0, i), it->GetInsertRID());
+      EXPECT_EQ(lengths[i], it->GetInsertTuple().GetLength());
+      EXPECT_EQ(offset, reader.GetOffset());
+      offset += it->GetSize();
+    }
+    EXPECT_EQ(lsns.size(), i) << "block size " << block_size;
+  }
+
+  log_manager->StopFlushThread();
+  disk_manager->ShutDown();
+  delete log_manager;
+  delete disk_manager;
+}
+
+TEST_F(RecoveryTest, GroupCommitTest) {
+  auto *bustub_instance = new BustubInstance("test.db");
+  bustub_instance->log_manager_->RunFlushThread();
+  ASSERT_TRUE(enable_logging);
+  auto saved_max_wait = group_commit_max_wait;
+  auto saved_max_batch = group_commit_max_batch;
+  group_commit_max_wait = std::chrono::milliseconds(100);
+  group_commit_max_batch = 4;
+
+  const int num_threads = 4;
+  const int commits_per_thread = 25;
+  int flushes_before = bustub_instance->disk_manager_->GetNumFlushes();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_threads; i++) {
+    threads.emplace_back([&] {
+      for (int j = 0; j < commits_per_thread; j++) {
+        Transaction *txn = bustub_instance->transaction_manager_->Begin();
+        bustub_instance->transaction_manager_->Commit(txn);
+        // the commit record is durable as soon as Commit returns
+        EXPECT_LE(txn->GetPrevLSN(), bustub_instance->log_manager_->GetPersistentLSN());
+        delete txn;
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  // committers share log writes instead of forcing one each
+  int flushes = bustub_instance->disk_manager_->GetNumFlushes() - flushes_before;
+  EXPECT_LT(flushes, num_threads * commits_per_thread / 2);
+
+  group_commit_max_wait = saved_max_wait;
+  group_commit_max_batch = saved_max_batch;
+  delete bustub_instance;
+}
+
+TEST_F(RecoveryTest, EarlyLockReleaseTest) {
+  auto *bustub_instance = new BustubInstance("test.db");
+  bustub_instance->log_manager_->RunFlushThread();
+  ASSERT_TRUE(enable_logging);
+  auto saved_max_wait = group_commit_max_wait;
+  auto saved_max_batch = group_commit_max_batch;
+  // the first commit waits for a second one before it forces the log
+  group_commit_max_wait = std::chrono::milliseconds(500);
+  group_commit_max_batch = 2;
+
+  auto *txn_mgr = bustub_instance->transaction_manager_;
+  auto *lock_mgr = bustub_instance->lock_manager_;
+  RID rid(0, 0);
+  Transaction *txn1 = txn_mgr->Begin();
+  Transaction *txn2 = txn_mgr->Begin();
+  ASSERT_TRUE(lock_mgr->LockExclusive(txn1, rid));
+
+  std::thread committer2([&] {
+    // younger, so it waits for txn1
+    ASSERT_TRUE(lock_mgr->LockExclusive(txn2, rid));
+    // the lock is handed over before the commit that released it is durable
+    EXPECT_EQ(txn1->GetPrevLSN(), txn2->GetDependencyLSN());
+    EXPECT_LT(bustub_instance->log_manager_->GetPersistentLSN(), txn2->GetDependencyLSN());
+    txn_mgr->Commit(txn2);
+    EXPECT_LE(txn2->GetPrevLSN(), bustub_instance->log_manager_->GetPersistentLSN());
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  std::thread committer1([&] { txn_mgr->Commit(txn1); });
+  committer2.join();
+  committer1.join();
+  EXPECT_LE(txn1->GetPrevLSN(), bustub_instance->log_manager_->GetPersistentLSN());
+
+  delete txn1;
+  delete txn2;
+  group_commit_max_wait = saved_max_wait;
+  group_commit_max_batch = saved_max_batch;
+  delete bustub_instance;
+}
+
 }  // namespace bustub
@@ -0,0 +1,89 @@
+// Commits per second against the number of concurrent committers, every commit waiting for its log record to be
+// persistent. With "hot", every transaction also locks the same row exclusively before it commits.
+// Usage: bustub-commit-bench [seconds per run] [group commit max wait in us] [group commit max batch] [hot]
+
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "common/config.h"
+#include "concurrency/lock_manager.h"
+#include "concurrency/transaction_manager.h"
+#include "recovery/log_manager.h"
+#include "storage/disk/disk_manager.h"
+
+auto main(int argc, char **argv) -> int {
+  using bustub::DiskManager;
+  using bustub::LockManager;
+  using bustub::LogManager;
+  using bustub::Transaction;
+  using bustub::TransactionManager;
+
+  double seconds = argc > 1 ? std::atof(argv[1]) : 1.0;
+  if (argc > 2) {
+    bustub::group_commit_max_wait = std::chrono::microseconds(std::atoi(argv[2]));
+  }
+  if (argc > 3) {
+    bustub::group_commit_max_batch = std::atoi(argv[3]);
+  }
+  bool hot = argc > 4 && std::string(argv[4]) == "hot";
+  std::printf("group commit max wait %lld us, max batch %d%s\n",
+              static_cast<long long>(bustub::group_commit_max_wait.count()),  // NOLINT
+              bustub::group_commit_max_batch, hot ? ", one hot row" : "");
+  std::printf("%10s %14s %14s\n", "committers", "commits/s", "commits/write");
+
+  for (int committers = 1; committers <= 64; committers *= 2) {
+    std::remove("commit_bench.db");
+    std::remove("commit_bench.log");
+    auto *disk_manager = new DiskManager("commit_bench.db");
+    auto *log_manager = new LogManager(disk_manager);
+    auto *lock_manager = new LockManager();
+    auto *txn_mgr = new TransactionManager(lock_manager, log_manager);
+    log_manager->RunFlushThread();
+
+    std::atomic<bool> stop{false};
+    std::atomic<int64_t> commits{0};
+    std::vector<std::thread> threads;
+    int flushes_before = disk_manager->GetNumFlushes();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < committers; i++) {
+      threads.emplace_back([&] {
+        int64_t done = 0;
+        while (!stop) {
+          Transaction *txn = txn_mgr->Begin();
+          if (hot && !lock_manager->LockExclusive(txn, bustub::RID(0, 0))) {
+            txn_mgr->Abort(txn);
+            delete txn;
+            continue;
+          }
+          txn_mgr->Commit(txn);
+          delete txn;
+          ++done;
+        }
+        commits += done;
+      });
+    }
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    stop = true;
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    int writes = std::max(1, disk_manager->GetNumFlushes() - flushes_before);
+    std::printf("%10d %14.0f %14.2f\n", committers, commits / elapsed, static_cast<double>(commits) / writes);
+
+    log_manager->StopFlushThread();
+    disk_manager->ShutDown();
+    delete txn_mgr;
+    delete lock_manager;
+    delete log_manager;
+    delete disk_manager;
+  }
+  std::remove("commit_bench.db");
+  std::remove("commit_bench.log");
+  return 0;
+}
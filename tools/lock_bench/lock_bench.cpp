@@ -0,0 +1,129 @@
+// Throughput and abort rate of the deadlock policies against the number of concurrent transactions. Every transaction
+// locks a few rows of a small table exclusively, in random order, and commits. The scheduled run goes through a
+// TransactionScheduler instead, which admits as many transactions at once as there are cores, retries them after a
+// backoff and runs those on the hottest rows one after the other. A last run takes increment locks, as updates of hot
+// counters do. The lock contention of the run with the most threads is dumped after it.
+// Usage: bustub-lock-bench [seconds per run] [rows] [locks per transaction] [cycle detection interval in ms]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <cstdio>
+#include <cstdlib>
+#include <numeric>
+#include <random>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "common/config.h"
+#include "concurrency/lock_manager.h"
+#include "concurrency/transaction_manager.h"
+#include "concurrency/transaction_scheduler.h"
+
+auto main(int argc, char **argv) -> int {
+  using bustub::LockManager;
+  using bustub::Transaction;
+  using bustub::TransactionManager;
+  using bustub::TransactionScheduler;
+  using bustub::TransactionState;
+
+  double seconds = argc > 1 ? std::atof(argv[1]) : 1.0;
+  int rows = argc > 2 ? std::atoi(argv[2]) : 64;
+  int locks = argc > 3 ? std::min(rows, std::atoi(argv[3])) : 4;
+  if (argc > 4) {
+    bustub::cycle_detection_interval = std::chrono::milliseconds(std::atoi(argv[4]));
+  }
+  std::printf("%d rows, %d locks per transaction, cycle detection every %lld ms\n", rows, locks,
+              static_cast<long long>(bustub::cycle_detection_interval.count()));  // NOLINT
+  std::printf("%12s %8s %14s %12s\n", "run", "threads", "commits/s", "abort rate");
+
+  struct Run {
+    const char *name_;
+    LockManager::DeadlockPolicy policy_;
+    bool increment_;
+    bool scheduled_;
+  };
+  for (const Run &run : {Run{"wound-wait", LockManager::DeadlockPolicy::WOUND_WAIT, false, false},
+                         Run{"detection", LockManager::DeadlockPolicy::DETECTION, false, false},
+                         Run{"scheduled", LockManager::DeadlockPolicy::WOUND_WAIT, false, true},
+                         Run{"increment", LockManager::DeadlockPolicy::WOUND_WAIT, true, false}}) {
+    for (int threads = 1; threads <= 32; threads *= 2) {
+      auto *lock_manager = new LockManager(bustub::LOCK_TABLE_SHARDS, run.policy_);
+      auto *txn_mgr = new TransactionManager(lock_manager);
+      TransactionScheduler *scheduler = nullptr;
+      if (run.scheduled_) {
+        scheduler = new TransactionScheduler(txn_mgr, lock_manager, std::max(1U, std::thread::hardware_concurrency()),
+                                             1000, 4);
+      }
+
+      std::atomic<bool> stop{false};
+      std::atomic<int64_t> commits{0};
+      std::atomic<int64_t> aborts{0};
+      std::vector<std::thread> workers;
+      auto start = std::chrono::steady_clock::now();
+      for (int i = 0; i < threads; i++) {
+        workers.emplace_back([&, i] {
+          std::mt19937 gen(i);
+          std::vector<int> slots(rows);
+          std::iota(slots.begin(), slots.end(), 0);
+          int64_t committed = 0;
+          int64_t aborted = 0;
+          while (!stop) {
+            std::shuffle(slots.begin(), slots.end(), gen);
+            std::vector<bustub::RID> keys;
+            for (int j = 0; j < locks; j++) {
+              keys.emplace_back(0, slots[j]);
+            }
+            auto body = [&](Transaction *txn) {
+              for (const bustub::RID &rid : keys) {
+                if (!(run.increment_ ? lock_manager->LockIncrement(txn, rid) : lock_manager->LockExclusive(txn, rid))) {
+                  break;
+                }
+              }
+              return true;
+            };
+            if (scheduler != nullptr) {
+              scheduler->Run(body, keys);
+              continue;
+            }
+            Transaction *txn = txn_mgr->Begin();
+            body(txn);
+            // a wound may also come after the last lock
+            if (txn->GetState() != TransactionState::ABORTED) {
+              txn_mgr->Commit(txn);
+              ++committed;
+            } else {
+              txn_mgr->Abort(txn);
+              ++aborted;
+            }
+            delete txn;
+          }
+          commits += committed;
+          aborts += aborted;
+        });
+      }
+      std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+      stop = true;
+      for (auto &worker : workers) {
+        worker.join();
+      }
+      double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      if (scheduler != nullptr) {
+        TransactionScheduler::Stats stats = scheduler->GetStats();
+        commits = stats.commits_;
+        aborts = stats.retries_ + stats.failures_;
+      }
+      double abort_rate = static_cast<double>(aborts) / std::max<int64_t>(1, commits + aborts);
+      std::printf("%12s %8d %14.0f %11.1f%%\n", run.name_, threads, commits / elapsed, 100 * abort_rate);
+      if (threads == 32) {
+        // where the busiest run waited
+        std::printf("%s", lock_manager->GetStats(3).ToString().c_str());
+      }
+
+      delete scheduler;
+      delete txn_mgr;
+      delete lock_manager;
+    }
+  }
+  return 0;
+}